@@ -45,6 +45,15 @@
 
 /* USER CODE BEGIN Includes */   	      
 /* Section where include file can be added */
+#if defined(__ICCARM__) || defined(__CC_ARM) || defined(__GNUC__)
+  #include <stdint.h>
+  /* Run time counter (see cycles.h) */
+  void Cycles_Start(void);
+  uint32_t Cycles_Task_Time(void);
+  /* Heap use (see health.h) */
+  void Health_Heap_Allocated(void);
+  #include "../Src/trace.h" /* Core/Src isn't on the include path of the kernel sources */
+#endif
 /* USER CODE END Includes */ 
 
 /* Ensure definitions are only used by the compiler, and not by the assembler. */
@@ -60,11 +69,12 @@
 #define configSUPPORT_DYNAMIC_ALLOCATION         1
 #define configUSE_IDLE_HOOK                      0
 #define configUSE_TICK_HOOK                      0
+#define configUSE_TICKLESS_IDLE                  2
 #define configCPU_CLOCK_HZ                       ( SystemCoreClock )
 #define configTICK_RATE_HZ                       ((TickType_t)1000)
 #define configMAX_PRIORITIES                     ( 56 )
 #define configMINIMAL_STACK_SIZE                 ((uint16_t)128)
-#define configTOTAL_HEAP_SIZE                    ((size_t)15360)
+#define configTOTAL_HEAP_SIZE                    ((size_t)1024)
 #define configMAX_TASK_NAME_LEN                  ( 16 )
 #define configUSE_TRACE_FACILITY                 1
 #define configUSE_16_BIT_TICKS                   0
@@ -85,7 +95,7 @@
 
 /* Software timer definitions. */
 #define configUSE_TIMERS                         1
-#define configTIMER_TASK_PRIORITY                ( 2 )
+#define configTIMER_TASK_PRIORITY                ( 24 )
 #define configTIMER_QUEUE_LENGTH                 10
 #define configTIMER_TASK_STACK_DEPTH             256
 
@@ -153,6 +163,25 @@ standard names. */
 
 /* USER CODE BEGIN Defines */   	      
 /* Section where parameter definitions can be added (for instance, to override default ones in FreeRTOS.h) */
+/* vPortSuppressTicksAndSleep is in sleep.c */
+#define configEXPECTED_IDLE_TIME_BEFORE_SLEEP    2
+/* Task run time in DWT cycles, less time in interrupt handlers (see cycles.h) */
+#define configGENERATE_RUN_TIME_STATS            1
+#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS() Cycles_Start()
+#define portGET_RUN_TIME_COUNTER_VALUE()         Cycles_Task_Time()
+/* RTOS events into the RAM trace (see trace.h) */
+#define traceTASK_SWITCHED_IN()                  Trace_Record( TRACE_TASK_SWITCHED_IN, pxCurrentTCB->uxTCBNumber, 0 )
+#define traceTASK_SWITCHED_OUT()                 Trace_Record( TRACE_TASK_SWITCHED_OUT, pxCurrentTCB->uxTCBNumber, 0 )
+#define traceTASK_NOTIFY()                       Trace_Record( TRACE_TASK_NOTIFY, pxTCB->uxTCBNumber, 0 )
+#define traceTASK_NOTIFY_FROM_ISR()              Trace_Record( TRACE_TASK_NOTIFY_FROM_ISR, pxTCB->uxTCBNumber, 0 )
+#define traceQUEUE_SEND( pxQueue )               Trace_Record( TRACE_QUEUE_SEND, ( pxQueue )->uxQueueNumber, ( pxQueue )->uxMessagesWaiting )
+#define traceQUEUE_SEND_FAILED( pxQueue )        Trace_Record( TRACE_QUEUE_SEND_FAILED, ( pxQueue )->uxQueueNumber, ( pxQueue )->uxMessagesWaiting )
+#define traceQUEUE_SEND_FROM_ISR( pxQueue )      Trace_Record( TRACE_QUEUE_SEND_FROM_ISR, ( pxQueue )->uxQueueNumber, ( pxQueue )->uxMessagesWaiting )
+#define traceQUEUE_RECEIVE( pxQueue )            Trace_Record( TRACE_QUEUE_RECEIVE, ( pxQueue )->uxQueueNumber, ( pxQueue )->uxMessagesWaiting )
+#define traceQUEUE_RECEIVE_FAILED( pxQueue )     Trace_Record( TRACE_QUEUE_RECEIVE_FAILED, ( pxQueue )->uxQueueNumber, ( pxQueue )->uxMessagesWaiting )
+#define traceQUEUE_RECEIVE_FROM_ISR( pxQueue )   Trace_Record( TRACE_QUEUE_RECEIVE_FROM_ISR, ( pxQueue )->uxQueueNumber, ( pxQueue )->uxMessagesWaiting )
+/* Every kernel object is static, so any allocation at all is news (see health.h) */
+#define traceMALLOC( pvAddress, uiSize )         Health_Heap_Allocated()
 /* USER CODE END Defines */ 
 
 #endif /* FREERTOS_CONFIG_H */
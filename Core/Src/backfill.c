@@ -0,0 +1,245 @@
+/**
+ * backfill.c
+ * Allen Snook
+ * October 19, 2026
+ *
+ * Records are sent oldest first. The cursor works up towards the limit
+ * (the oldest record the live frames still hold) and frames that are lost
+ * go out again ahead of anything new, so only what the gateway is missing
+ * is repeated. Once the cursor reaches the limit with nothing in flight, a
+ * new pass starts from the oldest record that still isn't acknowledged.
+ */
+
+#include "backfill.h"
+
+#ifndef TRUE
+#define TRUE UINT8_C(1)
+#endif
+#ifndef FALSE
+#define FALSE UINT8_C(0)
+#endif
+
+static obs_data_type backfill_records[BACKFILL_MAX_RECORDS];
+
+backfill_frame_type *_Backfill_Find( backfill_type *backfill, uint8_t state ) {
+	for ( uint8_t i = 0; i < BACKFILL_WINDOW; i++ ) {
+		if ( state == backfill->frames[i].state ) {
+			return &(backfill->frames[i]);
+		}
+	}
+	return 0;
+}
+
+/**
+ * Moves the oldest record up past everything acknowledged (or unreadable),
+ * then sends the cursor back to it
+ */
+void _Backfill_Start_Pass( backfill_type *backfill, uint32_t limit ) {
+	obs_data_type obs;
+	uint8_t acknowledged = FALSE;
+
+	while ( backfill->oldest < limit ) {
+		if ( BACKFILL_SUCCESS == backfill->store->read( backfill->oldest, &obs, &acknowledged ) && ! acknowledged ) {
+			break;
+		}
+		backfill->oldest++;
+	}
+
+	backfill->cursor = backfill->oldest;
+	if ( backfill->cursor < limit ) {
+		backfill->stats.passes++;
+	}
+}
+
+/**
+ * Reads the first run of consecutive unacknowledged records from *first up to end
+ * Moves *first past any it had to skip. Returns how many it read
+ */
+uint8_t _Backfill_Read_Run( backfill_type *backfill, uint32_t *first, uint32_t end ) {
+	uint8_t count = 0;
+	uint8_t acknowledged = FALSE;
+
+	for ( uint32_t id = *first; id < end && count < BACKFILL_MAX_RECORDS; id++ ) {
+		if ( BACKFILL_SUCCESS != backfill->store->read( id, &backfill_records[count], &acknowledged ) ) {
+			backfill->stats.unreadable++;
+			acknowledged = TRUE;
+		}
+		if ( acknowledged ) {
+			if ( count > 0 ) {
+				break;
+			}
+			*first = id + 1;
+			continue;
+		}
+		count++;
+	}
+
+	return count;
+}
+
+void Backfill_Init( backfill_type *backfill, const backfill_store_type *store, uint32_t oldest ) {
+	*backfill = (backfill_type) { 0 };
+	backfill->store = store;
+	backfill->oldest = oldest;
+	backfill->cursor = oldest;
+}
+
+/**
+ * Builds the next frame's payload from the records between tail (the oldest
+ * the store still has) and limit, into at most max_length bytes
+ * Returns its length, or 0 if there is nothing to send or the window is full
+ */
+uint16_t Backfill_Build_Frame( backfill_type *backfill, uint32_t tail, uint32_t limit, uint32_t now,
+	uint8_t *payload, uint16_t max_length ) {
+
+	backfill_frame_type *frame = _Backfill_Find( backfill, BACKFILL_FRAME_FREE );
+	if ( ! frame || max_length <= BACKFILL_PAYLOAD_HEADER_LENGTH ) {
+		return 0;
+	}
+
+	if ( backfill->oldest < tail ) {
+		backfill->oldest = tail;
+	}
+	if ( backfill->cursor < backfill->oldest ) {
+		backfill->cursor = backfill->oldest;
+	}
+
+	// Lost frames go again first, less anything acknowledged since
+	backfill_frame_type *lost = 0;
+	uint32_t first = 0;
+	uint32_t end = 0;
+	uint8_t count = 0;
+	while ( 0 == count ) {
+		lost = _Backfill_Find( backfill, BACKFILL_FRAME_LOST );
+		if ( lost ) {
+			first = lost->first < backfill->oldest ? backfill->oldest : lost->first;
+			end = lost->first + lost->count;
+		} else {
+			if ( backfill->cursor >= limit ) {
+				if ( Backfill_In_Flight( backfill ) ) {
+					return 0; // Wait to hear about them before looking for anything missed
+				}
+				_Backfill_Start_Pass( backfill, limit );
+				if ( backfill->cursor >= limit ) {
+					return 0;
+				}
+			}
+			first = backfill->cursor;
+			end = limit;
+		}
+
+		count = _Backfill_Read_Run( backfill, &first, end );
+		if ( 0 == count ) {
+			if ( lost ) {
+				lost->state = BACKFILL_FRAME_FREE;
+			} else {
+				backfill->cursor = end;
+			}
+		}
+	}
+
+	uint8_t records_length = 0;
+	uint16_t room = max_length - BACKFILL_PAYLOAD_HEADER_LENGTH;
+	uint8_t encoded = OBS_Encode( 0, backfill_records, count, &(payload[BACKFILL_PAYLOAD_HEADER_LENGTH]),
+		room > 0xFF ? 0xFF : (uint8_t) room, &records_length );
+	if ( 0 == encoded ) {
+		return 0;
+	}
+
+	// Whatever didn't fit stays lost, or waits for the cursor
+	if ( lost ) {
+		uint32_t next = first + encoded;
+		if ( next >= end ) {
+			lost->state = BACKFILL_FRAME_FREE;
+		} else {
+			lost->count = end - next;
+			lost->first = next;
+		}
+		backfill->stats.retransmitted += encoded;
+	} else {
+		backfill->cursor = first + encoded;
+	}
+
+	frame->state = BACKFILL_FRAME_IN_FLIGHT;
+	frame->sequence = backfill->sequence++;
+	frame->first = first;
+	frame->count = encoded;
+	frame->sent_at = now;
+
+	payload[0] = frame->sequence;
+	payload[1] = first >> 24;
+	payload[2] = ( first >> 16 ) & 0xFF;
+	payload[3] = ( first >> 8 ) & 0xFF;
+	payload[4] = first & 0xFF;
+	payload[5] = encoded;
+
+	backfill->stats.frames++;
+	backfill->stats.records += encoded;
+
+	return BACKFILL_PAYLOAD_HEADER_LENGTH + records_length;
+}
+
+/**
+ * A frame that never made it to the radio - its records go out again in the next one
+ */
+void Backfill_Cancel_Frame( backfill_type *backfill, const uint8_t *payload ) {
+	for ( uint8_t i = 0; i < BACKFILL_WINDOW; i++ ) {
+		backfill_frame_type *frame = &(backfill->frames[i]);
+		if ( BACKFILL_FRAME_IN_FLIGHT == frame->state && payload[0] == frame->sequence ) {
+			frame->state = BACKFILL_FRAME_LOST;
+			return;
+		}
+	}
+}
+
+/**
+ * The gateway received frame base, and base - n for each bit n set in bitmap
+ * Frames are sent in order, so a clear bit (or one that has fallen out of the
+ * bitmap) means that frame was lost
+ */
+void Backfill_Handle_Ack( backfill_type *backfill, uint8_t base, uint16_t bitmap ) {
+	for ( uint8_t i = 0; i < BACKFILL_WINDOW; i++ ) {
+		backfill_frame_type *frame = &(backfill->frames[i]);
+		if ( BACKFILL_FRAME_IN_FLIGHT != frame->state ) {
+			continue;
+		}
+
+		uint8_t behind = (uint8_t) ( base - frame->sequence );
+		if ( behind >= 0x80 ) {
+			continue; // Sent after base
+		}
+
+		if ( behind < BACKFILL_WINDOW && ( bitmap & ( 1U << behind ) ) ) {
+			backfill->store->acknowledge( frame->first, frame->first + frame->count - 1 );
+			frame->state = BACKFILL_FRAME_FREE;
+			backfill->stats.acked_frames++;
+			backfill->stats.acked_records += frame->count;
+		} else {
+			frame->state = BACKFILL_FRAME_LOST;
+			backfill->stats.nacked_frames++;
+		}
+	}
+}
+
+/**
+ * Frames in flight longer than timeout ms are taken as lost
+ */
+void Backfill_Expire( backfill_type *backfill, uint32_t now, uint32_t timeout ) {
+	for ( uint8_t i = 0; i < BACKFILL_WINDOW; i++ ) {
+		backfill_frame_type *frame = &(backfill->frames[i]);
+		if ( BACKFILL_FRAME_IN_FLIGHT == frame->state && now - frame->sent_at > timeout ) {
+			frame->state = BACKFILL_FRAME_LOST;
+			backfill->stats.timeouts++;
+		}
+	}
+}
+
+uint8_t Backfill_In_Flight( const backfill_type *backfill ) {
+	uint8_t count = 0;
+	for ( uint8_t i = 0; i < BACKFILL_WINDOW; i++ ) {
+		if ( BACKFILL_FRAME_FREE != backfill->frames[i].state ) {
+			count++;
+		}
+	}
+	return count;
+}
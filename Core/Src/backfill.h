@@ -0,0 +1,84 @@
+/**
+ * backfill.h
+ * Allen Snook
+ * October 19, 2026
+ *
+ * Bulk upload of logged observations the gateway never acknowledged
+ * Frames of consecutive records go out in a sliding window of up to
+ * BACKFILL_WINDOW frames, and the gateway answers with a bitmap of the
+ * last BACKFILL_WINDOW frames it received. Frames missing from the bitmap
+ * (or never answered for) are sent again, the rest are acknowledged in the log.
+ * No HAL or RTOS dependencies - the benchmark runs this on the host
+ */
+
+#ifndef __BACKFILL_H
+#define __BACKFILL_H
+
+#include <stdint.h>
+#include "obs.h"
+
+#define BACKFILL_SUCCESS 1
+#define BACKFILL_FAILURE 0
+
+// Frame Payload (follows the radio header)
+// Byte 0: backfill sequence number (its own, wrapping at 256)
+// Bytes 1 to 4: record id of the first record, big endian
+// Byte 5: number of records, which have consecutive ids
+// Byte 6 onward: records, bit packed (see obs.h), the first one standing alone
+#define BACKFILL_PAYLOAD_HEADER_LENGTH 6
+
+// Frames in flight at once, and bits in the gateway's bitmap (bit n is sequence base - n)
+#define BACKFILL_WINDOW 16
+
+// Most records read for one frame - more than fit in 255 bytes
+#define BACKFILL_MAX_RECORDS 128
+
+// Frame states
+#define BACKFILL_FRAME_FREE 0
+#define BACKFILL_FRAME_IN_FLIGHT 1
+#define BACKFILL_FRAME_LOST 2		// Its records go out again in the next frame
+
+typedef struct {
+	uint8_t state;
+	uint8_t sequence;
+	uint8_t count;
+	uint32_t first;
+	uint32_t sent_at;	// ms
+} backfill_frame_type;
+
+typedef struct {
+	uint32_t frames;			// Frames built
+	uint32_t records;			// Records sent, counting each time they go
+	uint32_t retransmitted;		// ... that had been sent before
+	uint32_t acked_frames;
+	uint32_t acked_records;
+	uint32_t nacked_frames;		// Missing from the gateway's bitmap
+	uint32_t timeouts;			// Never answered for
+	uint32_t unreadable;		// Records skipped because the store couldn't read them
+	uint32_t passes;			// Times the search started over from the oldest record
+} backfill_stats_type;
+
+// Where the records come from and where acknowledgements go (the flash log, on the board)
+typedef struct {
+	uint8_t ( *read )( uint32_t id, obs_data_type *obs, uint8_t *acknowledged );
+	void ( *acknowledge )( uint32_t first, uint32_t last );
+} backfill_store_type;
+
+typedef struct {
+	const backfill_store_type *store;
+	backfill_frame_type frames[BACKFILL_WINDOW];
+	uint32_t oldest;	// No record below this still needs sending
+	uint32_t cursor;	// Next record to look at
+	uint8_t sequence;	// For the next frame
+	backfill_stats_type stats;
+} backfill_type;
+
+void Backfill_Init( backfill_type *backfill, const backfill_store_type *store, uint32_t oldest );
+uint16_t Backfill_Build_Frame( backfill_type *backfill, uint32_t tail, uint32_t limit, uint32_t now,
+	uint8_t *payload, uint16_t max_length );
+void Backfill_Cancel_Frame( backfill_type *backfill, const uint8_t *payload );
+void Backfill_Handle_Ack( backfill_type *backfill, uint8_t base, uint16_t bitmap );
+void Backfill_Expire( backfill_type *backfill, uint32_t now, uint32_t timeout );
+uint8_t Backfill_In_Flight( const backfill_type *backfill );
+
+#endif // __BACKFILL_H
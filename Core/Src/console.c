@@ -0,0 +1,657 @@
+/**
+ * console.c
+ * Allen Snook
+ * October 19, 2026
+ *
+ * Debug console on the ST-LINK virtual COM port (USART3, 115200 8N1)
+ * Type a command and press enter - "help" lists them
+ */
+
+#include "console.h"
+#include "radio.h"
+#include "core.h"
+#include "pool.h"
+#include "mailbox.h"
+#include "gps.h"
+#include "thp.h"
+#include "sleep.h"
+#include "log.h"
+#include "health.h"
+#include "trace.h"
+#include "string.h"
+
+// The UART is polled, which keeps up with typing but not with pasting
+#define CONSOLE_POLL 10 // ms
+#define CONSOLE_TX_TIMEOUT 100 // ms
+#define CONSOLE_MAX_LINE_LENGTH 32
+
+// The UART stops in STOP mode, so while the console is in use it keeps the board out of it
+// After this long without a keystroke it lets go and sleeps until RX wakes it (losing that keystroke)
+#define CONSOLE_IDLE_TIMEOUT 60000 // ms
+#define CONSOLE_FLAG_WAKE 0x01
+
+typedef struct {
+	const char *name;
+	const char *help;
+	void ( *handler )( const char *arguments );
+} console_command_type;
+
+static UART_HandleTypeDef *console_huart = 0;
+static char console_line[CONSOLE_MAX_LINE_LENGTH];
+static uint8_t console_line_length = 0;
+static char console_last_char = 0;
+static uint8_t console_started = 0;
+
+static osThreadId_t console_thread = 0;
+static GPIO_TypeDef *console_wake_gpio = 0;
+static uint16_t console_wake_pin = 0;
+static uint8_t console_awake = 0;
+static uint32_t console_last_activity = 0;
+
+void _Console_Help( const char *arguments );
+void _Console_Link( const char *arguments );
+void _Console_Core( const char *arguments );
+void _Console_Pools( const char *arguments );
+void _Console_Drops( const char *arguments );
+void _Console_Sleep( const char *arguments );
+void _Console_Log( const char *arguments );
+void _Console_Health( const char *arguments );
+void _Console_CPU( const char *arguments );
+void _Console_Trace( const char *arguments );
+
+static const console_command_type console_commands[] = {
+	{ "help", "List the commands", _Console_Help },
+	{ "link", "Radio link statistics for each peer", _Console_Link },
+	{ "core", "Core task wakeups and transmit timing", _Console_Core },
+	{ "pools", "Message block occupancy and exhaustion", _Console_Pools },
+	{ "drops", "Everywhere data has been lost", _Console_Drops },
+	{ "sleep", "Idle time at each sleep depth and charge per observation", _Console_Sleep },
+	{ "log", "Flash observation log fill, acknowledgements, wear and backfill", _Console_Log },
+	{ "health", "Reset cause, heap, and each task's stack and CPU share", _Console_Health },
+	{ "cpu", "Cycles in each task and interrupt handler, and time idle", _Console_CPU },
+	{ "trace", "Dump the RTOS event trace for Tools/trace_decode (\"trace clear\" empties it)", _Console_Trace }
+};
+
+#define CONSOLE_COMMANDS ( sizeof( console_commands ) / sizeof( console_commands[0] ) )
+
+void Console_Set_UART( UART_HandleTypeDef *huart ) {
+	console_huart = huart;
+}
+
+void Console_Write( const char *text ) {
+	if ( ! console_huart ) {
+		return;
+	}
+
+	HAL_UART_Transmit( console_huart, (uint8_t *) text, strlen( text ), CONSOLE_TX_TIMEOUT );
+}
+
+void Console_Write_Int( int32_t value ) {
+	char text[12];
+	uint8_t i = sizeof( text );
+	uint32_t magnitude = value < 0 ? - (uint32_t) value : (uint32_t) value;
+
+	text[--i] = 0;
+	do {
+		text[--i] = '0' + magnitude % 10;
+		magnitude /= 10;
+	} while ( magnitude );
+	if ( value < 0 ) {
+		text[--i] = '-';
+	}
+
+	Console_Write( &(text[i]) );
+}
+
+void _Console_Write_Hex( uint32_t value, uint8_t digits ) {
+	char text[9];
+	text[digits] = 0;
+	while ( digits ) {
+		text[--digits] = "0123456789abcdef"[value & 0xF];
+		value >>= 4;
+	}
+	Console_Write( text );
+}
+
+void _Console_Help( const char *arguments ) {
+	for ( uint8_t i = 0; i < CONSOLE_COMMANDS; i++ ) {
+		Console_Write( console_commands[i].name );
+		Console_Write( "\t" );
+		Console_Write( console_commands[i].help );
+		Console_Write( "\r\n" );
+	}
+}
+
+void _Console_Link( const char *arguments ) {
+	radio_peer_stats_type peer;
+
+	Console_Write( "addr\trssi\tfei\trx\ttx\tretry\tack\tfail\tair ms\r\n" );
+	for ( uint8_t i = 0; RADIO_SUCCESS == Radio_Get_Peer_Stats( i, &peer ); i++ ) {
+		int32_t fields[] = { peer.address, peer.rssi, peer.fei, peer.received, peer.sent,
+			peer.retried, peer.acked, peer.failed, peer.airtime };
+		for ( uint8_t f = 0; f < sizeof( fields ) / sizeof( fields[0] ); f++ ) {
+			Console_Write_Int( fields[f] );
+			Console_Write( f + 1 < sizeof( fields ) / sizeof( fields[0] ) ? "\t" : "\r\n" );
+		}
+
+		// Only the buckets that have something in them, labelled with their upper bound
+		Console_Write( "\ttx done (ms below: count)" );
+		for ( uint8_t b = 0; b < RADIO_TX_DONE_BUCKETS; b++ ) {
+			if ( 0 == peer.tx_done[b] ) {
+				continue;
+			}
+			Console_Write( " " );
+			if ( b + 1 < RADIO_TX_DONE_BUCKETS ) {
+				Console_Write_Int( 1 << b );
+			} else {
+				Console_Write( "more" );
+			}
+			Console_Write( ": " );
+			Console_Write_Int( peer.tx_done[b] );
+		}
+		Console_Write( "\r\n" );
+	}
+
+	radio_encryption_stats_type aes;
+	Radio_Get_Encryption_Stats( &aes );
+	Console_Write( aes.enabled ? "aes on, key " : "aes off, key " );
+	Console_Write_Int( aes.key_id );
+	Console_Write( ", rotations " );
+	Console_Write_Int( aes.rotations );
+	Console_Write( ", oversize " );
+	Console_Write_Int( aes.oversize_frames );
+	Console_Write( ", long frames read whole " );
+	Console_Write_Int( aes.long_frames );
+	Console_Write( "\r\n" );
+}
+
+void _Console_Core( const char *arguments ) {
+	core_timing_stats_type timing;
+	Core_Get_Timing_Stats( &timing );
+
+	Console_Write( "wakeups " );
+	Console_Write_Int( timing.wakeups );
+	Console_Write( "\r\ntransmits " );
+	Console_Write_Int( timing.transmits );
+	Console_Write( "\r\njitter ms " );
+	Console_Write_Int( timing.jitter );
+	Console_Write( " (max " );
+	Console_Write_Int( timing.max_jitter );
+	Console_Write( ")\r\nlatency ms " );
+	Console_Write_Int( timing.latency );
+	Console_Write( " (max " );
+	Console_Write_Int( timing.max_latency );
+	Console_Write( ")\r\n" );
+}
+
+void _Console_Pools( const char *arguments ) {
+	pool_stats_type pool;
+	for ( uint8_t i = 0; POOL_SUCCESS == Pool_Get_Stats( i, &pool ); i++ ) {
+		Console_Write( pool.name );
+		Console_Write( " in use " );
+		Console_Write_Int( pool.in_use );
+		Console_Write( "/" );
+		Console_Write_Int( pool.block_count );
+		Console_Write( " (max " );
+		Console_Write_Int( pool.max_in_use );
+		Console_Write( ") allocs " );
+		Console_Write_Int( pool.allocations );
+		Console_Write( " exhausted " );
+		Console_Write_Int( pool.exhaustions );
+		Console_Write( " bad frees " );
+		Console_Write_Int( pool.bad_frees );
+		Console_Write( "\r\n" );
+	}
+}
+
+void _Console_Drops( const char *arguments ) {
+	mailbox_stats_type mailbox;
+	for ( uint8_t i = 0; MAILBOX_SUCCESS == Mailbox_Get_Stats( i, &mailbox ); i++ ) {
+		Console_Write( mailbox.name );
+		Console_Write( " posts " );
+		Console_Write_Int( mailbox.posts );
+		Console_Write( " overwritten " );
+		Console_Write_Int( mailbox.overwrites );
+		Console_Write( "\r\n" );
+	}
+
+	pool_stats_type pool;
+	for ( uint8_t i = 0; POOL_SUCCESS == Pool_Get_Stats( i, &pool ); i++ ) {
+		Console_Write( pool.name );
+		Console_Write( " exhausted " );
+		Console_Write_Int( pool.exhaustions );
+		Console_Write( "\r\n" );
+	}
+
+	gps_stats_type gps;
+	GPS_Get_Stats( &gps );
+	Console_Write( "gps uart overruns " );
+	Console_Write_Int( gps.uart_overruns );
+	Console_Write( " line overflows " );
+	Console_Write_Int( gps.line_overflows );
+
+	Console_Write( "\r\nthp read failures " );
+	Console_Write_Int( THP_Get_Read_Failures() );
+
+	core_batch_stats_type batch;
+	Core_Get_Batch_Stats( &batch );
+	Console_Write( "\r\ncore observations dropped " );
+	Console_Write_Int( batch.dropped );
+	Console_Write( " radio queue full " );
+	Console_Write_Int( batch.queue_full );
+
+	radio_relay_stats_type relay;
+	Radio_Get_Relay_Stats( &relay );
+	if ( relay.enabled ) {
+		Console_Write( "\r\nrelay hop limit " );
+		Console_Write_Int( relay.hop_limit_drops );
+		Console_Write( " oversize " );
+		Console_Write_Int( relay.oversize_drops );
+		Console_Write( " queue full " );
+		Console_Write_Int( relay.queue_full_drops );
+	}
+	Console_Write( "\r\n" );
+}
+
+void _Console_Sleep( const char *arguments ) {
+	sleep_stats_type sleep;
+	Sleep_Get_Stats( &sleep );
+	uint32_t uptime = HAL_GetTick();
+	uint32_t asleep = sleep.time[SLEEP_DEPTH_SLEEP] + sleep.time[SLEEP_DEPTH_STOP];
+
+	Console_Write( "uptime ms " );
+	Console_Write_Int( uptime );
+	Console_Write( "\r\nrun ms " );
+	Console_Write_Int( uptime > asleep ? uptime - asleep : 0 );
+	Console_Write( "\r\nsleep ms " );
+	Console_Write_Int( sleep.time[SLEEP_DEPTH_SLEEP] );
+	Console_Write( " (" );
+	Console_Write_Int( sleep.sleeps[SLEEP_DEPTH_SLEEP] );
+	Console_Write( " times)\r\nstop ms " );
+	Console_Write_Int( sleep.time[SLEEP_DEPTH_STOP] );
+	Console_Write( " (" );
+	Console_Write_Int( sleep.sleeps[SLEEP_DEPTH_STOP] );
+	Console_Write( " times)\r\nearly wakes " );
+	Console_Write_Int( sleep.early_wakes );
+	Console_Write( " aborted " );
+	Console_Write_Int( sleep.aborted );
+	Console_Write( " wakeup failures " );
+	Console_Write_Int( sleep.wakeup_failures );
+	Console_Write( " lsi hz " );
+	Console_Write_Int( sleep.lsi );
+
+	Console_Write( "\r\nasleep ms" );
+	for ( uint8_t b = 0; b < SLEEP_HISTOGRAM_BUCKETS; b++ ) {
+		if ( 0 == sleep.histogram[b] ) {
+			continue;
+		}
+		Console_Write( " <" );
+		if ( b + 1 < SLEEP_HISTOGRAM_BUCKETS ) {
+			Console_Write_Int( 1 << b );
+		} else {
+			Console_Write( "more" );
+		}
+		Console_Write( ": " );
+		Console_Write_Int( sleep.histogram[b] );
+	}
+
+	// The MCU's share only - the radio's time in each mode is under link
+	core_batch_stats_type batch;
+	Core_Get_Batch_Stats( &batch );
+	uint32_t charge = Sleep_Get_Charge();
+	Console_Write( "\r\nmcu charge mC " );
+	Console_Write_Int( charge );
+	if ( batch.observations > 0 ) {
+		Console_Write( " (uC per observation " );
+		Console_Write_Int( (int32_t) ( (uint64_t) charge * 1000 / batch.observations ) );
+		Console_Write( ")" );
+	}
+	Console_Write( "\r\n" );
+}
+
+void _Console_Log( const char *arguments ) {
+	log_stats_type log;
+	Log_Get_Stats( &log );
+
+	Console_Write( "records " );
+	Console_Write_Int( log.tail );
+	Console_Write( " to " );
+	Console_Write_Int( log.head );
+	Console_Write( " (capacity " );
+	Console_Write_Int( LOG_CAPACITY );
+	Console_Write( ")\r\nappended " );
+	Console_Write_Int( log.appended );
+	Console_Write( " acknowledged " );
+	Console_Write_Int( log.acknowledged );
+	Console_Write( " lost unacknowledged " );
+	Console_Write_Int( log.lost );
+	Console_Write( "\r\ncrc errors " );
+	Console_Write_Int( log.crc_errors );
+	Console_Write( " write errors " );
+	Console_Write_Int( log.write_errors );
+	Console_Write( "\r\nerases" );
+	for ( uint8_t s = 0; s < LOG_SECTORS; s++ ) {
+		Console_Write( " " );
+		Console_Write_Int( log.erases[s] );
+	}
+	if ( log.erasing ) {
+		Console_Write( " (erasing, " );
+		Console_Write_Int( log.pending_acks );
+		Console_Write( " acks waiting)" );
+	}
+
+	backfill_stats_type backfill;
+	uint8_t in_flight = Core_Get_Backfill_Stats( &backfill );
+	Console_Write( "\r\nbackfill frames " );
+	Console_Write_Int( backfill.frames );
+	Console_Write( " (" );
+	Console_Write_Int( in_flight );
+	Console_Write( " in flight) records " );
+	Console_Write_Int( backfill.records );
+	Console_Write( " resent " );
+	Console_Write_Int( backfill.retransmitted );
+	Console_Write( "\r\nacked frames " );
+	Console_Write_Int( backfill.acked_frames );
+	Console_Write( " records " );
+	Console_Write_Int( backfill.acked_records );
+	Console_Write( " nacked " );
+	Console_Write_Int( backfill.nacked_frames );
+	Console_Write( " timed out " );
+	Console_Write_Int( backfill.timeouts );
+	Console_Write( " unreadable " );
+	Console_Write_Int( backfill.unreadable );
+	Console_Write( " passes " );
+	Console_Write_Int( backfill.passes );
+	Console_Write( "\r\n" );
+}
+
+void _Console_Health( const char *arguments ) {
+	health_stats_type health;
+	Health_Get_Stats( &health );
+
+	static const char *causes[] = { "", "bor", "pin", "por", "software", "iwdg", "wwdg", "low power" };
+	Console_Write( "reset" );
+	for ( uint8_t b = 1; b < 8; b++ ) {
+		if ( health.reset_cause & ( 1 << b ) ) {
+			Console_Write( " " );
+			Console_Write( causes[b] );
+		}
+	}
+	Console_Write( " uptime s " );
+	Console_Write_Int( health.uptime );
+	Console_Write( "\r\nheap free " );
+	Console_Write_Int( health.heap_free );
+	Console_Write( " (least " );
+	Console_Write_Int( health.heap_min_free );
+	Console_Write( " of " );
+	Console_Write_Int( configTOTAL_HEAP_SIZE );
+	Console_Write( ", allocations " );
+	Console_Write_Int( health.heap_allocations );
+	Console_Write( ")\r\n" );
+
+	health_task_stats_type task;
+	Console_Write( "task\tstack\tcpu\r\n" );
+	for ( uint8_t i = 0; HEALTH_SUCCESS == Health_Get_Task_Stats( i, &task ); i++ ) {
+		Console_Write( task.name );
+		Console_Write( "\t" );
+		Console_Write_Int( task.stack_free );
+		Console_Write( "\t" );
+		Console_Write_Int( task.cpu );
+		Console_Write( "\r\n" );
+	}
+}
+
+/**
+ * Shares (per mille) and task cycles are over the last health window,
+ * the handlers' calls and longest call (in cycles) since boot
+ */
+void _Console_CPU( const char *arguments ) {
+	health_stats_type health;
+	Health_Get_Stats( &health );
+
+	Console_Write( "window ms " );
+	Console_Write_Int( health.window );
+	Console_Write( " load " );
+	Console_Write_Int( health.load );
+	Console_Write( " isr " );
+	Console_Write_Int( health.isr );
+	Console_Write( " idle " );
+	Console_Write_Int( health.idle );
+	Console_Write( " (asleep " );
+	Console_Write_Int( health.asleep );
+	Console_Write( ")\r\n" );
+
+	health_task_stats_type task;
+	Console_Write( "task\tcpu\tcycles\r\n" );
+	for ( uint8_t i = 0; HEALTH_SUCCESS == Health_Get_Task_Stats( i, &task ); i++ ) {
+		Console_Write( task.name );
+		Console_Write( "\t" );
+		Console_Write_Int( task.cpu );
+		Console_Write( "\t" );
+		Console_Write_Int( task.cycles );
+		Console_Write( "\r\n" );
+	}
+
+	cycles_isr_stats_type isr;
+	Console_Write( "isr\tcpu\tcalls\tmax\r\n" );
+	for ( uint8_t i = 0; CYCLES_SUCCESS == Cycles_Get_ISR_Stats( i, &isr ); i++ ) {
+		Console_Write( isr.name );
+		Console_Write( "\t" );
+		Console_Write_Int( health.isr_cpu[i] );
+		Console_Write( "\t" );
+		Console_Write_Int( isr.calls );
+		Console_Write( "\t" );
+		Console_Write_Int( isr.max_cycles );
+		Console_Write( "\r\n" );
+	}
+}
+
+/**
+ * One record per line, oldest first, after the names the decoder needs
+ * Tracing stops while the dump goes out
+ */
+void _Console_Trace( const char *arguments ) {
+	if ( 0 == strcmp( arguments, "clear" ) ) {
+		Trace_Clear();
+		return;
+	}
+
+	Trace_Pause();
+
+	uint32_t count = Trace_Count();
+	Console_Write( "trace " );
+	Console_Write_Int( count );
+	Console_Write( " " );
+	Console_Write_Int( SystemCoreClock );
+	Console_Write( "\r\n" );
+
+	health_task_stats_type task;
+	for ( uint8_t i = 0; HEALTH_SUCCESS == Health_Get_Task_Stats( i, &task ); i++ ) {
+		Console_Write( "task " );
+		Console_Write_Int( task.number );
+		Console_Write( " " );
+		Console_Write( task.name );
+		Console_Write( "\r\n" );
+	}
+
+	cycles_isr_stats_type isr;
+	for ( uint8_t i = 0; CYCLES_SUCCESS == Cycles_Get_ISR_Stats( i, &isr ); i++ ) {
+		Console_Write( "isr " );
+		Console_Write_Int( i );
+		Console_Write( " " );
+		Console_Write( isr.name );
+		Console_Write( "\r\n" );
+	}
+
+	Console_Write( "queue " );
+	Console_Write_Int( TRACE_QUEUE_CORE_TO_RADIO );
+	Console_Write( " coreToRadio\r\n" );
+
+	trace_record_type record;
+	for ( uint32_t i = 0; TRACE_SUCCESS == Trace_Read( i, &record ); i++ ) {
+		Console_Write( "r " );
+		_Console_Write_Hex( record.cycles, 8 );
+		Console_Write( " " );
+		_Console_Write_Hex( record.event, 2 );
+		Console_Write( " " );
+		_Console_Write_Hex( record.id, 2 );
+		Console_Write( " " );
+		_Console_Write_Hex( record.value, 4 );
+		Console_Write( "\r\n" );
+	}
+	Console_Write( "end\r\n" );
+
+	Trace_Resume();
+}
+
+void _Console_Execute() {
+	console_line[console_line_length] = 0;
+	console_line_length = 0;
+
+	// The command is the first word, anything after it is its arguments
+	char *arguments = strchr( console_line, ' ' );
+	if ( arguments ) {
+		*arguments++ = 0;
+	} else {
+		arguments = &(console_line[strlen( console_line )]);
+	}
+
+	if ( 0 == console_line[0] ) {
+		return;
+	}
+
+	for ( uint8_t i = 0; i < CONSOLE_COMMANDS; i++ ) {
+		if ( 0 == strcmp( console_line, console_commands[i].name ) ) {
+			console_commands[i].handler( arguments );
+			return;
+		}
+	}
+
+	Console_Write( "Unknown command - try help\r\n" );
+}
+
+void _Console_Handle_Char( char c ) {
+	char echo[2] = { c, 0 };
+
+	if ( '\r' == c || '\n' == c ) {
+		// Take CR LF as one line ending
+		if ( '\n' == c && '\r' == console_last_char ) {
+			console_last_char = c;
+			return;
+		}
+		console_last_char = c;
+
+		Console_Write( "\r\n" );
+		_Console_Execute();
+		Console_Write( "> " );
+		return;
+	}
+	console_last_char = c;
+
+	if ( '\b' == c || 0x7F == c ) {
+		if ( console_line_length > 0 ) {
+			console_line_length--;
+			Console_Write( "\b \b" );
+		}
+		return;
+	}
+
+	if ( c >= ' ' && c <= '~' && console_line_length < CONSOLE_MAX_LINE_LENGTH - 1 ) {
+		console_line[console_line_length++] = c;
+		Console_Write( echo );
+	}
+}
+
+/**
+ * The RX pin, watched for a falling edge (a start bit) while the console sleeps
+ */
+void Console_Set_Wake_Pin( GPIO_TypeDef *gpio, uint16_t pin ) {
+	console_wake_gpio = gpio;
+	console_wake_pin = pin;
+}
+
+/**
+ * From the EXTI callback - someone is typing
+ */
+void Console_Wake() {
+	EXTI->IMR &= ~( (uint32_t) console_wake_pin );
+	if ( console_thread ) {
+		osThreadFlagsSet( console_thread, CONSOLE_FLAG_WAKE );
+	}
+}
+
+/**
+ * Routes the wake pin to its EXTI line, leaving the pin itself with the UART
+ */
+void _Console_Arm_Wake_Pin() {
+	uint32_t line = 31 - __CLZ( console_wake_pin );
+	uint32_t port = ( (uintptr_t) console_wake_gpio - GPIOA_BASE ) / ( GPIOB_BASE - GPIOA_BASE );
+	uint32_t shift = 4 * ( line & 0x03 );
+
+	__HAL_RCC_SYSCFG_CLK_ENABLE();
+	SYSCFG->EXTICR[line >> 2] = ( SYSCFG->EXTICR[line >> 2] & ~( 0x0FUL << shift ) ) | ( port << shift );
+	EXTI->FTSR |= console_wake_pin;
+	EXTI->RTSR &= ~( (uint32_t) console_wake_pin );
+	EXTI->PR = console_wake_pin;
+	EXTI->IMR |= console_wake_pin;
+}
+
+void _Console_Set_Awake( uint8_t awake ) {
+	if ( awake == console_awake ) {
+		return;
+	}
+	console_awake = awake;
+
+	if ( awake ) {
+		console_last_activity = osKernelGetTickCount();
+		Sleep_Prevent_Stop();
+	} else {
+		Console_Write( "\r\nconsole sleeping - press enter to wake\r\n" );
+		Sleep_Allow_Stop();
+	}
+}
+
+void Console_Run() {
+	if ( ! console_huart ) {
+		osDelay( CONSOLE_POLL );
+		return;
+	}
+
+	if ( ! console_started ) {
+		console_started = 1;
+		console_thread = osThreadGetId();
+		_Console_Set_Awake( 1 );
+		Console_Write( "\r\nwxtx console - type help\r\n> " );
+	}
+
+	if ( ! console_awake ) {
+		if ( ! console_wake_gpio ) {
+			_Console_Set_Awake( 1 ); // Nothing to wake us - stay up
+			return;
+		}
+		osThreadFlagsClear( CONSOLE_FLAG_WAKE );
+		_Console_Arm_Wake_Pin();
+		osThreadFlagsWait( CONSOLE_FLAG_WAKE, osFlagsWaitAny, osWaitForever );
+		_Console_Set_Awake( 1 );
+		console_line_length = 0;
+		Console_Write( "\r\n> " );
+	}
+
+	// Reading SR then DR also clears an overrun
+	uint32_t status = console_huart->Instance->SR;
+	while ( status & ( USART_SR_RXNE | USART_SR_ORE ) ) {
+		char c = (char) ( console_huart->Instance->DR & 0xFF );
+		if ( status & USART_SR_RXNE ) {
+			_Console_Handle_Char( c );
+			console_last_activity = osKernelGetTickCount();
+		}
+		status = console_huart->Instance->SR;
+	}
+
+	if ( osKernelGetTickCount() - console_last_activity >= CONSOLE_IDLE_TIMEOUT ) {
+		_Console_Set_Awake( 0 );
+		return;
+	}
+
+	osDelay( CONSOLE_POLL );
+}
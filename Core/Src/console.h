@@ -0,0 +1,22 @@
+/**
+ * console.h
+ * Allen Snook
+ * October 19, 2026
+ *
+ * Debug console on the ST-LINK virtual COM port
+ */
+
+#ifndef __CONSOLE_H
+#define __CONSOLE_H
+
+#include "stm32f4xx_hal.h"
+#include "cmsis_os.h"
+
+void Console_Set_UART( UART_HandleTypeDef *huart );
+void Console_Set_Wake_Pin( GPIO_TypeDef *gpio, uint16_t pin );
+void Console_Wake();
+void Console_Write( const char *text );
+void Console_Write_Int( int32_t value );
+void Console_Run();
+
+#endif // __CONSOLE_H
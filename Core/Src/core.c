@@ -7,6 +7,12 @@
 #include "core.h"
 #include "gps.h"
 #include "thp.h"
+#include "radio.h"
+#include "tdma.h"
+#include "obs.h"
+#include "log.h"
+#include "health.h"
+#include "pool.h"
 
 #ifndef TRUE
 #define TRUE UINT8_C(1)
@@ -15,17 +21,52 @@
 #define FALSE UINT8_C(0)
 #endif
 
-#define CORE_LOOP_DELAY 250
 #define CORE_TRANSMIT_INTERVAL 10000
 
-#define CORE_RADIO_TX_PACKET_LENGTH 24
-
-thp_data_type core_thp_data;
-gps_data_type core_gps_data;
+// While waiting for the first THP and GPS data, the green LED blinks at this period
+#define CORE_BLINK_PERIOD 250
+
+// A frame is the header, the link telemetry and then the compact
+// observation payload (see obs.h)
+#define CORE_TELEMETRY_LENGTH 2
+#define CORE_PAYLOAD_OFFSET ( RADIO_HEADER_LENGTH + CORE_TELEMETRY_LENGTH )
+#define CORE_RECORDS_OFFSET ( CORE_PAYLOAD_OFFSET + OBS_PAYLOAD_HEADER_LENGTH )
+#define CORE_BATCH_MAX_OBSERVATIONS 32
+
+// What one observation used to cost: header, raw thp_data_type (6 bytes)
+// and gps_data_type (14 bytes) and the link telemetry
+#define CORE_RAW_FRAME_LENGTH ( RADIO_HEADER_LENGTH + 20 + CORE_TELEMETRY_LENGTH )
+
+// Frames we remember the last observation of, so that when the receiver
+// acknowledges one we can start sending deltas against it
+#define CORE_SENT_FRAMES 4
+
+// Link statistics go to the gateway one peer at a time, every this many transmit intervals
+#define CORE_LINK_STATS_INTERVAL 60
+#define CORE_LINK_STATS_LENGTH ( RADIO_HEADER_LENGTH + 18 + 2 * RADIO_TX_DONE_BUCKETS )
+
+// Runtime health goes every this many transmit intervals, half way between the link statistics
+#define CORE_HEALTH_INTERVAL 60
+#define CORE_HEALTH_LENGTH( pools, tasks ) ( RADIO_HEADER_LENGTH + 18 + (pools) + 5 * (tasks) )
+
+// Logged observations the gateway never acknowledged go again as backfill frames
+// (see backfill.h), queued behind each live frame. Only at faster profiles, where
+// a full frame and its link report take a fraction of the slot, and only while
+// the last hour's airtime leaves the live frames room under the 1% limit
+#define CORE_BACKFILL_MIN_PROFILE RADIO_PROFILE_38K4
+#define CORE_BACKFILL_FRAMES 2 // Per transmit interval - leaves pool blocks for the next live frame
+#define CORE_BACKFILL_MAX_DUTY_CYCLE_OF_LIMIT 700 // per mille of the duty cycle limit
+#define CORE_BACKFILL_TIMEOUT ( 3 * CORE_TRANSMIT_INTERVAL ) // ms without a bitmap covering a frame
+
+// Defaults - see Core_Set_Batching
+#define CORE_BATCH_SIZE 8
+#define CORE_BATCH_LATENCY_BUDGET 30000
+
+// The latest of each, held in the producer's block until the next one arrives
+thp_data_type *core_thp_data = 0;
+gps_data_type *core_gps_data = 0;
 
 static RTC_HandleTypeDef *core_hrtc;
-static osMessageQueueId_t core_thp_hqueue;
-static osMessageQueueId_t core_gps_hqueue;
 static osMessageQueueId_t core_radio_hqueue;
 static HAL_StatusTypeDef core_hal_status;
 static osStatus_t core_os_status;
@@ -33,25 +74,55 @@ static osStatus_t core_os_status;
 static uint8_t core_has_thp_data = FALSE;
 static uint8_t core_has_gps_data = FALSE;
 
-static uint32_t core_loop_time = 0;
+static osThreadId_t core_thread = 0;
+static osTimerId_t core_transmit_timer = 0;
+static StaticTimer_t core_transmit_timer_cb; // Nothing comes from the FreeRTOS heap (see main.c)
+static const osTimerAttr_t core_transmit_timer_attributes = {
+	.name = "coreTransmit",
+	.cb_mem = &core_transmit_timer_cb,
+	.cb_size = sizeof( core_transmit_timer_cb )
+};
+static volatile uint32_t core_transmit_due = 0; // Tick the timer fired at
+static uint32_t core_last_transmit_due = 0;
+static core_timing_stats_type core_timing_stats = { 0 };
 
 static RTC_DateTypeDef core_rtc_date;
 static RTC_TimeTypeDef core_rtc_time;
 
-static uint8_t core_radio_tx_packet[CORE_RADIO_TX_PACKET_LENGTH];
+static uint8_t core_batch_size = CORE_BATCH_SIZE;
+static uint32_t core_batch_latency_budget = CORE_BATCH_LATENCY_BUDGET;
+static uint8_t core_batch_count = 0;
+static uint32_t core_batch_start = 0;
+static core_batch_stats_type core_batch_stats = { 0 };
+static obs_data_type core_batch[CORE_BATCH_MAX_OBSERVATIONS];
+static uint32_t core_batch_records[CORE_BATCH_MAX_OBSERVATIONS]; // Where each is in the log
+
+typedef struct {
+	uint8_t sequence;
+	obs_data_type last;
+	uint32_t first_record;	// Log records the frame carried, acknowledged along with it
+	uint32_t last_record;
+} core_sent_frame_type;
+
+static uint8_t core_sequence = 0;
+static uint8_t core_reference_sequence = OBS_NO_REFERENCE;
+static obs_data_type core_reference;
+static core_sent_frame_type core_sent_frames[CORE_SENT_FRAMES];
+static uint8_t core_sent_frame_index = 0;
+
+static uint32_t core_slot_time = 0; // ms of our slot left after the frames queued this interval
+static const backfill_store_type core_backfill_store = { Log_Read, Log_Acknowledge_Range };
+static backfill_type core_backfill;
+static uint8_t core_backfill_started = FALSE;
+
+static uint8_t core_link_stats_countdown = CORE_LINK_STATS_INTERVAL;
+static uint8_t core_link_stats_peer = 0;
+static uint8_t core_health_countdown = CORE_HEALTH_INTERVAL / 2;
 
 void Core_Set_RTC_Handle( RTC_HandleTypeDef *hrtc ) {
 	core_hrtc = hrtc;
 }
 
-void Core_Set_THP_Message_Queue( osMessageQueueId_t hqueue ) {
-	core_thp_hqueue = hqueue;
-}
-
-void Core_Set_GPS_Message_Queue( osMessageQueueId_t hqueue ) {
-	core_gps_hqueue = hqueue;
-}
-
 void Core_Set_Radio_Message_Queue( osMessageQueueId_t hqueue ) {
 	core_radio_hqueue = hqueue;
 }
@@ -60,9 +131,9 @@ void _Core_Update_RTC() {
 	RTC_TimeTypeDef rtc_time = {0};
 	RTC_DateTypeDef rtc_date = {0};
 
-	rtc_time.Hours = core_gps_data.hour;
-	rtc_time.Minutes = core_gps_data.minutes;
-	rtc_time.Seconds = core_gps_data.seconds;
+	rtc_time.Hours = core_gps_data->hour;
+	rtc_time.Minutes = core_gps_data->minutes;
+	rtc_time.Seconds = core_gps_data->seconds;
 	rtc_time.DayLightSaving = RTC_DAYLIGHTSAVING_NONE;
 	rtc_time.StoreOperation = RTC_STOREOPERATION_RESET;
 	core_hal_status = HAL_RTC_SetTime( core_hrtc, &rtc_time, RTC_FORMAT_BIN );
@@ -70,9 +141,9 @@ void _Core_Update_RTC() {
 		return;
 	}
 	rtc_date.WeekDay = RTC_WEEKDAY_MONDAY; // TODO
-	rtc_date.Month = core_gps_data.month;
-	rtc_date.Date = core_gps_data.day;
-	rtc_date.Year = core_gps_data.year;
+	rtc_date.Month = core_gps_data->month;
+	rtc_date.Date = core_gps_data->day;
+	rtc_date.Year = core_gps_data->year;
 
 	core_hal_status = HAL_RTC_SetDate( core_hrtc, &rtc_date, RTC_FORMAT_BIN );
 	if ( core_hal_status != HAL_OK ) {
@@ -80,37 +151,36 @@ void _Core_Update_RTC() {
 	}
 }
 
-void _Core_Handle_GPS_Queue() {
-	if ( ! core_gps_hqueue ) {
-		return;
-	}
-
-	// Receive the gps_data_type structure (14 bytes)
-	core_os_status = osMessageQueueGet( core_gps_hqueue, (void *) &core_gps_data, NULL, 0U );
-	if ( core_os_status == osOK ) {
+void _Core_Handle_GPS_Mailbox() {
+	// Take the newest gps_data_type structure (14 bytes), if there is one
+	gps_data_type *gps_data = GPS_Take_Data();
+	if ( gps_data ) {
+		if ( core_gps_data ) {
+			GPS_Free_Data( core_gps_data );
+		}
+		core_gps_data = gps_data;
 		core_has_gps_data = TRUE;
 		_Core_Update_RTC();
 	}
 }
 
-void _Core_Handle_THP_Queue() {
-	if ( ! core_gps_hqueue ) {
-		return;
-	}
-
-	// Receive the thp_data_type structure (6 bytes)
-	core_os_status = osMessageQueueGet( core_thp_hqueue, (void *) &core_thp_data, NULL, 0U );
-	if ( core_os_status == osOK ) {
+void _Core_Handle_THP_Mailbox() {
+	// Take the newest thp_data_type structure (6 bytes), if there is one
+	thp_data_type *thp_data = THP_Take_Data();
+	if ( thp_data ) {
+		if ( core_thp_data ) {
+			THP_Free_Data( core_thp_data );
+		}
+		core_thp_data = thp_data;
 		core_has_thp_data = TRUE;
+		Radio_Set_Temperature( core_thp_data->temperature );
 	}
 }
 
-void _Core_Prepare_Packet() {
-	// Do we have a core radio message queue handle?
-	if ( ! core_radio_hqueue ) {
-		return;
-	}
-
+/**
+ * Stamps the latest THP and GPS data with the RTC time and appends it to the batch
+ */
+void _Core_Take_Observation() {
 	// Do we have THP data?
 	if ( ! core_has_thp_data ) {
 		return;
@@ -122,10 +192,10 @@ void _Core_Prepare_Packet() {
 	}
 
 	// Size checks
-	if ( 6 != sizeof( core_thp_data ) ) {
+	if ( 6 != sizeof( *core_thp_data ) ) {
 		return;
 	}
-	if ( 14 != sizeof( core_gps_data ) ) {
+	if ( 14 != sizeof( *core_gps_data ) ) {
 		return;
 	}
 
@@ -143,39 +213,529 @@ void _Core_Prepare_Packet() {
 
 	// Update the GPS data with the latest RTC results
 	// Since the GPS may take 30 or more seconds to send a datetime update
-	core_gps_data.year = core_rtc_date.Year;
-	core_gps_data.month = core_rtc_date.Month;
-	core_gps_data.day = core_rtc_date.Date;
-	core_gps_data.hour = core_rtc_time.Hours;
-	core_gps_data.minutes = core_rtc_time.Minutes;
-	core_gps_data.seconds = core_rtc_time.Seconds;
+	core_gps_data->year = core_rtc_date.Year;
+	core_gps_data->month = core_rtc_date.Month;
+	core_gps_data->day = core_rtc_date.Date;
+	core_gps_data->hour = core_rtc_time.Hours;
+	core_gps_data->minutes = core_rtc_time.Minutes;
+	core_gps_data->seconds = core_rtc_time.Seconds;
+
+	if ( 0 == core_batch_count ) {
+		core_batch_start = osKernelGetTickCount();
+	}
+
+	// If the radio has fallen behind, make room by dropping the oldest
+	if ( core_batch_count >= CORE_BATCH_MAX_OBSERVATIONS ) {
+		for ( uint8_t i = 1; i < core_batch_count; i++ ) {
+			core_batch[i - 1] = core_batch[i];
+			core_batch_records[i - 1] = core_batch_records[i];
+		}
+		core_batch_count--;
+		core_batch_stats.dropped++;
+	}
+
+	obs_data_type *obs = &(core_batch[core_batch_count]);
+	obs->time = OBS_Epoch_From_Date( core_gps_data->year, core_gps_data->month, core_gps_data->day,
+		core_gps_data->hour, core_gps_data->minutes, core_gps_data->seconds );
+	obs->temperature = core_thp_data->temperature;
+	obs->pressure = core_thp_data->pressure;
+	obs->humidity = core_thp_data->humidity;
+	obs->latitude = OBS_Arc_Seconds( core_gps_data->latitude_degrees, core_gps_data->latitude_minutes,
+		core_gps_data->latitude_seconds, core_gps_data->latitude_hem );
+	obs->longitude = OBS_Arc_Seconds( core_gps_data->longitude_degrees, core_gps_data->longitude_minutes,
+		core_gps_data->longitude_seconds, core_gps_data->longitude_hem );
+
+	// Every observation goes to flash, whether or not it makes it over the air
+	core_batch_records[core_batch_count] = Log_Append( obs );
+
+	core_batch_count++;
+}
+
+/**
+ * Should the batch go out now, or can it wait for another observation?
+ */
+uint8_t _Core_Batch_Is_Due() {
+	if ( 0 == core_batch_count ) {
+		return FALSE;
+	}
+
+	if ( core_batch_count >= core_batch_size ) {
+		return TRUE;
+	}
+
+	// Would the oldest observation blow the latency budget waiting for the next one?
+	uint32_t age = osKernelGetTickCount() - core_batch_start;
+	if ( age + CORE_TRANSMIT_INTERVAL > core_batch_latency_budget ) {
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+/**
+ * Once the receiver has acknowledged a frame, later frames can be deltas against its last observation
+ * and the log can let go of the observations it carried
+ */
+void _Core_Handle_Acknowledgement() {
+	uint8_t sequence = 0;
+	if ( RADIO_SUCCESS != Radio_Get_Acknowledged_Sequence( &sequence ) ) {
+		return;
+	}
+
+	for ( uint8_t i = 0; i < CORE_SENT_FRAMES; i++ ) {
+		if ( core_sent_frames[i].sequence == sequence ) {
+			core_reference = core_sent_frames[i].last;
+			core_reference_sequence = sequence;
+			Log_Acknowledge_Range( core_sent_frames[i].first_record, core_sent_frames[i].last_record );
+			core_sent_frames[i].first_record = LOG_NO_RECORD;
+			core_sent_frames[i].last_record = LOG_NO_RECORD;
+			return;
+		}
+	}
+}
+
+/**
+ * Takes a frame that was just queued out of the slot time backfill can have
+ */
+void _Core_Use_Slot( uint16_t length ) {
+	uint32_t time = Radio_Get_Frame_Time( length );
+	core_slot_time = core_slot_time > time ? core_slot_time - time : 0;
+}
+
+void _Core_Send_Batch() {
+	// Do we have a core radio message queue handle?
+	if ( ! core_radio_hqueue ) {
+		return;
+	}
+
+	_Core_Handle_Acknowledgement();
+
+	// The frame is built in place in a block the radio frees once it is sent
+	// If it is still busy with all of them, the batch waits for the next interval
+	uint8_t *frame = Radio_Alloc_Frame();
+	if ( ! frame ) {
+		return;
+	}
+
+	// Frames longer than the FIFO are streamed, but must still fit in our TDMA slot
+	const obs_data_type *reference = ( OBS_NO_REFERENCE == core_reference_sequence ) ? 0 : &core_reference;
+	uint16_t max_length = Radio_Get_Max_Frame_Length();
+	uint8_t records_length = 0;
+	uint8_t encoded = 0;
+	if ( max_length > CORE_RECORDS_OFFSET ) {
+		encoded = OBS_Encode( reference, core_batch, core_batch_count,
+			&(frame[CORE_RECORDS_OFFSET]), max_length - CORE_RECORDS_OFFSET, &records_length );
+	}
+	if ( 0 == encoded ) {
+		Radio_Free_Frame( frame );
+		core_batch_stats.dropped += core_batch_count;
+		core_batch_count = 0;
+		return;
+	}
+
+	uint16_t length = CORE_RECORDS_OFFSET + records_length;
 
 	// Build the radio packet
 	// Header
-	core_radio_tx_packet[0] = CORE_RADIO_TX_PACKET_LENGTH;	// 24
-	core_radio_tx_packet[1] = 0x0;							// dest addr
-	core_radio_tx_packet[2] = 0x0;							// src addr
-	core_radio_tx_packet[3] = 0x0;							// control byte
+	frame[0] = length - 1;	// bytes that follow the length
+	frame[1] = RADIO_GATEWAY_ADDRESS;	// dest addr
+	frame[2] = RADIO_NODE_ADDRESS;		// src addr
+	frame[3] = RADIO_FRAME_OBSERVATION_COMPACT;
 
-	// THP Data
-	__builtin_memcpy( (void *) &(core_radio_tx_packet[4]), (void *) &core_thp_data, 6 );
+	// Link Telemetry
+	frame[4] = (uint8_t) Radio_Get_Tx_Power();		// dBm
+	frame[5] = (uint8_t) Radio_Get_Link_Margin();	// dB, INT8_MIN if unknown
 
-	// GPS Data
-	__builtin_memcpy( (void *) &(core_radio_tx_packet[10]), (void *) &core_gps_data, 14 );
+	// Observation Payload
+	frame[CORE_PAYLOAD_OFFSET] = core_sequence;
+	frame[CORE_PAYLOAD_OFFSET + 1] = core_reference_sequence;
+	frame[CORE_PAYLOAD_OFFSET + 2] = encoded;
 
 	// Send it
-	osMessageQueuePut( core_radio_hqueue, (void *) &(core_radio_tx_packet[0]), 0U, 0U );
+	core_os_status = osMessageQueuePut( core_radio_hqueue, (void *) &frame, 0U, 0U );
+	if ( osOK != core_os_status ) {
+		Radio_Free_Frame( frame );
+		core_batch_stats.queue_full++;
+	} else {
+		core_sent_frames[core_sent_frame_index].sequence = core_sequence;
+		core_sent_frames[core_sent_frame_index].last = core_batch[encoded - 1];
+		core_sent_frames[core_sent_frame_index].first_record = LOG_NO_RECORD;
+		core_sent_frames[core_sent_frame_index].last_record = LOG_NO_RECORD;
+		for ( uint8_t i = 0; i < encoded; i++ ) {
+			if ( LOG_NO_RECORD == core_batch_records[i] ) {
+				continue; // Never made it to flash
+			}
+			if ( LOG_NO_RECORD == core_sent_frames[core_sent_frame_index].first_record ) {
+				core_sent_frames[core_sent_frame_index].first_record = core_batch_records[i];
+			}
+			core_sent_frames[core_sent_frame_index].last_record = core_batch_records[i];
+		}
+		core_sent_frame_index = ( core_sent_frame_index + 1 ) % CORE_SENT_FRAMES;
+		_Core_Use_Slot( length );
+		core_sequence = ( core_sequence >= OBS_MAX_SEQUENCE ) ? 0 : core_sequence + 1;
+
+		// Compare against sending each observation in a raw frame of its own
+		uint32_t single = Radio_Get_Airtime( CORE_RAW_FRAME_LENGTH );
+		uint32_t batched = Radio_Get_Airtime( length );
+		core_batch_stats.frames++;
+		core_batch_stats.observations += encoded;
+		core_batch_stats.airtime_saved_per_observation = single - batched / encoded;
+		core_batch_stats.airtime_saved += single * encoded - batched;
+	}
+
+	// Anything that didn't fit goes in the next frame
+	for ( uint8_t i = encoded; i < core_batch_count; i++ ) {
+		core_batch[i - encoded] = core_batch[i];
+		core_batch_records[i - encoded] = core_batch_records[i];
+	}
+	core_batch_count -= encoded;
+}
+
+void _Core_Put_16( uint8_t *buffer, uint16_t value ) {
+	buffer[0] = value >> 8;
+	buffer[1] = value & 0xFF;
+}
+
+void _Core_Put_32( uint8_t *buffer, uint32_t value ) {
+	_Core_Put_16( buffer, value >> 16 );
+	_Core_Put_16( buffer + 2, value & 0xFFFF );
+}
+
+/**
+ * Sends the radio's statistics for the next peer in its table (see RADIO_FRAME_LINK_STATS)
+ */
+void _Core_Send_Link_Stats() {
+	if ( ! core_radio_hqueue ) {
+		return;
+	}
+
+	radio_peer_stats_type peer;
+	if ( RADIO_SUCCESS != Radio_Get_Peer_Stats( core_link_stats_peer, &peer ) ) {
+		core_link_stats_peer = 0;
+		if ( RADIO_SUCCESS != Radio_Get_Peer_Stats( core_link_stats_peer, &peer ) ) {
+			return;
+		}
+	}
+	core_link_stats_peer++;
+
+	// Skipped when FEC leaves too little room
+	if ( CORE_LINK_STATS_LENGTH > Radio_Get_Max_Frame_Length() ) {
+		return;
+	}
+
+	uint8_t *frame = Radio_Alloc_Frame();
+	if ( ! frame ) {
+		return;
+	}
+
+	uint8_t *stats = &(frame[RADIO_HEADER_LENGTH]);
+	frame[0] = CORE_LINK_STATS_LENGTH - 1;
+	frame[1] = RADIO_GATEWAY_ADDRESS;
+	frame[2] = RADIO_NODE_ADDRESS;
+	frame[3] = RADIO_FRAME_LINK_STATS;
+
+	stats[0] = peer.address;
+	stats[1] = (uint8_t) peer.rssi;
+	_Core_Put_16( &(stats[2]), (uint16_t) peer.fei );
+	_Core_Put_16( &(stats[4]), peer.received );
+	_Core_Put_16( &(stats[6]), peer.sent );
+	_Core_Put_16( &(stats[8]), peer.retried );
+	_Core_Put_16( &(stats[10]), peer.acked );
+	_Core_Put_16( &(stats[12]), peer.failed );
+	_Core_Put_32( &(stats[14]), peer.airtime );
+	for ( uint8_t i = 0; i < RADIO_TX_DONE_BUCKETS; i++ ) {
+		_Core_Put_16( &(stats[18 + 2 * i]), peer.tx_done[i] );
+	}
+
+	core_os_status = osMessageQueuePut( core_radio_hqueue, (void *) &frame, 0U, 0U );
+	if ( osOK != core_os_status ) {
+		Radio_Free_Frame( frame );
+		core_batch_stats.queue_full++;
+	} else {
+		_Core_Use_Slot( CORE_LINK_STATS_LENGTH );
+	}
+}
+
+/**
+ * Sends our runtime health (see RADIO_FRAME_HEALTH)
+ */
+void _Core_Send_Health() {
+	if ( ! core_radio_hqueue ) {
+		return;
+	}
+
+	health_stats_type health;
+	health_task_stats_type task;
+	pool_stats_type pool;
+	Health_Get_Stats( &health );
+
+	uint8_t pools = 0;
+	while ( pools < POOL_MAX_POOLS && POOL_SUCCESS == Pool_Get_Stats( pools, &pool ) ) {
+		pools++;
+	}
+
+	// Skipped when FEC leaves too little room
+	uint8_t length = CORE_HEALTH_LENGTH( pools, health.tasks );
+	if ( length > Radio_Get_Max_Frame_Length() ) {
+		return;
+	}
+
+	uint8_t *frame = Radio_Alloc_Frame();
+	if ( ! frame ) {
+		return;
+	}
+
+	uint8_t *payload = &(frame[RADIO_HEADER_LENGTH]);
+	frame[0] = length - 1;
+	frame[1] = RADIO_GATEWAY_ADDRESS;
+	frame[2] = RADIO_NODE_ADDRESS;
+	frame[3] = RADIO_FRAME_HEALTH;
+
+	payload[0] = health.reset_cause;
+	_Core_Put_32( &(payload[1]), health.uptime );
+	_Core_Put_16( &(payload[5]), health.heap_free > 0xFFFF ? 0xFFFF : health.heap_free );
+	_Core_Put_16( &(payload[7]), health.heap_min_free > 0xFFFF ? 0xFFFF : health.heap_min_free );
+	payload[9] = Radio_Get_Queue_High_Water();
+	_Core_Put_16( &(payload[10]), health.load );
+	_Core_Put_16( &(payload[12]), health.isr );
+	_Core_Put_16( &(payload[14]), health.idle );
+
+	uint8_t i = 16;
+	payload[i++] = pools;
+	for ( uint8_t p = 0; p < pools && POOL_SUCCESS == Pool_Get_Stats( p, &pool ); p++ ) {
+		payload[i++] = pool.max_in_use;
+	}
+
+	payload[i++] = health.tasks;
+	for ( uint8_t t = 0; t < health.tasks && HEALTH_SUCCESS == Health_Get_Task_Stats( t, &task ); t++ ) {
+		payload[i++] = task.number;
+		_Core_Put_16( &(payload[i]), task.stack_free );
+		_Core_Put_16( &(payload[i + 2]), task.cpu );
+		i += 4;
+	}
+
+	core_os_status = osMessageQueuePut( core_radio_hqueue, (void *) &frame, 0U, 0U );
+	if ( osOK != core_os_status ) {
+		Radio_Free_Frame( frame );
+		core_batch_stats.queue_full++;
+	} else {
+		_Core_Use_Slot( length );
+	}
+}
+
+/**
+ * The oldest log record the live frames might still get acknowledged, which backfill leaves alone
+ */
+uint32_t _Core_Backfill_Limit( uint32_t head ) {
+	uint32_t limit = head;
+
+	for ( uint8_t i = 0; i < core_batch_count; i++ ) {
+		if ( core_batch_records[i] < limit ) {
+			limit = core_batch_records[i];
+		}
+	}
+
+	for ( uint8_t i = 0; i < CORE_SENT_FRAMES; i++ ) {
+		if ( core_sent_frames[i].first_record < limit ) {
+			limit = core_sent_frames[i].first_record;
+		}
+	}
+
+	return limit;
+}
+
+/**
+ * Follows the live frames with backfill frames, when the link is fast enough for it
+ */
+void _Core_Send_Backfill() {
+	if ( ! core_radio_hqueue ) {
+		return;
+	}
+
+	log_stats_type log;
+	Log_Get_Stats( &log );
+	if ( ! core_backfill_started ) {
+		Backfill_Init( &core_backfill, &core_backfill_store, log.tail );
+		core_backfill_started = TRUE;
+	}
+
+	uint32_t now = osKernelGetTickCount();
+	uint8_t base = 0;
+	uint16_t bitmap = 0;
+	if ( RADIO_SUCCESS == Radio_Get_Backfill_Ack( &base, &bitmap ) ) {
+		Backfill_Handle_Ack( &core_backfill, base, bitmap );
+	}
+	Backfill_Expire( &core_backfill, now, CORE_BACKFILL_TIMEOUT );
+
+	if ( Radio_Get_Profile() < CORE_BACKFILL_MIN_PROFILE || Radio_Get_Duty_Cycle_Of_Limit() >= CORE_BACKFILL_MAX_DUTY_CYCLE_OF_LIMIT ) {
+		return;
+	}
+
+	// Reading the log would stall until the erase is done
+	if ( Log_Is_Erasing() ) {
+		return;
+	}
+
+	// Sized to fit behind the live frames, so they don't wait for the next slot
+	uint32_t limit = _Core_Backfill_Limit( log.head );
+	for ( uint8_t i = 0; i < CORE_BACKFILL_FRAMES; i++ ) {
+		uint16_t max_length = Radio_Get_Max_Frame_Length_In( core_slot_time );
+		if ( max_length <= RADIO_HEADER_LENGTH ) {
+			return;
+		}
+
+		uint8_t *frame = Radio_Alloc_Frame();
+		if ( ! frame ) {
+			return;
+		}
+
+		uint16_t length = Backfill_Build_Frame( &core_backfill, log.tail, limit, now,
+			&(frame[RADIO_HEADER_LENGTH]), max_length - RADIO_HEADER_LENGTH );
+		if ( 0 == length ) {
+			Radio_Free_Frame( frame );
+			return;
+		}
+		length += RADIO_HEADER_LENGTH;
+
+		frame[0] = length - 1;
+		frame[1] = RADIO_GATEWAY_ADDRESS;
+		frame[2] = RADIO_NODE_ADDRESS;
+		frame[3] = RADIO_FRAME_BACKFILL;
+
+		core_os_status = osMessageQueuePut( core_radio_hqueue, (void *) &frame, 0U, 0U );
+		if ( osOK != core_os_status ) {
+			Backfill_Cancel_Frame( &core_backfill, &(frame[RADIO_HEADER_LENGTH]) );
+			Radio_Free_Frame( frame );
+			return;
+		}
+		_Core_Use_Slot( length );
+	}
+}
+
+/**
+ * Up to max_observations (1 to CORE_BATCH_MAX_OBSERVATIONS) are sent in one frame,
+ * holding none of them longer than latency_budget ms. 1 turns batching off.
+ */
+void Core_Set_Batching( uint8_t max_observations, uint32_t latency_budget ) {
+	if ( max_observations < 1 ) {
+		max_observations = 1;
+	}
+
+	if ( max_observations > CORE_BATCH_MAX_OBSERVATIONS ) {
+		max_observations = CORE_BATCH_MAX_OBSERVATIONS;
+	}
+
+	core_batch_size = max_observations;
+	core_batch_latency_budget = latency_budget;
+}
+
+void Core_Get_Batch_Stats( core_batch_stats_type *stats ) {
+	*stats = core_batch_stats;
+}
+
+/**
+ * Returns the number of backfill frames waiting to hear from the gateway
+ */
+uint8_t Core_Get_Backfill_Stats( backfill_stats_type *stats ) {
+	*stats = core_backfill.stats;
+	return Backfill_In_Flight( &core_backfill );
+}
+
+/**
+ * How evenly the transmit deadlines arrive, and how long the core takes to act on them
+ */
+void Core_Get_Timing_Stats( core_timing_stats_type *stats ) {
+	*stats = core_timing_stats;
+}
+
+/**
+ * Runs in the timer task
+ */
+void _Core_Transmit_Timer( void *argument ) {
+	core_transmit_due = osKernelGetTickCount();
+	osThreadFlagsSet( core_thread, CORE_FLAG_TRANSMIT );
+}
+
+/**
+ * Every CORE_TRANSMIT_INTERVAL take an observation and hand the radio whatever is due
+ */
+void _Core_Handle_Transmit_Deadline() {
+	uint32_t due = core_transmit_due;
+
+	// The timer keeps its period from when it should have fired, so any
+	// difference here is the timer task being held up
+	if ( core_timing_stats.transmits > 0 ) {
+		int32_t jitter = (int32_t) ( due - core_last_transmit_due - CORE_TRANSMIT_INTERVAL );
+		uint32_t magnitude = jitter < 0 ? -jitter : jitter;
+		core_timing_stats.jitter = jitter;
+		if ( magnitude > core_timing_stats.max_jitter ) {
+			core_timing_stats.max_jitter = magnitude;
+		}
+	}
+	core_last_transmit_due = due;
+	core_slot_time = TDMA_SLOT_LENGTH - TDMA_GUARD_TIME;
+
+	_Core_Take_Observation();
+	if ( _Core_Batch_Is_Due() ) {
+		_Core_Send_Batch();
+	}
+
+	if ( 0 == --core_link_stats_countdown ) {
+		core_link_stats_countdown = CORE_LINK_STATS_INTERVAL;
+		_Core_Send_Link_Stats();
+	}
+
+	Health_Sample();
+	if ( 0 == --core_health_countdown ) {
+		core_health_countdown = CORE_HEALTH_INTERVAL;
+		_Core_Send_Health();
+	}
+
+	// From the deadline to the frame being in the radio's queue
+	uint32_t latency = osKernelGetTickCount() - due;
+	core_timing_stats.latency = latency;
+	if ( latency > core_timing_stats.max_latency ) {
+		core_timing_stats.max_latency = latency;
+	}
+	core_timing_stats.transmits++;
+
+	// Backfill goes behind everything live
+	_Core_Send_Backfill();
 }
 
 void Core_Run() {
-	_Core_Handle_GPS_Queue();
-	_Core_Handle_THP_Queue();
+	if ( ! core_transmit_timer ) {
+		core_thread = osThreadGetId();
+		for ( uint8_t i = 0; i < CORE_SENT_FRAMES; i++ ) {
+			core_sent_frames[i].first_record = LOG_NO_RECORD;
+			core_sent_frames[i].last_record = LOG_NO_RECORD;
+		}
+		core_transmit_timer = osTimerNew( _Core_Transmit_Timer, osTimerPeriodic, NULL, &core_transmit_timer_attributes );
+		if ( ! core_transmit_timer || osOK != osTimerStart( core_transmit_timer, CORE_TRANSMIT_INTERVAL ) ) {
+			osDelay( CORE_BLINK_PERIOD );
+			return;
+		}
+	}
+
+	// Sleep until there is new data or a deadline, waking only to blink until the data is all in
+	uint32_t timeout = ( core_has_thp_data && core_has_gps_data ) ? osWaitForever : CORE_BLINK_PERIOD;
+	uint32_t flags = osThreadFlagsWait( CORE_FLAG_THP | CORE_FLAG_GPS | CORE_FLAG_TRANSMIT, osFlagsWaitAny, timeout );
+	if ( flags & osFlagsError ) {
+		flags = 0;
+	} else {
+		core_timing_stats.wakeups++;
+	}
 
-	// Every CORE_TRANSMIT_INTERVAL build a buffer with all the data and send it to the radio to transmit
-	core_loop_time += CORE_LOOP_DELAY;
-	if ( CORE_TRANSMIT_INTERVAL <= core_loop_time ) {
-		core_loop_time = 0;
-		_Core_Prepare_Packet();
+	if ( flags & CORE_FLAG_GPS ) {
+		_Core_Handle_GPS_Mailbox();
+	}
+
+	if ( flags & CORE_FLAG_THP ) {
+		_Core_Handle_THP_Mailbox();
+	}
+
+	if ( flags & CORE_FLAG_TRANSMIT ) {
+		_Core_Handle_Transmit_Deadline();
 	}
 
 	if ( ! core_has_thp_data || ! core_has_gps_data ) {
@@ -183,6 +743,4 @@ void Core_Run() {
 	} else {
 		HAL_GPIO_WritePin( GPIOB, GPIO_PIN_0, GPIO_PIN_SET ); // Green PB0 LD1
 	}
-
-	osDelay( CORE_LOOP_DELAY );
 }
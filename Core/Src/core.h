@@ -9,11 +9,37 @@
 
 #include "cmsis_os.h"
 #include "stm32f4xx_hal.h"
+#include "backfill.h"
+
+// Thread flags that wake the core task
+#define CORE_FLAG_THP 0x01
+#define CORE_FLAG_GPS 0x02
+#define CORE_FLAG_TRANSMIT 0x04
+
+typedef struct {
+	uint32_t frames;
+	uint32_t observations;
+	uint32_t airtime_saved_per_observation;	// us, for the last frame
+	uint32_t airtime_saved;					// us, total
+	uint32_t dropped;						// Observations lost to a full batch or one that couldn't be encoded
+	uint32_t queue_full;					// Frames the radio queue had no room for
+} core_batch_stats_type;
+
+typedef struct {
+	uint32_t wakeups;		// Times the core task woke for work
+	uint32_t transmits;		// Transmit deadlines handled
+	int32_t jitter;			// ms the last deadline was late (positive) or early against the one before
+	uint32_t max_jitter;	// ms, largest either way
+	uint32_t latency;		// ms from the last deadline until its frames were queued for the radio
+	uint32_t max_latency;
+} core_timing_stats_type;
 
 void Core_Set_RTC_Handle( RTC_HandleTypeDef *hrtc );
-void Core_Set_THP_Message_Queue( osMessageQueueId_t hqueue );
-void Core_Set_GPS_Message_Queue( osMessageQueueId_t hqueue );
 void Core_Set_Radio_Message_Queue( osMessageQueueId_t hqueue );
+void Core_Set_Batching( uint8_t max_observations, uint32_t latency_budget );
+void Core_Get_Batch_Stats( core_batch_stats_type *stats );
+void Core_Get_Timing_Stats( core_timing_stats_type *stats );
+uint8_t Core_Get_Backfill_Stats( backfill_stats_type *stats );
 void Core_Run();
 
 #endif // __CORE_H
@@ -0,0 +1,95 @@
+/**
+ * cycles.c
+ * Allen Snook
+ * October 19, 2026
+ *
+ * The counter runs at the core clock (16 MHz, so it wraps every 268 s) and
+ * stops while the core sleeps. Every total here wraps with it, so take
+ * differences over less than that.
+ */
+
+#include "cycles.h"
+#include "trace.h"
+
+static cycles_isr_stats_type cycles_isr_stats[CYCLES_ISRS] = {
+	{ "rtc wkup" },
+	{ "exti9_5" },
+	{ "tim7" }
+};
+
+static volatile uint32_t cycles_isr_time = 0; // In every handler with an account, nested ones only once
+
+/**
+ * The scheduler calls this as it starts (portCONFIGURE_TIMER_FOR_RUN_TIME_STATS),
+ * before any task runs
+ */
+void Cycles_Start() {
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+uint32_t Cycles_Now() {
+	return DWT->CYCCNT;
+}
+
+/**
+ * Cycles outside the handlers we account for (portGET_RUN_TIME_COUNTER_VALUE)
+ */
+uint32_t Cycles_Task_Time() {
+	return DWT->CYCCNT - cycles_isr_time;
+}
+
+uint32_t Cycles_ISR_Time() {
+	return cycles_isr_time;
+}
+
+void Cycles_ISR_Enter( cycles_isr_entry_type *entry, uint8_t isr ) {
+	if ( CYCLES_TRACED_ISRS & ( 1 << isr ) ) {
+		Trace_Record( TRACE_ISR_ENTER, isr, 0 );
+	}
+
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	entry->isr = isr;
+	entry->nested = cycles_isr_time;
+	entry->start = DWT->CYCCNT;
+	__set_PRIMASK( primask );
+}
+
+/**
+ * Charges the handler for its time, less any it spent preempted by another
+ */
+void Cycles_ISR_Exit( cycles_isr_entry_type *entry ) {
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	uint32_t cycles = DWT->CYCCNT - entry->start - ( cycles_isr_time - entry->nested );
+	cycles_isr_time += cycles;
+
+	cycles_isr_stats_type *stats = &(cycles_isr_stats[entry->isr]);
+	stats->calls++;
+	stats->cycles += cycles;
+	if ( cycles > stats->max_cycles ) {
+		stats->max_cycles = cycles;
+	}
+
+	__set_PRIMASK( primask );
+
+	if ( CYCLES_TRACED_ISRS & ( 1 << entry->isr ) ) {
+		Trace_Record( TRACE_ISR_EXIT, entry->isr, 0 );
+	}
+}
+
+uint8_t Cycles_Get_ISR_Stats( uint8_t isr, cycles_isr_stats_type *stats ) {
+	if ( isr >= CYCLES_ISRS ) {
+		return CYCLES_FAILURE;
+	}
+
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	*stats = cycles_isr_stats[isr];
+	__set_PRIMASK( primask );
+
+	return CYCLES_SUCCESS;
+}
@@ -0,0 +1,53 @@
+/**
+ * cycles.h
+ * Allen Snook
+ * October 19, 2026
+ *
+ * Owns the DWT cycle counter and splits the CPU's time between interrupt
+ * handlers and tasks. Each handler we own brackets itself with
+ * Cycles_ISR_Enter and Cycles_ISR_Exit (see stm32f4xx_it.c), and the
+ * FreeRTOS run time counter is the cycle count less time in those handlers,
+ * so each task's run time (see health.h) is its own and not the interrupts'
+ * The kernel's SysTick and PendSV handlers still count against the task they interrupted
+ */
+
+#ifndef __CYCLES_H
+#define __CYCLES_H
+
+#include "stm32f4xx_hal.h"
+
+#define CYCLES_SUCCESS 1
+#define CYCLES_FAILURE 0
+
+// Handlers with their own accounts
+#define CYCLES_ISR_RTC_WKUP 0
+#define CYCLES_ISR_EXTI9_5 1
+#define CYCLES_ISR_TIM7 2
+#define CYCLES_ISRS 3
+
+// Handlers that also go in the trace (see trace.h) - not the HAL tick, which
+// interrupts every ms while awake and would soon push everything else out
+#define CYCLES_TRACED_ISRS ( ( 1 << CYCLES_ISR_RTC_WKUP ) | ( 1 << CYCLES_ISR_EXTI9_5 ) )
+
+typedef struct {
+	uint8_t isr;
+	uint32_t start;
+	uint32_t nested;	// Cycles in all handlers when this one started
+} cycles_isr_entry_type;
+
+typedef struct {
+	const char *name;
+	uint32_t calls;
+	uint32_t cycles;	// Running total, wrapping
+	uint32_t max_cycles;	// Longest single call
+} cycles_isr_stats_type;
+
+void Cycles_Start();
+uint32_t Cycles_Now();
+uint32_t Cycles_Task_Time();
+uint32_t Cycles_ISR_Time();
+void Cycles_ISR_Enter( cycles_isr_entry_type *entry, uint8_t isr );
+void Cycles_ISR_Exit( cycles_isr_entry_type *entry );
+uint8_t Cycles_Get_ISR_Stats( uint8_t isr, cycles_isr_stats_type *stats );
+
+#endif // __CYCLES_H
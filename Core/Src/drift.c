@@ -0,0 +1,118 @@
+/**
+ * drift.c
+ * Allen Snook
+ * October 19, 2026
+ *
+ * Each bin keeps a running average of the frequency error measured at
+ * temperatures in its range. A crystal's error is a smooth (roughly cubic)
+ * curve in temperature, so between bins the prediction is a straight line
+ * between the nearest bins on either side that have been measured
+ */
+
+#include "drift.h"
+
+// New measurements count for 1 / 2^DRIFT_AVERAGE_SHIFT of a bin's average
+#define DRIFT_AVERAGE_SHIFT 2
+
+// A bin is trusted once it has this many measurements
+#define DRIFT_MIN_SAMPLES 3
+
+// How far (in bins) to look for measured neighbours
+#define DRIFT_MAX_GAP 3
+
+typedef struct {
+	int32_t error;		// Hz, scaled by 2^DRIFT_AVERAGE_SHIFT
+	uint16_t samples;
+} drift_bin_type;
+
+static drift_bin_type drift_bins[DRIFT_BINS];
+static drift_stats_type drift_stats = { 0 };
+
+int16_t _Drift_Bin( int16_t temperature ) {
+	int16_t bin = ( temperature - DRIFT_MIN_TEMPERATURE ) / DRIFT_BIN_WIDTH;
+	if ( temperature < DRIFT_MIN_TEMPERATURE || bin >= DRIFT_BINS ) {
+		return -1;
+	}
+	return bin;
+}
+
+uint8_t _Drift_Is_Trusted( int16_t bin ) {
+	return bin >= 0 && bin < DRIFT_BINS && drift_bins[bin].samples >= DRIFT_MIN_SAMPLES;
+}
+
+int32_t _Drift_Bin_Error( int16_t bin ) {
+	return drift_bins[bin].error >> DRIFT_AVERAGE_SHIFT;
+}
+
+/**
+ * error is how far (Hz) the transmitter was above where it should have been
+ */
+void Drift_Record( int16_t temperature, int32_t error ) {
+	drift_stats.measurements++;
+	drift_stats.last_error = error;
+	drift_stats.last_temperature = temperature;
+
+	int16_t bin = _Drift_Bin( temperature );
+	if ( bin < 0 ) {
+		return;
+	}
+
+	drift_bin_type *b = &drift_bins[bin];
+	if ( 0 == b->samples ) {
+		b->error = error << DRIFT_AVERAGE_SHIFT;
+	} else {
+		b->error += error - ( b->error >> DRIFT_AVERAGE_SHIFT );
+	}
+
+	if ( b->samples < UINT16_MAX ) {
+		b->samples++;
+		if ( DRIFT_MIN_SAMPLES == b->samples ) {
+			drift_stats.bins_used++;
+		}
+	}
+}
+
+/**
+ * Expected error (Hz) at temperature
+ * Returns DRIFT_FAILURE if we haven't measured close enough to it
+ */
+uint8_t Drift_Predict( int16_t temperature, int32_t *error ) {
+	int16_t bin = _Drift_Bin( temperature );
+	if ( bin < 0 ) {
+		return DRIFT_FAILURE;
+	}
+
+	// Bin centres, in 0.1 deg C, relative to the start of the table
+	int32_t position = temperature - DRIFT_MIN_TEMPERATURE - DRIFT_BIN_WIDTH / 2;
+
+	int16_t below = -1;
+	int16_t above = -1;
+	for ( int16_t gap = 0; gap <= DRIFT_MAX_GAP; gap++ ) {
+		if ( below < 0 && _Drift_Is_Trusted( bin - gap ) && ( bin - gap ) * DRIFT_BIN_WIDTH <= position ) {
+			below = bin - gap;
+		}
+		if ( above < 0 && _Drift_Is_Trusted( bin + gap ) && ( bin + gap ) * DRIFT_BIN_WIDTH >= position ) {
+			above = bin + gap;
+		}
+	}
+
+	if ( below < 0 && above < 0 ) {
+		return DRIFT_FAILURE;
+	}
+
+	if ( below < 0 || above < 0 || below == above ) {
+		*error = _Drift_Bin_Error( below < 0 ? above : below );
+		return DRIFT_SUCCESS;
+	}
+
+	int32_t span = ( above - below ) * DRIFT_BIN_WIDTH;
+	int32_t offset = position - below * DRIFT_BIN_WIDTH;
+	int32_t low = _Drift_Bin_Error( below );
+	int32_t high = _Drift_Bin_Error( above );
+	*error = low + ( high - low ) * offset / span;
+	return DRIFT_SUCCESS;
+}
+
+void Drift_Get_Stats( drift_stats_type *stats ) {
+	*stats = drift_stats;
+}
@@ -0,0 +1,34 @@
+/**
+ * drift.h
+ * Allen Snook
+ * October 19, 2026
+ *
+ * Model of the radio crystal's frequency error against temperature
+ * No HAL or RTOS dependencies
+ */
+
+#ifndef __DRIFT_H
+#define __DRIFT_H
+
+#include <stdint.h>
+
+#define DRIFT_SUCCESS 1
+#define DRIFT_FAILURE 0
+
+// Temperature bins, in the BME280's 0.1 deg C units
+#define DRIFT_MIN_TEMPERATURE -400
+#define DRIFT_BIN_WIDTH 20
+#define DRIFT_BINS 50 // -40 to +60 deg C
+
+typedef struct {
+	uint32_t measurements;
+	uint8_t bins_used;		// Bins with enough measurements to predict from
+	int32_t last_error;		// Hz, the last measurement
+	int16_t last_temperature;
+} drift_stats_type;
+
+void Drift_Record( int16_t temperature, int32_t error );
+uint8_t Drift_Predict( int16_t temperature, int32_t *error );
+void Drift_Get_Stats( drift_stats_type *stats );
+
+#endif // __DRIFT_H
@@ -0,0 +1,270 @@
+/**
+ * fec.c
+ * Allen Snook
+ * October 19, 2026
+ *
+ * The encoder works a nibble at a time from a table of the eight coded
+ * bits each nibble produces from each of the 64 encoder states, so it is
+ * one lookup per nibble instead of two parity calculations per bit
+ *
+ * The decoder is a hard decision Viterbi decoder. It needs about 8 KB of
+ * RAM, so it is only built for the host (with FEC_DECODER)
+ */
+
+#include "fec.h"
+
+// Generator polynomials, 171 and 133 octal
+#define FEC_G1 0x79
+#define FEC_G2 0x5B
+#define FEC_STATES 64
+
+#define FEC_CRC_INIT 0xFFFF
+#define FEC_CRC_POLY 0x1021
+
+// Coded output for each encoder state (the last six input bits) and the
+// next four input bits, most significant first
+static const uint8_t fec_nibble_table[FEC_STATES][16] = {
+	{ 0x00, 0x03, 0x0D, 0x0E, 0x34, 0x37, 0x39, 0x3A, 0xD3, 0xD0, 0xDE, 0xDD, 0xE7, 0xE4, 0xEA, 0xE9 },
+	{ 0x4F, 0x4C, 0x42, 0x41, 0x7B, 0x78, 0x76, 0x75, 0x9C, 0x9F, 0x91, 0x92, 0xA8, 0xAB, 0xA5, 0xA6 },
+	{ 0x3E, 0x3D, 0x33, 0x30, 0x0A, 0x09, 0x07, 0x04, 0xED, 0xEE, 0xE0, 0xE3, 0xD9, 0xDA, 0xD4, 0xD7 },
+	{ 0x71, 0x72, 0x7C, 0x7F, 0x45, 0x46, 0x48, 0x4B, 0xA2, 0xA1, 0xAF, 0xAC, 0x96, 0x95, 0x9B, 0x98 },
+	{ 0xFB, 0xF8, 0xF6, 0xF5, 0xCF, 0xCC, 0xC2, 0xC1, 0x28, 0x2B, 0x25, 0x26, 0x1C, 0x1F, 0x11, 0x12 },
+	{ 0xB4, 0xB7, 0xB9, 0xBA, 0x80, 0x83, 0x8D, 0x8E, 0x67, 0x64, 0x6A, 0x69, 0x53, 0x50, 0x5E, 0x5D },
+	{ 0xC5, 0xC6, 0xC8, 0xCB, 0xF1, 0xF2, 0xFC, 0xFF, 0x16, 0x15, 0x1B, 0x18, 0x22, 0x21, 0x2F, 0x2C },
+	{ 0x8A, 0x89, 0x87, 0x84, 0xBE, 0xBD, 0xB3, 0xB0, 0x59, 0x5A, 0x54, 0x57, 0x6D, 0x6E, 0x60, 0x63 },
+	{ 0xEC, 0xEF, 0xE1, 0xE2, 0xD8, 0xDB, 0xD5, 0xD6, 0x3F, 0x3C, 0x32, 0x31, 0x0B, 0x08, 0x06, 0x05 },
+	{ 0xA3, 0xA0, 0xAE, 0xAD, 0x97, 0x94, 0x9A, 0x99, 0x70, 0x73, 0x7D, 0x7E, 0x44, 0x47, 0x49, 0x4A },
+	{ 0xD2, 0xD1, 0xDF, 0xDC, 0xE6, 0xE5, 0xEB, 0xE8, 0x01, 0x02, 0x0C, 0x0F, 0x35, 0x36, 0x38, 0x3B },
+	{ 0x9D, 0x9E, 0x90, 0x93, 0xA9, 0xAA, 0xA4, 0xA7, 0x4E, 0x4D, 0x43, 0x40, 0x7A, 0x79, 0x77, 0x74 },
+	{ 0x17, 0x14, 0x1A, 0x19, 0x23, 0x20, 0x2E, 0x2D, 0xC4, 0xC7, 0xC9, 0xCA, 0xF0, 0xF3, 0xFD, 0xFE },
+	{ 0x58, 0x5B, 0x55, 0x56, 0x6C, 0x6F, 0x61, 0x62, 0x8B, 0x88, 0x86, 0x85, 0xBF, 0xBC, 0xB2, 0xB1 },
+	{ 0x29, 0x2A, 0x24, 0x27, 0x1D, 0x1E, 0x10, 0x13, 0xFA, 0xF9, 0xF7, 0xF4, 0xCE, 0xCD, 0xC3, 0xC0 },
+	{ 0x66, 0x65, 0x6B, 0x68, 0x52, 0x51, 0x5F, 0x5C, 0xB5, 0xB6, 0xB8, 0xBB, 0x81, 0x82, 0x8C, 0x8F },
+	{ 0xB0, 0xB3, 0xBD, 0xBE, 0x84, 0x87, 0x89, 0x8A, 0x63, 0x60, 0x6E, 0x6D, 0x57, 0x54, 0x5A, 0x59 },
+	{ 0xFF, 0xFC, 0xF2, 0xF1, 0xCB, 0xC8, 0xC6, 0xC5, 0x2C, 0x2F, 0x21, 0x22, 0x18, 0x1B, 0x15, 0x16 },
+	{ 0x8E, 0x8D, 0x83, 0x80, 0xBA, 0xB9, 0xB7, 0xB4, 0x5D, 0x5E, 0x50, 0x53, 0x69, 0x6A, 0x64, 0x67 },
+	{ 0xC1, 0xC2, 0xCC, 0xCF, 0xF5, 0xF6, 0xF8, 0xFB, 0x12, 0x11, 0x1F, 0x1C, 0x26, 0x25, 0x2B, 0x28 },
+	{ 0x4B, 0x48, 0x46, 0x45, 0x7F, 0x7C, 0x72, 0x71, 0x98, 0x9B, 0x95, 0x96, 0xAC, 0xAF, 0xA1, 0xA2 },
+	{ 0x04, 0x07, 0x09, 0x0A, 0x30, 0x33, 0x3D, 0x3E, 0xD7, 0xD4, 0xDA, 0xD9, 0xE3, 0xE0, 0xEE, 0xED },
+	{ 0x75, 0x76, 0x78, 0x7B, 0x41, 0x42, 0x4C, 0x4F, 0xA6, 0xA5, 0xAB, 0xA8, 0x92, 0x91, 0x9F, 0x9C },
+	{ 0x3A, 0x39, 0x37, 0x34, 0x0E, 0x0D, 0x03, 0x00, 0xE9, 0xEA, 0xE4, 0xE7, 0xDD, 0xDE, 0xD0, 0xD3 },
+	{ 0x5C, 0x5F, 0x51, 0x52, 0x68, 0x6B, 0x65, 0x66, 0x8F, 0x8C, 0x82, 0x81, 0xBB, 0xB8, 0xB6, 0xB5 },
+	{ 0x13, 0x10, 0x1E, 0x1D, 0x27, 0x24, 0x2A, 0x29, 0xC0, 0xC3, 0xCD, 0xCE, 0xF4, 0xF7, 0xF9, 0xFA },
+	{ 0x62, 0x61, 0x6F, 0x6C, 0x56, 0x55, 0x5B, 0x58, 0xB1, 0xB2, 0xBC, 0xBF, 0x85, 0x86, 0x88, 0x8B },
+	{ 0x2D, 0x2E, 0x20, 0x23, 0x19, 0x1A, 0x14, 0x17, 0xFE, 0xFD, 0xF3, 0xF0, 0xCA, 0xC9, 0xC7, 0xC4 },
+	{ 0xA7, 0xA4, 0xAA, 0xA9, 0x93, 0x90, 0x9E, 0x9D, 0x74, 0x77, 0x79, 0x7A, 0x40, 0x43, 0x4D, 0x4E },
+	{ 0xE8, 0xEB, 0xE5, 0xE6, 0xDC, 0xDF, 0xD1, 0xD2, 0x3B, 0x38, 0x36, 0x35, 0x0F, 0x0C, 0x02, 0x01 },
+	{ 0x99, 0x9A, 0x94, 0x97, 0xAD, 0xAE, 0xA0, 0xA3, 0x4A, 0x49, 0x47, 0x44, 0x7E, 0x7D, 0x73, 0x70 },
+	{ 0xD6, 0xD5, 0xDB, 0xD8, 0xE2, 0xE1, 0xEF, 0xEC, 0x05, 0x06, 0x08, 0x0B, 0x31, 0x32, 0x3C, 0x3F },
+	{ 0xC0, 0xC3, 0xCD, 0xCE, 0xF4, 0xF7, 0xF9, 0xFA, 0x13, 0x10, 0x1E, 0x1D, 0x27, 0x24, 0x2A, 0x29 },
+	{ 0x8F, 0x8C, 0x82, 0x81, 0xBB, 0xB8, 0xB6, 0xB5, 0x5C, 0x5F, 0x51, 0x52, 0x68, 0x6B, 0x65, 0x66 },
+	{ 0xFE, 0xFD, 0xF3, 0xF0, 0xCA, 0xC9, 0xC7, 0xC4, 0x2D, 0x2E, 0x20, 0x23, 0x19, 0x1A, 0x14, 0x17 },
+	{ 0xB1, 0xB2, 0xBC, 0xBF, 0x85, 0x86, 0x88, 0x8B, 0x62, 0x61, 0x6F, 0x6C, 0x56, 0x55, 0x5B, 0x58 },
+	{ 0x3B, 0x38, 0x36, 0x35, 0x0F, 0x0C, 0x02, 0x01, 0xE8, 0xEB, 0xE5, 0xE6, 0xDC, 0xDF, 0xD1, 0xD2 },
+	{ 0x74, 0x77, 0x79, 0x7A, 0x40, 0x43, 0x4D, 0x4E, 0xA7, 0xA4, 0xAA, 0xA9, 0x93, 0x90, 0x9E, 0x9D },
+	{ 0x05, 0x06, 0x08, 0x0B, 0x31, 0x32, 0x3C, 0x3F, 0xD6, 0xD5, 0xDB, 0xD8, 0xE2, 0xE1, 0xEF, 0xEC },
+	{ 0x4A, 0x49, 0x47, 0x44, 0x7E, 0x7D, 0x73, 0x70, 0x99, 0x9A, 0x94, 0x97, 0xAD, 0xAE, 0xA0, 0xA3 },
+	{ 0x2C, 0x2F, 0x21, 0x22, 0x18, 0x1B, 0x15, 0x16, 0xFF, 0xFC, 0xF2, 0xF1, 0xCB, 0xC8, 0xC6, 0xC5 },
+	{ 0x63, 0x60, 0x6E, 0x6D, 0x57, 0x54, 0x5A, 0x59, 0xB0, 0xB3, 0xBD, 0xBE, 0x84, 0x87, 0x89, 0x8A },
+	{ 0x12, 0x11, 0x1F, 0x1C, 0x26, 0x25, 0x2B, 0x28, 0xC1, 0xC2, 0xCC, 0xCF, 0xF5, 0xF6, 0xF8, 0xFB },
+	{ 0x5D, 0x5E, 0x50, 0x53, 0x69, 0x6A, 0x64, 0x67, 0x8E, 0x8D, 0x83, 0x80, 0xBA, 0xB9, 0xB7, 0xB4 },
+	{ 0xD7, 0xD4, 0xDA, 0xD9, 0xE3, 0xE0, 0xEE, 0xED, 0x04, 0x07, 0x09, 0x0A, 0x30, 0x33, 0x3D, 0x3E },
+	{ 0x98, 0x9B, 0x95, 0x96, 0xAC, 0xAF, 0xA1, 0xA2, 0x4B, 0x48, 0x46, 0x45, 0x7F, 0x7C, 0x72, 0x71 },
+	{ 0xE9, 0xEA, 0xE4, 0xE7, 0xDD, 0xDE, 0xD0, 0xD3, 0x3A, 0x39, 0x37, 0x34, 0x0E, 0x0D, 0x03, 0x00 },
+	{ 0xA6, 0xA5, 0xAB, 0xA8, 0x92, 0x91, 0x9F, 0x9C, 0x75, 0x76, 0x78, 0x7B, 0x41, 0x42, 0x4C, 0x4F },
+	{ 0x70, 0x73, 0x7D, 0x7E, 0x44, 0x47, 0x49, 0x4A, 0xA3, 0xA0, 0xAE, 0xAD, 0x97, 0x94, 0x9A, 0x99 },
+	{ 0x3F, 0x3C, 0x32, 0x31, 0x0B, 0x08, 0x06, 0x05, 0xEC, 0xEF, 0xE1, 0xE2, 0xD8, 0xDB, 0xD5, 0xD6 },
+	{ 0x4E, 0x4D, 0x43, 0x40, 0x7A, 0x79, 0x77, 0x74, 0x9D, 0x9E, 0x90, 0x93, 0xA9, 0xAA, 0xA4, 0xA7 },
+	{ 0x01, 0x02, 0x0C, 0x0F, 0x35, 0x36, 0x38, 0x3B, 0xD2, 0xD1, 0xDF, 0xDC, 0xE6, 0xE5, 0xEB, 0xE8 },
+	{ 0x8B, 0x88, 0x86, 0x85, 0xBF, 0xBC, 0xB2, 0xB1, 0x58, 0x5B, 0x55, 0x56, 0x6C, 0x6F, 0x61, 0x62 },
+	{ 0xC4, 0xC7, 0xC9, 0xCA, 0xF0, 0xF3, 0xFD, 0xFE, 0x17, 0x14, 0x1A, 0x19, 0x23, 0x20, 0x2E, 0x2D },
+	{ 0xB5, 0xB6, 0xB8, 0xBB, 0x81, 0x82, 0x8C, 0x8F, 0x66, 0x65, 0x6B, 0x68, 0x52, 0x51, 0x5F, 0x5C },
+	{ 0xFA, 0xF9, 0xF7, 0xF4, 0xCE, 0xCD, 0xC3, 0xC0, 0x29, 0x2A, 0x24, 0x27, 0x1D, 0x1E, 0x10, 0x13 },
+	{ 0x9C, 0x9F, 0x91, 0x92, 0xA8, 0xAB, 0xA5, 0xA6, 0x4F, 0x4C, 0x42, 0x41, 0x7B, 0x78, 0x76, 0x75 },
+	{ 0xD3, 0xD0, 0xDE, 0xDD, 0xE7, 0xE4, 0xEA, 0xE9, 0x00, 0x03, 0x0D, 0x0E, 0x34, 0x37, 0x39, 0x3A },
+	{ 0xA2, 0xA1, 0xAF, 0xAC, 0x96, 0x95, 0x9B, 0x98, 0x71, 0x72, 0x7C, 0x7F, 0x45, 0x46, 0x48, 0x4B },
+	{ 0xED, 0xEE, 0xE0, 0xE3, 0xD9, 0xDA, 0xD4, 0xD7, 0x3E, 0x3D, 0x33, 0x30, 0x0A, 0x09, 0x07, 0x04 },
+	{ 0x67, 0x64, 0x6A, 0x69, 0x53, 0x50, 0x5E, 0x5D, 0xB4, 0xB7, 0xB9, 0xBA, 0x80, 0x83, 0x8D, 0x8E },
+	{ 0x28, 0x2B, 0x25, 0x26, 0x1C, 0x1F, 0x11, 0x12, 0xFB, 0xF8, 0xF6, 0xF5, 0xCF, 0xCC, 0xC2, 0xC1 },
+	{ 0x59, 0x5A, 0x54, 0x57, 0x6D, 0x6E, 0x60, 0x63, 0x8A, 0x89, 0x87, 0x84, 0xBE, 0xBD, 0xB3, 0xB0 },
+	{ 0x16, 0x15, 0x1B, 0x18, 0x22, 0x21, 0x2F, 0x2C, 0xC5, 0xC6, 0xC8, 0xCB, 0xF1, 0xF2, 0xFC, 0xFF },
+};
+
+static uint8_t fec_scratch[FEC_MAX_ENCODED_LENGTH];
+
+/**
+ * CRC-16/CCITT-FALSE
+ */
+uint16_t _FEC_CRC( const uint8_t *data, uint8_t length ) {
+	uint16_t crc = FEC_CRC_INIT;
+	for ( uint8_t i = 0; i < length; i++ ) {
+		crc ^= (uint16_t) data[i] << 8;
+		for ( uint8_t bit = 0; bit < 8; bit++ ) {
+			crc = ( crc & 0x8000 ) ? ( crc << 1 ) ^ FEC_CRC_POLY : crc << 1;
+		}
+	}
+	return crc;
+}
+
+/**
+ * Pushes one byte through the encoder, two coded bytes out
+ */
+static inline uint8_t _FEC_Encode_Byte( uint8_t state, uint8_t byte, uint8_t *out ) {
+	out[0] = fec_nibble_table[state][byte >> 4];
+	state = ( ( state << 4 ) | ( byte >> 4 ) ) & ( FEC_STATES - 1 );
+	out[1] = fec_nibble_table[state][byte & 0x0F];
+	return ( ( state << 4 ) | ( byte & 0x0F ) ) & ( FEC_STATES - 1 );
+}
+
+/**
+ * Lays the block out as 8 rows of length bits and reads it back a column
+ * at a time, so neighbouring bits on the air are length bits apart in the code
+ */
+void _FEC_Interleave( const uint8_t *in, uint8_t *out, uint16_t length ) {
+	for ( uint16_t column = 0; column < length; column++ ) {
+		uint8_t byte = 0;
+		for ( uint8_t row = 0; row < 8; row++ ) {
+			uint16_t bit = row * length + column;
+			byte |= ( ( in[bit >> 3] >> ( 7 - ( bit & 7 ) ) ) & 1 ) << ( 7 - row );
+		}
+		out[column] = byte;
+	}
+}
+
+/**
+ * Encodes length bytes of data into encoded, which may be the same buffer
+ * Returns FEC_FAILURE if the result would be longer than max_length
+ */
+uint8_t FEC_Encode( const uint8_t *data, uint8_t length, uint8_t *encoded, uint16_t max_length, uint16_t *encoded_length ) {
+	uint16_t total = FEC_ENCODED_LENGTH( length );
+	if ( total > max_length || total > FEC_MAX_ENCODED_LENGTH ) {
+		return FEC_FAILURE;
+	}
+
+	uint16_t crc = _FEC_CRC( data, length );
+	uint8_t state = 0;
+	uint16_t out = 0;
+
+	for ( uint8_t i = 0; i < length; i++ ) {
+		state = _FEC_Encode_Byte( state, data[i], &(fec_scratch[out]) );
+		out += 2;
+	}
+	state = _FEC_Encode_Byte( state, crc >> 8, &(fec_scratch[out]) );
+	out += 2;
+	state = _FEC_Encode_Byte( state, crc & 0xFF, &(fec_scratch[out]) );
+	out += 2;
+
+	// Eight zeros leave the encoder back in state 0 for the decoder to finish on
+	_FEC_Encode_Byte( state, 0, &(fec_scratch[out]) );
+
+	_FEC_Interleave( fec_scratch, encoded, total );
+
+	*encoded_length = total;
+	return FEC_SUCCESS;
+}
+
+#ifdef FEC_DECODER
+
+#define FEC_MAX_STEPS ( FEC_MAX_ENCODED_LENGTH * 4 )
+
+static uint64_t fec_decisions[FEC_MAX_STEPS];
+
+void _FEC_Deinterleave( const uint8_t *in, uint8_t *out, uint16_t length ) {
+	for ( uint16_t i = 0; i < length; i++ ) {
+		out[i] = 0;
+	}
+
+	for ( uint16_t column = 0; column < length; column++ ) {
+		for ( uint8_t row = 0; row < 8; row++ ) {
+			uint16_t bit = row * length + column;
+			out[bit >> 3] |= ( ( in[column] >> ( 7 - row ) ) & 1 ) << ( 7 - ( bit & 7 ) );
+		}
+	}
+}
+
+static inline uint8_t _FEC_Parity( uint8_t x ) {
+	x ^= x >> 4;
+	x ^= x >> 2;
+	x ^= x >> 1;
+	return x & 1;
+}
+
+/**
+ * Corrects and decodes a block from FEC_Encode
+ * Returns FEC_FAILURE if it is too damaged for the CRC to check out
+ */
+uint8_t FEC_Decode( const uint8_t *encoded, uint16_t encoded_length, uint8_t *data, uint8_t *length ) {
+	if ( encoded_length & 1 || encoded_length < FEC_ENCODED_LENGTH( 0 ) || encoded_length > FEC_MAX_ENCODED_LENGTH ) {
+		return FEC_FAILURE;
+	}
+
+	_FEC_Deinterleave( encoded, fec_scratch, encoded_length );
+
+	// Expected coded bit pair for each shift register value
+	uint8_t expected[FEC_STATES * 2];
+	for ( uint8_t sr = 0; sr < FEC_STATES * 2; sr++ ) {
+		expected[sr] = ( _FEC_Parity( sr & FEC_G1 ) << 1 ) | _FEC_Parity( sr & FEC_G2 );
+	}
+
+	uint16_t metric[FEC_STATES];
+	uint16_t next_metric[FEC_STATES];
+	for ( uint8_t s = 0; s < FEC_STATES; s++ ) {
+		metric[s] = ( 0 == s ) ? 0 : 0x3FFF;
+	}
+
+	uint16_t steps = encoded_length * 4;
+	for ( uint16_t t = 0; t < steps; t++ ) {
+		uint8_t received = ( fec_scratch[t >> 2] >> ( 6 - 2 * ( t & 3 ) ) ) & 3;
+		uint64_t decisions = 0;
+
+		for ( uint8_t s = 0; s < FEC_STATES; s++ ) {
+			// s was reached from one of two states, differing in the bit shifted out
+			uint8_t from_0 = s >> 1;
+			uint8_t from_1 = from_0 | ( FEC_STATES >> 1 );
+			uint8_t cost_0 = expected[s] ^ received;
+			uint8_t cost_1 = expected[s | FEC_STATES] ^ received;
+			uint16_t metric_0 = metric[from_0] + ( cost_0 >> 1 ) + ( cost_0 & 1 );
+			uint16_t metric_1 = metric[from_1] + ( cost_1 >> 1 ) + ( cost_1 & 1 );
+
+			if ( metric_1 < metric_0 ) {
+				next_metric[s] = metric_1;
+				decisions |= (uint64_t) 1 << s;
+			} else {
+				next_metric[s] = metric_0;
+			}
+		}
+
+		fec_decisions[t] = decisions;
+		for ( uint8_t s = 0; s < FEC_STATES; s++ ) {
+			metric[s] = next_metric[s];
+		}
+	}
+
+	// The tail byte left the encoder in state 0, so trace back from there
+	uint8_t state = 0;
+	for ( uint16_t t = steps; t > 0; t-- ) {
+		uint8_t bit = state & 1;
+		uint16_t i = t - 1;
+		if ( bit ) {
+			fec_scratch[i >> 3] |= 0x80 >> ( i & 7 );
+		} else {
+			fec_scratch[i >> 3] &= ~( 0x80 >> ( i & 7 ) );
+		}
+		uint8_t high = ( fec_decisions[i] >> state ) & 1;
+		state = ( state >> 1 ) | ( high ? FEC_STATES >> 1 : 0 );
+	}
+
+	uint8_t data_length = encoded_length / 2 - FEC_OVERHEAD;
+	uint16_t crc = ( (uint16_t) fec_scratch[data_length] << 8 ) | fec_scratch[data_length + 1];
+	if ( crc != _FEC_CRC( fec_scratch, data_length ) ) {
+		return FEC_FAILURE;
+	}
+
+	for ( uint8_t i = 0; i < data_length; i++ ) {
+		data[i] = fec_scratch[i];
+	}
+	*length = data_length;
+	return FEC_SUCCESS;
+}
+
+#endif // FEC_DECODER
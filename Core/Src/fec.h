@@ -0,0 +1,35 @@
+/**
+ * fec.h
+ * Allen Snook
+ * October 19, 2026
+ *
+ * Forward error correction for frames sent near the edge of coverage
+ * Rate 1/2, constraint length 7 convolutional code (the 171/133 octal
+ * pair used by CCSDS and 802.11) with a CRC-16 inside and a bit
+ * interleaver outside to break up bursts
+ * No HAL or RTOS dependencies - the decoder builds on the host with FEC_DECODER
+ */
+
+#ifndef __FEC_H
+#define __FEC_H
+
+#include <stdint.h>
+
+#define FEC_SUCCESS 1
+#define FEC_FAILURE 0
+
+// Each data byte becomes two, and the CRC and a tail byte to flush the encoder are added
+#define FEC_OVERHEAD 3
+#define FEC_ENCODED_LENGTH( length ) ( 2 * ( (length) + FEC_OVERHEAD ) )
+#define FEC_MAX_DATA_LENGTH( encoded_length ) ( (encoded_length) / 2 > FEC_OVERHEAD ? (encoded_length) / 2 - FEC_OVERHEAD : 0 )
+
+// Longest block the encoder handles, in encoded bytes
+#define FEC_MAX_ENCODED_LENGTH 256
+
+uint8_t FEC_Encode( const uint8_t *data, uint8_t length, uint8_t *encoded, uint16_t max_length, uint16_t *encoded_length );
+
+#ifdef FEC_DECODER
+uint8_t FEC_Decode( const uint8_t *encoded, uint16_t encoded_length, uint8_t *data, uint8_t *length );
+#endif
+
+#endif // __FEC_H
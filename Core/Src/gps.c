@@ -5,6 +5,9 @@
  */
 
 #include "gps.h"
+#include "tdma.h"
+#include "pool.h"
+#include "mailbox.h"
 #include "stm32f4xx_hal.h"
 #include "string.h"
 #include "stdlib.h" // for strtoul
@@ -24,7 +27,8 @@
 #define GPS_GPRMC_MAX_TOKEN_LENGTH 12
 
 static UART_HandleTypeDef *gps_huart;
-static osMessageQueueId_t gps_hqueue;
+static osThreadId_t gps_notify_thread = 0;
+static uint32_t gps_notify_flags = 0;
 
 static uint8_t gps_char_rx;
 static uint32_t gps_uart_flags;
@@ -34,14 +38,28 @@ static char gps_buffer[GPS_MAX_BUFFER_LENGTH];
 static uint8_t gps_buffer_length = 0;
 
 static char gps_scratchpad[GPS_GPRMC_TOKENS][GPS_GPRMC_MAX_TOKEN_LENGTH];
-static gps_data_type gps_data;
+
+// Fixes are parsed straight into a block from here and the block itself is posted
+// One in the mailbox, one held by the consumer and one being parsed
+#define GPS_POOL_BLOCKS 3
+POOL_DEFINE( gps_pool, gps_data_type, GPS_POOL_BLOCKS );
+MAILBOX_DEFINE( gps_mailbox );
+
+static gps_stats_type gps_stats = { 0 };
+
+// Somewhere to parse to when every block is out, so the TDMA schedule still gets the time
+static gps_data_type gps_scratch_data;
 
 void GPS_Set_UART( UART_HandleTypeDef *huart ) {
 	gps_huart = huart;
 }
 
-void GPS_Set_Message_Queue( osMessageQueueId_t hqueue ) {
-	gps_hqueue = hqueue;
+/**
+ * Sets flags on thread each time new data is posted
+ */
+void GPS_Set_Notify( osThreadId_t thread, uint32_t flags ) {
+	gps_notify_thread = thread;
+	gps_notify_flags = flags;
 }
 
 int8_t _GPS_Int_From_String( int8_t index, int8_t offset, int8_t length ) {
@@ -57,7 +75,11 @@ int8_t _GPS_Int_From_String( int8_t index, int8_t offset, int8_t length ) {
 	return value;
 }
 
-uint8_t _GPS_Process_Buffer() {
+/**
+ * Parses the line in gps_buffer into new_gps_data
+ * Returns FALSE (and new_gps_data may be partly written) if it isn't a valid fix
+ */
+uint8_t _GPS_Process_Buffer( gps_data_type *new_gps_data ) {
 	// Is the buffer between 16 and 66 chars?
 	if ( ( gps_buffer_length < 16 ) | ( gps_buffer_length > 66 ) ) {
 		return FALSE;
@@ -126,23 +148,23 @@ uint8_t _GPS_Process_Buffer() {
 		return FALSE;
 	}
 
-	gps_data_type new_gps_data = { 0 };
+	*new_gps_data = (gps_data_type) { 0 };
 
 	// Scratchpad Entry #1: Time stamp (hhmmss.xx)
 	if ( strlen( gps_scratchpad[1] ) < 6 ) {
 		return FALSE;
 	}
-	new_gps_data.hour = _GPS_Int_From_String( 1, 0, 2 );
-	new_gps_data.minutes = _GPS_Int_From_String( 1, 2, 2 );
-	new_gps_data.seconds = _GPS_Int_From_String( 1, 4, 2 );
+	new_gps_data->hour = _GPS_Int_From_String( 1, 0, 2 );
+	new_gps_data->minutes = _GPS_Int_From_String( 1, 2, 2 );
+	new_gps_data->seconds = _GPS_Int_From_String( 1, 4, 2 );
 
 	// Scratchpad Entry #9: Date stamp (ddmmyy)
 	if ( strlen( gps_scratchpad[9] ) != 6 ) {
 		return FALSE;
 	}
-	new_gps_data.year = _GPS_Int_From_String( 9, 4, 2 );
-	new_gps_data.month = _GPS_Int_From_String( 9, 2, 2 );
-	new_gps_data.day = _GPS_Int_From_String( 9, 0, 2 );
+	new_gps_data->year = _GPS_Int_From_String( 9, 4, 2 );
+	new_gps_data->month = _GPS_Int_From_String( 9, 2, 2 );
+	new_gps_data->day = _GPS_Int_From_String( 9, 0, 2 );
 
 	uint16_t seconds = 0;
 
@@ -153,17 +175,17 @@ uint8_t _GPS_Process_Buffer() {
 	if ( '.' != gps_scratchpad[3][4] ) {
 		return FALSE;
 	}
-	new_gps_data.latitude_degrees = _GPS_Int_From_String( 3, 0, 2 );
-	new_gps_data.latitude_minutes = _GPS_Int_From_String( 3, 2, 2 );
+	new_gps_data->latitude_degrees = _GPS_Int_From_String( 3, 0, 2 );
+	new_gps_data->latitude_minutes = _GPS_Int_From_String( 3, 2, 2 );
 	seconds = _GPS_Int_From_String( 3, 5, 2 );
 	seconds = seconds * 60 / 100;
-	new_gps_data.latitude_seconds = seconds;
+	new_gps_data->latitude_seconds = seconds;
 
 	// Scratchpad Entry #4: North/South (N or S)
 	if ( 'N' != gps_scratchpad[4][0] && 'S' != gps_scratchpad[4][0] ) {
 		return FALSE;
 	}
-	new_gps_data.latitude_hem = gps_scratchpad[4][0];
+	new_gps_data->latitude_hem = gps_scratchpad[4][0];
 
 	// Scratchpad Entry #5: Longitude (dddmm.xxxxx)
 	if ( strlen( gps_scratchpad[5] ) < 8 ) {
@@ -172,38 +194,60 @@ uint8_t _GPS_Process_Buffer() {
 	if ( '.' != gps_scratchpad[5][5] ) {
 		return FALSE;
 	}
-	new_gps_data.longitude_degrees = _GPS_Int_From_String( 5, 0, 3 );
-	new_gps_data.longitude_minutes = _GPS_Int_From_String( 5, 3, 2 );
+	new_gps_data->longitude_degrees = _GPS_Int_From_String( 5, 0, 3 );
+	new_gps_data->longitude_minutes = _GPS_Int_From_String( 5, 3, 2 );
 	seconds = _GPS_Int_From_String( 5, 6, 2 );
 	seconds = seconds * 60 / 100;
-	new_gps_data.longitude_seconds = seconds;
+	new_gps_data->longitude_seconds = seconds;
 
 	// Scratchpad Entry #6: East/West (E or W)
 	if ( 'E' != gps_scratchpad[6][0] && 'W' != gps_scratchpad[6][0] ) {
 		return FALSE;
 	}
-	new_gps_data.longitude_hem = gps_scratchpad[6][0];
-
-	// All is well - persist the new time and location
-	gps_data = new_gps_data;
+	new_gps_data->longitude_hem = gps_scratchpad[6][0];
 
 	return TRUE;
 }
 
-void _GPS_Enqueue_Data() {
-	if ( ! gps_hqueue ) {
-		return;
+/**
+ * The newest fix since the last call, or 0 if there isn't one
+ * Never blocks. The caller owns the block and gives it back with GPS_Free_Data
+ */
+gps_data_type *GPS_Take_Data() {
+	return Mailbox_Take( &gps_mailbox );
+}
+
+void GPS_Free_Data( gps_data_type *data ) {
+	Pool_Free( &gps_pool, data );
+}
+
+void GPS_Get_Stats( gps_stats_type *stats ) {
+	*stats = gps_stats;
+}
+
+/**
+ * Posts the block, freeing any older fix the consumer didn't get to
+ */
+void _GPS_Post_Data( gps_data_type *data ) {
+	gps_data_type *stale = Mailbox_Post( &gps_mailbox, data );
+	if ( stale ) {
+		GPS_Free_Data( stale );
 	}
 
-	osMessageQueuePut( gps_hqueue, (void *) &(gps_data), 0U, 0U );
+	if ( gps_notify_thread ) {
+		osThreadFlagsSet( gps_notify_thread, gps_notify_flags );
+	}
 }
 
 void GPS_Run() {
 	do {
-		// Read any error flags so reception doesn't stall
+		// Read any error flags so reception doesn't stall (SR then DR clears them)
 		// (Don't care if we get errors - we can just wait for the next line)
-		gps_uart_flags = gps_huart->Instance->DR;
 		gps_uart_flags = gps_huart->Instance->SR;
+		(void) gps_huart->Instance->DR;
+		if ( gps_uart_flags & USART_SR_ORE ) {
+			gps_stats.uart_overruns++;
+		}
 
 		// Receive any bits
 		gps_hal_status = HAL_UART_Receive( gps_huart, &gps_char_rx, 1, 50 );
@@ -211,8 +255,17 @@ void GPS_Run() {
 
 			// End of line? Try to process it
 			if ( gps_buffer_length > 0 && ( 0x0A == gps_char_rx || 0x0D == gps_char_rx ) ) {
-				if ( _GPS_Process_Buffer() ) {
-					_GPS_Enqueue_Data();
+				// The sentence just ended - note when, for the TDMA schedule
+				uint32_t tick = osKernelGetTickCount();
+				gps_data_type *data = Pool_Alloc( &gps_pool );
+				if ( _GPS_Process_Buffer( data ? data : &gps_scratch_data ) ) {
+					const gps_data_type *fix = data ? data : &gps_scratch_data;
+					TDMA_Synchronize( fix->hour, fix->minutes, fix->seconds, tick );
+					if ( data ) {
+						_GPS_Post_Data( data );
+					}
+				} else if ( data ) {
+					GPS_Free_Data( data );
 				}
 				gps_buffer_length = 0;
 			} else {
@@ -228,6 +281,8 @@ void GPS_Run() {
 						gps_buffer[ gps_buffer_length ] = gps_char_rx;
 						gps_buffer[ gps_buffer_length + 1 ] = 0;
 						gps_buffer_length++;
+					} else if ( gps_buffer[ 0 ] == '$' ) {
+						gps_stats.line_overflows++;
 					}
 				}
 			}
@@ -27,8 +27,16 @@ typedef struct {
 	char longitude_hem;			// W or E
 } gps_data_type; // 14 bytes
 
+typedef struct {
+	uint32_t uart_overruns;		// Times a byte arrived before the last was read
+	uint32_t line_overflows;	// Bytes dropped for not fitting in the line buffer
+} gps_stats_type;
+
 void GPS_Set_UART( UART_HandleTypeDef *huart );
-void GPS_Set_Message_Queue( osMessageQueueId_t hqueue );
+void GPS_Set_Notify( osThreadId_t thread, uint32_t flags );
+gps_data_type *GPS_Take_Data();
+void GPS_Free_Data( gps_data_type *data );
+void GPS_Get_Stats( gps_stats_type *stats );
 void GPS_Run();
 
 #endif // __GPS_H
@@ -0,0 +1,181 @@
+/**
+ * health.c
+ * Allen Snook
+ * October 19, 2026
+ *
+ * FreeRTOS keeps each task's run time in DWT cycle counts (see
+ * configGENERATE_RUN_TIME_STATS and cycles.h). The counter doesn't run while
+ * the core sleeps, so the shares are taken against the wall clock and whatever
+ * is left over is time asleep.
+ */
+
+#include "health.h"
+#include "cmsis_os.h"
+#include "FreeRTOS.h"
+#include "task.h"
+
+typedef struct {
+	uint32_t last_run_time;		// The task's run time counter at the last sample
+	uint32_t window_cycles;		// Cycles since the window started
+} health_task_window_type;
+
+static uint8_t health_reset_cause = 0;
+static volatile uint32_t health_heap_allocations = 0;
+
+static TaskStatus_t health_task_status[HEALTH_MAX_TASKS]; // Too big for the core's stack
+static health_task_stats_type health_tasks[HEALTH_MAX_TASKS];
+static health_task_window_type health_task_windows[HEALTH_MAX_TASKS];
+static uint8_t health_task_count = 0;
+
+static uint32_t health_isr_last[CYCLES_ISRS];		// Each handler's cycles at the last sample
+static uint32_t health_isr_window_cycles[CYCLES_ISRS];
+
+static health_stats_type health_stats = { 0 };
+static uint32_t health_window_start = 0;
+static uint8_t health_window_samples = 0;
+
+/**
+ * Call as early as possible - the flags are cleared for next time
+ */
+uint8_t Health_Save_Reset_Cause() {
+	health_reset_cause = RCC->CSR >> 24;
+	__HAL_RCC_CLEAR_RESET_FLAGS();
+	return health_reset_cause;
+}
+
+/**
+ * Our slot in health_tasks for a task, found by its number, or a new one
+ */
+uint8_t _Health_Find_Task( const TaskStatus_t *status ) {
+	uint8_t i = 0;
+	for ( ; i < health_task_count; i++ ) {
+		if ( health_tasks[i].number == status->xTaskNumber ) {
+			return i;
+		}
+	}
+
+	health_tasks[i] = (health_task_stats_type) { 0 };
+	health_tasks[i].name = status->pcTaskName;
+	health_tasks[i].number = status->xTaskNumber;
+	health_tasks[i].idle = tskIDLE_PRIORITY == status->uxCurrentPriority;
+	health_task_windows[i].last_run_time = status->ulRunTimeCounter;
+	health_task_windows[i].window_cycles = 0;
+	health_task_count++;
+	return i;
+}
+
+uint16_t _Health_Per_Mille( uint32_t cycles, uint32_t window_cycles ) {
+	return window_cycles ? (uint16_t) ( (uint64_t) cycles * 1000 / window_cycles ) : 0;
+}
+
+/**
+ * Works out each task's and handler's share of the window just gone, then starts the next one
+ */
+void _Health_End_Window( uint32_t now ) {
+	uint32_t window = now - health_window_start;
+	uint32_t window_cycles = window * ( SystemCoreClock / 1000 );
+	uint32_t awake = 0;
+
+	health_stats.load = 0;
+	for ( uint8_t i = 0; i < health_task_count; i++ ) {
+		uint32_t cycles = health_task_windows[i].window_cycles;
+		uint16_t cpu = _Health_Per_Mille( cycles, window_cycles );
+
+		health_tasks[i].cycles = cycles;
+		health_tasks[i].cpu = cpu;
+		health_task_windows[i].window_cycles = 0;
+
+		awake += cpu;
+		if ( ! health_tasks[i].idle ) {
+			health_stats.load += cpu;
+		}
+	}
+
+	health_stats.isr = 0;
+	for ( uint8_t isr = 0; isr < CYCLES_ISRS; isr++ ) {
+		health_stats.isr_cpu[isr] = _Health_Per_Mille( health_isr_window_cycles[isr], window_cycles );
+		health_stats.isr += health_stats.isr_cpu[isr];
+		health_isr_window_cycles[isr] = 0;
+	}
+	awake += health_stats.isr;
+
+	health_stats.asleep = awake < 1000 ? 1000 - awake : 0;
+	health_stats.idle = health_stats.load + health_stats.isr < 1000 ? 1000 - health_stats.load - health_stats.isr : 0;
+	health_stats.window = window;
+	health_window_start = now;
+	health_window_samples = 0;
+}
+
+/**
+ * Catches the stack and heap low water marks and adds up each task's cycles
+ * Call every transmit interval from the core task
+ */
+void Health_Sample() {
+	uint32_t now = osKernelGetTickCount();
+
+	UBaseType_t count = uxTaskGetSystemState( health_task_status, HEALTH_MAX_TASKS, NULL );
+	if ( 0 == count ) {
+		health_stats.failures++;
+		return;
+	}
+
+	if ( 0 == health_stats.samples ) {
+		health_window_start = now;
+	}
+
+	for ( UBaseType_t t = 0; t < count; t++ ) {
+		const TaskStatus_t *status = &(health_task_status[t]);
+		uint8_t i = _Health_Find_Task( status );
+
+		health_tasks[i].stack_free = status->usStackHighWaterMark * sizeof( StackType_t );
+		health_task_windows[i].window_cycles += status->ulRunTimeCounter - health_task_windows[i].last_run_time;
+		health_task_windows[i].last_run_time = status->ulRunTimeCounter;
+	}
+
+	cycles_isr_stats_type isr_stats;
+	for ( uint8_t isr = 0; CYCLES_SUCCESS == Cycles_Get_ISR_Stats( isr, &isr_stats ); isr++ ) {
+		if ( health_stats.samples > 0 ) {
+			health_isr_window_cycles[isr] += isr_stats.cycles - health_isr_last[isr];
+		}
+		health_isr_last[isr] = isr_stats.cycles;
+	}
+
+	health_stats.samples++;
+	if ( ++health_window_samples >= HEALTH_WINDOW_SAMPLES ) {
+		_Health_End_Window( now );
+	}
+}
+
+void Health_Get_Stats( health_stats_type *stats ) {
+	*stats = health_stats;
+	stats->reset_cause = health_reset_cause;
+	stats->uptime = osKernelGetTickCount() / 1000;
+	stats->heap_allocations = health_heap_allocations;
+
+	// heap_4 only counts its pool at the first allocation, and with every kernel
+	// object static there may never be one
+	if ( stats->heap_allocations ) {
+		stats->heap_free = xPortGetFreeHeapSize();
+		stats->heap_min_free = xPortGetMinimumEverFreeHeapSize();
+	} else {
+		stats->heap_free = configTOTAL_HEAP_SIZE;
+		stats->heap_min_free = configTOTAL_HEAP_SIZE;
+	}
+	stats->tasks = health_task_count;
+}
+
+/**
+ * The kernel's traceMALLOC (see FreeRTOSConfig.h), with the scheduler suspended
+ */
+void Health_Heap_Allocated() {
+	health_heap_allocations++;
+}
+
+uint8_t Health_Get_Task_Stats( uint8_t index, health_task_stats_type *stats ) {
+	if ( index >= health_task_count ) {
+		return HEALTH_FAILURE;
+	}
+
+	*stats = health_tasks[index];
+	return HEALTH_SUCCESS;
+}
@@ -0,0 +1,69 @@
+/**
+ * health.h
+ * Allen Snook
+ * October 19, 2026
+ *
+ * Runtime health of the firmware - how close each task has come to the end
+ * of its stack, how low the heap has got, how much of the CPU each task takes
+ * and why the board last reset. The core samples it every transmit interval
+ * and now and then sends it to the gateway (see RADIO_FRAME_HEALTH)
+ */
+
+#ifndef __HEALTH_H
+#define __HEALTH_H
+
+#include "stm32f4xx_hal.h"
+#include "cycles.h"
+
+#define HEALTH_SUCCESS 1
+#define HEALTH_FAILURE 0
+
+// Our five tasks, the idle task and the timer service task, with one to spare
+#define HEALTH_MAX_TASKS 8
+
+// CPU shares are worked out over this many samples (a minute, at one per transmit interval)
+// Short enough that no task's cycle count can wrap in between
+#define HEALTH_WINDOW_SAMPLES 6
+
+// Reset causes - the top byte of RCC_CSR as it was at boot (a power on sets BOR too)
+#define HEALTH_RESET_BOR 0x02
+#define HEALTH_RESET_PIN 0x04
+#define HEALTH_RESET_POR 0x08
+#define HEALTH_RESET_SOFTWARE 0x10
+#define HEALTH_RESET_IWDG 0x20
+#define HEALTH_RESET_WWDG 0x40
+#define HEALTH_RESET_LOW_POWER 0x80
+
+typedef struct {
+	const char *name;
+	uint8_t number;			// FreeRTOS task number, in the order the tasks were created
+	uint8_t idle;			// The idle task, whose time is mostly spent asleep
+	uint16_t stack_free;	// Least stack it has ever had left, in bytes
+	uint16_t cpu;			// Per mille of the last window
+	uint32_t cycles;		// ... which was this many core clock cycles
+} health_task_stats_type;
+
+typedef struct {
+	uint8_t reset_cause;
+	uint32_t uptime;		// s
+	uint32_t heap_free;		// bytes
+	uint32_t heap_min_free;	// ... the least there has ever been
+	uint32_t heap_allocations;	// Attempted, successful or not - with every kernel object static, this should stay 0
+	uint8_t tasks;
+	uint16_t load;			// Per mille of the last window spent in tasks other than idle
+	uint16_t isr;			// ... in interrupt handlers
+	uint16_t idle;			// ... in neither, whether in the idle task or asleep
+	uint16_t asleep;		// ... with the core clock stopped
+	uint16_t isr_cpu[CYCLES_ISRS];	// Each handler's share
+	uint32_t window;		// ms
+	uint32_t samples;
+	uint32_t failures;		// Samples that found more tasks than HEALTH_MAX_TASKS
+} health_stats_type;
+
+uint8_t Health_Save_Reset_Cause();
+void Health_Sample();
+void Health_Get_Stats( health_stats_type *stats );
+void Health_Heap_Allocated();
+uint8_t Health_Get_Task_Stats( uint8_t index, health_task_stats_type *stats );
+
+#endif // __HEALTH_H
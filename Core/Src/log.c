@@ -0,0 +1,377 @@
+/**
+ * log.c
+ * Allen Snook
+ * October 19, 2026
+ *
+ * Sector N of the log holds records N * LOG_RECORDS_PER_SECTOR onward of the
+ * sector sequence, and sequence S lives in sector S % LOG_SECTORS. Mounting
+ * only has to read the four headers and binary search the newest sector.
+ */
+
+#include "log.h"
+#include "string.h"
+
+#ifndef TRUE
+#define TRUE UINT8_C(1)
+#endif
+#ifndef FALSE
+#define FALSE UINT8_C(0)
+#endif
+
+#define LOG_MAGIC 0x574C4F47 // "WLOG"
+#define LOG_BLANK 0xFFFFFFFF
+#define LOG_CRC_WORDS ( ( sizeof( obs_data_type ) + sizeof( uint32_t ) ) / sizeof( uint32_t ) )
+
+// Acknowledgements that arrive while a sector is erasing wait for it here
+#define LOG_PENDING_ACKS 8
+
+_Static_assert( sizeof( log_record_type ) == LOG_SLOT_SIZE, "Log record must fill one slot" );
+_Static_assert( sizeof( obs_data_type ) % sizeof( uint32_t ) == 0, "Log records are programmed a word at a time" );
+
+typedef struct {
+	uint32_t magic;
+	uint32_t sequence;		// Which LOG_RECORDS_PER_SECTOR records this sector holds
+	uint32_t erase_count;
+	uint32_t crc;			// Over the three words above
+} log_header_type;
+
+typedef struct {
+	uint32_t first;
+	uint32_t last;
+} log_range_type;
+
+static uint8_t log_mounted = FALSE;
+static uint8_t log_erasing = FALSE;
+static uint32_t log_erase_sequence = 0;	// The sequence the erasing sector will hold
+static uint32_t log_erase_count = 0;	// And its erase count once done
+static log_range_type log_pending_acks[LOG_PENDING_ACKS];
+static uint8_t log_pending_ack_count = 0;
+static log_stats_type log_stats = { 0 };
+
+uint32_t _Log_Sector_Address( uint32_t sequence ) {
+	return LOG_BASE + ( sequence % LOG_SECTORS ) * LOG_SECTOR_SIZE;
+}
+
+const log_header_type *_Log_Header( uint8_t sector ) {
+	return (const log_header_type *) (uintptr_t) ( LOG_BASE + sector * LOG_SECTOR_SIZE );
+}
+
+const log_record_type *_Log_Record( uint32_t id ) {
+	return (const log_record_type *) (uintptr_t) ( _Log_Sector_Address( id / LOG_RECORDS_PER_SECTOR ) +
+		( 1 + id % LOG_RECORDS_PER_SECTOR ) * LOG_SLOT_SIZE );
+}
+
+/**
+ * CRC-32 (Ethernet polynomial) on the CRC unit, a word at a time
+ */
+uint32_t _Log_CRC( const uint32_t *words, uint8_t count ) {
+	CRC->CR = CRC_CR_RESET;
+	for ( uint8_t i = 0; i < count; i++ ) {
+		CRC->DR = words[i];
+	}
+	return CRC->DR;
+}
+
+uint8_t _Log_Header_Is_Valid( const log_header_type *header ) {
+	return LOG_MAGIC == header->magic && header->crc == _Log_CRC( (const uint32_t *) header, 3 );
+}
+
+/**
+ * Nothing has been written to the record at all (a write that was cut short leaves it used)
+ */
+uint8_t _Log_Record_Is_Blank( const log_record_type *record ) {
+	const uint32_t *words = (const uint32_t *) record;
+	for ( uint8_t i = 0; i < LOG_SLOT_SIZE / sizeof( uint32_t ); i++ ) {
+		if ( LOG_BLANK != words[i] ) {
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/**
+ * The data cache may still hold what was there before a program or erase
+ */
+void _Log_Flush_Cache() {
+	if ( FLASH->ACR & FLASH_ACR_DCEN ) {
+		__HAL_FLASH_DATA_CACHE_DISABLE();
+		__HAL_FLASH_DATA_CACHE_RESET();
+		__HAL_FLASH_DATA_CACHE_ENABLE();
+	}
+}
+
+uint8_t _Log_Program( uintptr_t address, const uint32_t *words, uint8_t count ) {
+	uint8_t result = LOG_SUCCESS;
+
+	HAL_FLASH_Unlock();
+	for ( uint8_t i = 0; i < count; i++ ) {
+		if ( HAL_OK != HAL_FLASH_Program( FLASH_TYPEPROGRAM_WORD, address + i * sizeof( uint32_t ), words[i] ) ) {
+			result = LOG_FAILURE;
+			break;
+		}
+	}
+	HAL_FLASH_Lock();
+	_Log_Flush_Cache();
+
+	if ( LOG_SUCCESS == result && 0 != memcmp( (const void *) address, words, count * sizeof( uint32_t ) ) ) {
+		result = LOG_FAILURE;
+	}
+	if ( LOG_SUCCESS != result ) {
+		log_stats.write_errors++;
+	}
+	return result;
+}
+
+/**
+ * Starts erasing the sector that will hold sequence and returns without waiting
+ * (128K takes one to two seconds) - _Log_Finish_Erase writes its header afterwards
+ */
+void _Log_Start_Erase( uint32_t sequence ) {
+	uint8_t sector = sequence % LOG_SECTORS;
+	const log_header_type *header = _Log_Header( sector );
+
+	// Count what we are about to lose
+	log_erase_count = 1;
+	if ( _Log_Header_Is_Valid( header ) ) {
+		log_erase_count = header->erase_count + 1;
+		for ( uint32_t i = 0; i < LOG_RECORDS_PER_SECTOR; i++ ) {
+			const log_record_type *record = _Log_Record( header->sequence * LOG_RECORDS_PER_SECTOR + i );
+			if ( _Log_Record_Is_Blank( record ) ) {
+				break;
+			}
+			if ( LOG_BLANK == record->ack ) {
+				log_stats.lost++;
+			}
+		}
+	}
+
+	log_erase_sequence = sequence;
+	log_stats.tail = ( sequence >= LOG_SECTORS - 1 ) ? ( sequence - ( LOG_SECTORS - 1 ) ) * LOG_RECORDS_PER_SECTOR : 0;
+
+	HAL_FLASH_Unlock();
+	__HAL_FLASH_CLEAR_FLAG( FLASH_FLAG_EOP | FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR |
+		FLASH_FLAG_PGAERR | FLASH_FLAG_PGPERR | FLASH_FLAG_PGSERR );
+	while ( __HAL_FLASH_GET_FLAG( FLASH_FLAG_BSY ) );
+	FLASH_Erase_Sector( LOG_FIRST_SECTOR + sector, FLASH_VOLTAGE_RANGE_3 );
+	log_erasing = TRUE;
+}
+
+void _Log_Apply_Acknowledgement( uint32_t first, uint32_t last );
+
+/**
+ * Finishes the erase _Log_Start_Erase began, waiting for it if asked to
+ * Returns LOG_SUCCESS once nothing is erasing
+ */
+uint8_t _Log_Finish_Erase( uint8_t wait ) {
+	if ( ! log_erasing ) {
+		return LOG_SUCCESS;
+	}
+
+	if ( __HAL_FLASH_GET_FLAG( FLASH_FLAG_BSY ) ) {
+		if ( ! wait ) {
+			return LOG_FAILURE;
+		}
+		while ( __HAL_FLASH_GET_FLAG( FLASH_FLAG_BSY ) );
+	}
+
+	uint32_t errors = FLASH->SR & ( FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR | FLASH_FLAG_PGAERR |
+		FLASH_FLAG_PGPERR | FLASH_FLAG_PGSERR );
+	CLEAR_BIT( FLASH->CR, ( FLASH_CR_SER | FLASH_CR_SNB ) );
+	HAL_FLASH_Lock();
+	_Log_Flush_Cache();
+	log_erasing = FALSE;
+
+	uint8_t sector = log_erase_sequence % LOG_SECTORS;
+	if ( errors ) {
+		__HAL_FLASH_CLEAR_FLAG( errors );
+		log_stats.write_errors++;
+	} else {
+		log_stats.erases[sector] = log_erase_count;
+	}
+
+	log_header_type header = { LOG_MAGIC, log_erase_sequence, log_erase_count, 0 };
+	header.crc = _Log_CRC( (const uint32_t *) &header, 3 );
+	_Log_Program( (uintptr_t) _Log_Header( sector ), (const uint32_t *) &header, sizeof( header ) / sizeof( uint32_t ) );
+
+	for ( uint8_t i = 0; i < log_pending_ack_count; i++ ) {
+		_Log_Apply_Acknowledgement( log_pending_acks[i].first, log_pending_acks[i].last );
+	}
+	log_pending_ack_count = 0;
+
+	return LOG_SUCCESS;
+}
+
+/**
+ * Finds the newest sector from the headers and where its records end
+ * If the log has never been used, erases the first sector (blocking)
+ */
+uint8_t Log_Mount() {
+	__HAL_RCC_CRC_CLK_ENABLE();
+
+	uint8_t found = FALSE;
+	uint32_t newest = 0;
+	for ( uint8_t sector = 0; sector < LOG_SECTORS; sector++ ) {
+		const log_header_type *header = _Log_Header( sector );
+		if ( _Log_Header_Is_Valid( header ) ) {
+			log_stats.erases[sector] = header->erase_count;
+			if ( ! found || header->sequence > newest ) {
+				newest = header->sequence;
+				found = TRUE;
+			}
+		}
+	}
+
+	if ( ! found ) {
+		_Log_Start_Erase( 0 );
+		_Log_Finish_Erase( TRUE );
+		if ( ! _Log_Header_Is_Valid( _Log_Header( 0 ) ) ) {
+			return LOG_FAILURE;
+		}
+		log_stats.head = 0;
+		log_stats.tail = 0;
+		log_mounted = TRUE;
+		return LOG_SUCCESS;
+	}
+
+	// The oldest sector still holding its place in the sequence
+	log_stats.tail = newest * LOG_RECORDS_PER_SECTOR;
+	for ( uint32_t back = 1; back < LOG_SECTORS && back <= newest; back++ ) {
+		const log_header_type *header = _Log_Header( ( newest - back ) % LOG_SECTORS );
+		if ( ! _Log_Header_Is_Valid( header ) || header->sequence != newest - back ) {
+			break;
+		}
+		log_stats.tail = header->sequence * LOG_RECORDS_PER_SECTOR;
+	}
+
+	// Records are written in order, so the first blank one is where we left off
+	uint32_t base = newest * LOG_RECORDS_PER_SECTOR;
+	uint32_t low = 0;
+	uint32_t high = LOG_RECORDS_PER_SECTOR;
+	while ( low < high ) {
+		uint32_t middle = ( low + high ) / 2;
+		if ( _Log_Record_Is_Blank( _Log_Record( base + middle ) ) ) {
+			high = middle;
+		} else {
+			low = middle + 1;
+		}
+	}
+	log_stats.head = base + low;
+	log_mounted = TRUE;
+
+	if ( LOG_RECORDS_PER_SECTOR == low ) {
+		_Log_Start_Erase( newest + 1 );
+	}
+
+	return LOG_SUCCESS;
+}
+
+/**
+ * Returns the new record's id, or LOG_NO_RECORD if it could not be written
+ * When this fills a sector, the oldest one starts erasing in the background
+ */
+uint32_t Log_Append( const obs_data_type *obs ) {
+	if ( ! log_mounted ) {
+		return LOG_NO_RECORD;
+	}
+
+	// Started when the last record went into the previous sector, so normally long done
+	_Log_Finish_Erase( TRUE );
+
+	uint32_t id = log_stats.head;
+	uint32_t words[LOG_CRC_WORDS + 1];
+	memcpy( words, obs, sizeof( obs_data_type ) );
+	words[LOG_CRC_WORDS - 1] = id;
+	words[LOG_CRC_WORDS] = _Log_CRC( words, LOG_CRC_WORDS );
+
+	// A failed write still uses up the slot
+	uint8_t result = _Log_Program( (uintptr_t) _Log_Record( id ), words, LOG_CRC_WORDS + 1 );
+	log_stats.head++;
+	if ( 0 == log_stats.head % LOG_RECORDS_PER_SECTOR ) {
+		_Log_Start_Erase( log_stats.head / LOG_RECORDS_PER_SECTOR );
+	}
+
+	if ( LOG_SUCCESS != result ) {
+		return LOG_NO_RECORD;
+	}
+	log_stats.appended++;
+	return id;
+}
+
+void _Log_Apply_Acknowledgement( uint32_t first, uint32_t last ) {
+	if ( first < log_stats.tail ) {
+		first = log_stats.tail;
+	}
+	if ( last >= log_stats.head ) {
+		last = log_stats.head - 1;
+	}
+
+	for ( uint32_t id = first; id <= last && id < log_stats.head; id++ ) {
+		const log_record_type *record = _Log_Record( id );
+		if ( id != record->id || LOG_BLANK != record->ack ) {
+			continue;
+		}
+		uint32_t ack = 0;
+		if ( LOG_SUCCESS == _Log_Program( (uintptr_t) &(record->ack), &ack, 1 ) ) {
+			log_stats.acknowledged++;
+		}
+	}
+}
+
+/**
+ * Marks records first to last (inclusive) as received by the gateway
+ * While a sector is erasing the range is held until it finishes, rather than waiting on it
+ */
+void Log_Acknowledge_Range( uint32_t first, uint32_t last ) {
+	if ( ! log_mounted || LOG_NO_RECORD == first || LOG_NO_RECORD == last || last < first ) {
+		return;
+	}
+
+	if ( LOG_SUCCESS != _Log_Finish_Erase( FALSE ) ) {
+		if ( log_pending_ack_count < LOG_PENDING_ACKS ) {
+			log_pending_acks[log_pending_ack_count].first = first;
+			log_pending_acks[log_pending_ack_count].last = last;
+			log_pending_ack_count++;
+			return;
+		}
+		_Log_Finish_Erase( TRUE );
+	}
+
+	_Log_Apply_Acknowledgement( first, last );
+}
+
+/**
+ * Reads back a record, checking its CRC
+ * Fails while a sector is erasing, since reading bank 2 would stall until it is done
+ */
+uint8_t Log_Read( uint32_t id, obs_data_type *obs, uint8_t *acknowledged ) {
+	if ( ! log_mounted || id < log_stats.tail || id >= log_stats.head ) {
+		return LOG_FAILURE;
+	}
+
+	if ( LOG_SUCCESS != _Log_Finish_Erase( FALSE ) ) {
+		return LOG_FAILURE;
+	}
+
+	const log_record_type *record = _Log_Record( id );
+	if ( id != record->id || record->crc != _Log_CRC( (const uint32_t *) record, LOG_CRC_WORDS ) ) {
+		log_stats.crc_errors++;
+		return LOG_FAILURE;
+	}
+
+	*obs = record->obs;
+	*acknowledged = ( LOG_BLANK != record->ack );
+	return LOG_SUCCESS;
+}
+
+/**
+ * Reads will fail until this returns 0
+ */
+uint8_t Log_Is_Erasing() {
+	return LOG_SUCCESS != _Log_Finish_Erase( FALSE );
+}
+
+void Log_Get_Stats( log_stats_type *stats ) {
+	*stats = log_stats;
+	stats->erasing = log_erasing;
+	stats->pending_acks = log_pending_ack_count;
+}
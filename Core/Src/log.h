@@ -0,0 +1,63 @@
+/**
+ * log.h
+ * Allen Snook
+ * October 19, 2026
+ *
+ * Store and forward observation log in the last four sectors of flash
+ * bank 2 (see STM32F429ZITX_FLASH.ld), kept until the gateway acknowledges
+ * each observation. Records are appended in order and the oldest sector
+ * is erased to make room, so every sector wears at the same rate.
+ */
+
+#ifndef __LOG_H
+#define __LOG_H
+
+#include "stm32f4xx_hal.h"
+#include "obs.h"
+
+#define LOG_SUCCESS 1
+#define LOG_FAILURE 0
+
+// The LOG region of the linker script - 128K sectors 20 to 23
+// Bank 2 keeps programming and erasing from stalling code running in bank 1
+#define LOG_BASE 0x08180000
+#define LOG_FIRST_SECTOR FLASH_SECTOR_20
+#define LOG_SECTORS 4
+#define LOG_SECTOR_SIZE 0x20000
+
+// Each sector starts with a header in the first slot, records fill the rest
+#define LOG_SLOT_SIZE 32
+#define LOG_RECORDS_PER_SECTOR ( LOG_SECTOR_SIZE / LOG_SLOT_SIZE - 1 )
+#define LOG_CAPACITY ( LOG_SECTORS * LOG_RECORDS_PER_SECTOR )
+
+#define LOG_NO_RECORD 0xFFFFFFFF
+
+// Record (one slot) - programmed a word at a time, the ack word last of all and only once acknowledged
+typedef struct {
+	obs_data_type obs;
+	uint32_t id;		// Counts up from the first record ever written
+	uint32_t crc;		// Hardware CRC-32 over obs and id
+	uint32_t ack;		// Erased (0xFFFFFFFF) until acknowledged, then 0
+} log_record_type;
+
+typedef struct {
+	uint32_t head;				// Next record id
+	uint32_t tail;				// Oldest record id still in flash
+	uint32_t appended;			// Since boot
+	uint32_t acknowledged;
+	uint32_t lost;				// Erased before they were acknowledged
+	uint32_t crc_errors;		// Records read back that failed their CRC
+	uint32_t write_errors;		// Program or erase operations that failed
+	uint32_t erases[LOG_SECTORS];	// Over the life of the board, from the sector headers
+	uint8_t erasing;			// A sector erase is running
+	uint8_t pending_acks;		// Ranges waiting for it to finish
+} log_stats_type;
+
+uint8_t Log_Mount();
+uint32_t Log_Append( const obs_data_type *obs );
+void Log_Acknowledge_Range( uint32_t first, uint32_t last );
+uint8_t Log_Read( uint32_t id, obs_data_type *obs, uint8_t *acknowledged );
+uint8_t Log_Is_Erasing();
+void Log_Get_Stats( log_stats_type *stats );
+
+#endif // __LOG_H
@@ -0,0 +1,77 @@
+/**
+ * mailbox.c
+ * Allen Snook
+ * October 19, 2026
+ */
+
+#include "mailbox.h"
+#include "stm32f4xx_hal.h"
+
+// Mailboxes are listed here the first time something is posted to them
+static mailbox_type *mailbox_mailboxes[MAILBOX_MAX_MAILBOXES];
+static uint8_t mailbox_count = 0;
+
+void _Mailbox_Register( mailbox_type *mailbox ) {
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	if ( ! mailbox->registered ) {
+		mailbox->registered = 1;
+		if ( mailbox_count < MAILBOX_MAX_MAILBOXES ) {
+			mailbox_mailboxes[mailbox_count++] = mailbox;
+		}
+	}
+	__set_PRIMASK( primask );
+}
+
+/**
+ * Puts item in the mailbox
+ * Returns the item it replaced if the consumer never took it (so the caller
+ * can free it), otherwise 0
+ * Only one task should post to a mailbox
+ */
+void *Mailbox_Post( mailbox_type *mailbox, void *item ) {
+	if ( ! mailbox->registered ) {
+		_Mailbox_Register( mailbox );
+	}
+
+	void *displaced = __atomic_exchange_n( &mailbox->item, item, __ATOMIC_ACQ_REL );
+
+	mailbox->posts++;
+	if ( displaced ) {
+		mailbox->overwrites++;
+	}
+
+	return displaced;
+}
+
+/**
+ * Empties the mailbox
+ * Returns the newest item, or 0 if nothing new has been posted
+ * Only one task should take from a mailbox
+ */
+void *Mailbox_Take( mailbox_type *mailbox ) {
+	void *item = __atomic_exchange_n( &mailbox->item, (void *) 0, __ATOMIC_ACQ_REL );
+
+	if ( item ) {
+		mailbox->takes++;
+	}
+
+	return item;
+}
+
+/**
+ * Copies out the counters of the index'th mailbox to have been posted to
+ * Returns MAILBOX_FAILURE past the last one
+ */
+uint8_t Mailbox_Get_Stats( uint8_t index, mailbox_stats_type *stats ) {
+	if ( index >= mailbox_count ) {
+		return MAILBOX_FAILURE;
+	}
+
+	mailbox_type *mailbox = mailbox_mailboxes[index];
+	stats->name = mailbox->name;
+	stats->posts = mailbox->posts;
+	stats->overwrites = mailbox->overwrites;
+	stats->takes = mailbox->takes;
+	return MAILBOX_SUCCESS;
+}
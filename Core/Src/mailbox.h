@@ -0,0 +1,45 @@
+/**
+ * mailbox.h
+ * Allen Snook
+ * October 19, 2026
+ *
+ * Single slot, latest value mailboxes for sensor state
+ * Posting never blocks and always wins - it hands back whatever it displaced
+ * so the producer can free it. Taking never blocks either.
+ * The slot is swapped with LDREX/STREX, so there is no lock to wait on
+ */
+
+#ifndef __MAILBOX_H
+#define __MAILBOX_H
+
+#include <stdint.h>
+
+#define MAILBOX_SUCCESS 1
+#define MAILBOX_FAILURE 0
+
+#define MAILBOX_MAX_MAILBOXES 4 // That Mailbox_Get_Stats can list
+
+typedef struct {
+	const char *name;
+	void * volatile item;	// Newest item not yet taken, or 0
+	uint8_t registered;
+	uint32_t posts;
+	uint32_t overwrites;	// Posts that displaced an item nobody took
+	uint32_t takes;
+} mailbox_type;
+
+typedef struct {
+	const char *name;
+	uint32_t posts;
+	uint32_t overwrites;
+	uint32_t takes;
+} mailbox_stats_type;
+
+// Defines an empty mailbox, ready to use without initializing
+#define MAILBOX_DEFINE( name ) static mailbox_type name = { #name }
+
+void *Mailbox_Post( mailbox_type *mailbox, void *item );
+void *Mailbox_Take( mailbox_type *mailbox );
+uint8_t Mailbox_Get_Stats( uint8_t index, mailbox_stats_type *stats );
+
+#endif // __MAILBOX_H
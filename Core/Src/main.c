@@ -24,13 +24,21 @@
 
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include "queue.h"
 #include "core.h"
 #include "radio.h"
 #include "thp.h"
 #include "gps.h"
+#include "console.h"
+#include "sleep.h"
+#include "log.h"
+#include "health.h"
+#include "trace.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
+typedef StaticTask_t osStaticThreadDef_t;
+typedef StaticQueue_t osStaticMessageQDef_t;
 /* USER CODE BEGIN PTD */
 
 /* USER CODE END PTD */
@@ -52,52 +60,82 @@ RTC_HandleTypeDef hrtc;
 SPI_HandleTypeDef hspi1;
 
 UART_HandleTypeDef huart5;
+UART_HandleTypeDef huart3;
 
 /* Definitions for coreTask */
 osThreadId_t coreTaskHandle;
+uint32_t coreTaskBuffer[ 128 ];
+osStaticThreadDef_t coreTaskControlBlock;
 const osThreadAttr_t coreTask_attributes = {
   .name = "coreTask",
+  .cb_mem = &coreTaskControlBlock,
+  .cb_size = sizeof(coreTaskControlBlock),
+  .stack_mem = &coreTaskBuffer[0],
+  .stack_size = sizeof(coreTaskBuffer),
   .priority = (osPriority_t) osPriorityBelowNormal,
-  .stack_size = 128 * 4
 };
 /* Definitions for radioTask */
 osThreadId_t radioTaskHandle;
+uint32_t radioTaskBuffer[ 128 ];
+osStaticThreadDef_t radioTaskControlBlock;
 const osThreadAttr_t radioTask_attributes = {
   .name = "radioTask",
+  .cb_mem = &radioTaskControlBlock,
+  .cb_size = sizeof(radioTaskControlBlock),
+  .stack_mem = &radioTaskBuffer[0],
+  .stack_size = sizeof(radioTaskBuffer),
   .priority = (osPriority_t) osPriorityBelowNormal,
-  .stack_size = 128 * 4
 };
 /* Definitions for thpTask */
 osThreadId_t thpTaskHandle;
+uint32_t thpTaskBuffer[ 128 ];
+osStaticThreadDef_t thpTaskControlBlock;
 const osThreadAttr_t thpTask_attributes = {
   .name = "thpTask",
+  .cb_mem = &thpTaskControlBlock,
+  .cb_size = sizeof(thpTaskControlBlock),
+  .stack_mem = &thpTaskBuffer[0],
+  .stack_size = sizeof(thpTaskBuffer),
   .priority = (osPriority_t) osPriorityBelowNormal,
-  .stack_size = 128 * 4
 };
 /* Definitions for gpsTask */
 osThreadId_t gpsTaskHandle;
+uint32_t gpsTaskBuffer[ 128 ];
+osStaticThreadDef_t gpsTaskControlBlock;
 const osThreadAttr_t gpsTask_attributes = {
   .name = "gpsTask",
+  .cb_mem = &gpsTaskControlBlock,
+  .cb_size = sizeof(gpsTaskControlBlock),
+  .stack_mem = &gpsTaskBuffer[0],
+  .stack_size = sizeof(gpsTaskBuffer),
   .priority = (osPriority_t) osPriorityBelowNormal,
-  .stack_size = 128 * 4
 };
-/* Definitions for gpsToCore */
-osMessageQueueId_t gpsToCoreHandle;
-const osMessageQueueAttr_t gpsToCore_attributes = {
-  .name = "gpsToCore"
-};
-/* Definitions for thpToCore */
-osMessageQueueId_t thpToCoreHandle;
-const osMessageQueueAttr_t thpToCore_attributes = {
-  .name = "thpToCore"
+/* Definitions for consoleTask */
+osThreadId_t consoleTaskHandle;
+uint32_t consoleTaskBuffer[ 128 ];
+osStaticThreadDef_t consoleTaskControlBlock;
+const osThreadAttr_t consoleTask_attributes = {
+  .name = "consoleTask",
+  .cb_mem = &consoleTaskControlBlock,
+  .cb_size = sizeof(consoleTaskControlBlock),
+  .stack_mem = &consoleTaskBuffer[0],
+  .stack_size = sizeof(consoleTaskBuffer),
+  .priority = (osPriority_t) osPriorityLow,
 };
 /* Definitions for coreToRadio */
 osMessageQueueId_t coreToRadioHandle;
+uint8_t coreToRadioBuffer[ 3 * sizeof( uint8_t * ) ];
+osStaticMessageQDef_t coreToRadioControlBlock;
 const osMessageQueueAttr_t coreToRadio_attributes = {
-  .name = "coreToRadio"
+  .name = "coreToRadio",
+  .cb_mem = &coreToRadioControlBlock,
+  .cb_size = sizeof(coreToRadioControlBlock),
+  .mq_mem = &coreToRadioBuffer,
+  .mq_size = sizeof(coreToRadioBuffer)
 };
 /* USER CODE BEGIN PV */
-
+// Every kernel object is static, so nothing is taken from the FreeRTOS heap (see configTOTAL_HEAP_SIZE)
+// Stack sizes aren't checked at build time - watch each task's least stack free (console "health")
 /* USER CODE END PV */
 
 /* Private function prototypes -----------------------------------------------*/
@@ -107,10 +145,12 @@ static void MX_I2C2_Init(void);
 static void MX_RTC_Init(void);
 static void MX_SPI1_Init(void);
 static void MX_UART5_Init(void);
+static void MX_USART3_UART_Init(void);
 void StartCoreTask(void *argument);
 void StartRadioTask(void *argument);
 void StartTHPTask(void *argument);
 void StartGPSTask(void *argument);
+void StartConsoleTask(void *argument);
 
 /* USER CODE BEGIN PFP */
 
@@ -137,6 +177,7 @@ int main(void)
   HAL_Init();
 
   /* USER CODE BEGIN Init */
+  Trace_Init( Health_Save_Reset_Cause() );
 
   /* USER CODE END Init */
 
@@ -153,7 +194,10 @@ int main(void)
   MX_RTC_Init();
   MX_SPI1_Init();
   MX_UART5_Init();
+  MX_USART3_UART_Init();
   /* USER CODE BEGIN 2 */
+  Sleep_Set_RTC( &hrtc );
+  Sleep_Calibrate();
 
   /* USER CODE END 2 */
 
@@ -173,17 +217,12 @@ int main(void)
   /* USER CODE END RTOS_TIMERS */
 
   /* Create the queue(s) */
-  /* creation of gpsToCore */
-  gpsToCoreHandle = osMessageQueueNew (3, 14, &gpsToCore_attributes);
-
-  /* creation of thpToCore */
-  thpToCoreHandle = osMessageQueueNew (3, 6, &thpToCore_attributes);
-
   /* creation of coreToRadio */
-  coreToRadioHandle = osMessageQueueNew (3, 24, &coreToRadio_attributes);
+  coreToRadioHandle = osMessageQueueNew (3, sizeof(uint8_t *), &coreToRadio_attributes);
 
   /* USER CODE BEGIN RTOS_QUEUES */
   /* add queues, ... */
+  vQueueSetQueueNumber( (QueueHandle_t) coreToRadioHandle, TRACE_QUEUE_CORE_TO_RADIO );
   /* USER CODE END RTOS_QUEUES */
 
   /* Create the thread(s) */
@@ -199,6 +238,9 @@ int main(void)
   /* creation of gpsTask */
   gpsTaskHandle = osThreadNew(StartGPSTask, NULL, &gpsTask_attributes);
 
+  /* creation of consoleTask */
+  consoleTaskHandle = osThreadNew(StartConsoleTask, NULL, &consoleTask_attributes);
+
   /* USER CODE BEGIN RTOS_THREADS */
   /* add threads, ... */
   /* USER CODE END RTOS_THREADS */
@@ -332,8 +374,8 @@ static void MX_RTC_Init(void)
   */
   hrtc.Instance = RTC;
   hrtc.Init.HourFormat = RTC_HOURFORMAT_24;
-  hrtc.Init.AsynchPrediv = 127;
-  hrtc.Init.SynchPrediv = 255;
+  hrtc.Init.AsynchPrediv = 31;
+  hrtc.Init.SynchPrediv = 999;
   hrtc.Init.OutPut = RTC_OUTPUT_DISABLE;
   hrtc.Init.OutPutPolarity = RTC_OUTPUT_POLARITY_HIGH;
   hrtc.Init.OutPutType = RTC_OUTPUT_TYPE_OPENDRAIN;
@@ -443,6 +485,39 @@ static void MX_UART5_Init(void)
 
 }
 
+/**
+  * @brief USART3 Initialization Function
+  * @param None
+  * @retval None
+  */
+static void MX_USART3_UART_Init(void)
+{
+
+  /* USER CODE BEGIN USART3_Init 0 */
+
+  /* USER CODE END USART3_Init 0 */
+
+  /* USER CODE BEGIN USART3_Init 1 */
+
+  /* USER CODE END USART3_Init 1 */
+  huart3.Instance = USART3;
+  huart3.Init.BaudRate = 115200;
+  huart3.Init.WordLength = UART_WORDLENGTH_8B;
+  huart3.Init.StopBits = UART_STOPBITS_1;
+  huart3.Init.Parity = UART_PARITY_NONE;
+  huart3.Init.Mode = UART_MODE_TX_RX;
+  huart3.Init.HwFlowCtl = UART_HWCONTROL_NONE;
+  huart3.Init.OverSampling = UART_OVERSAMPLING_16;
+  if (HAL_UART_Init(&huart3) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  /* USER CODE BEGIN USART3_Init 2 */
+
+  /* USER CODE END USART3_Init 2 */
+
+}
+
 /**
   * @brief GPIO Initialization Function
   * @param None
@@ -520,14 +595,6 @@ static void MX_GPIO_Init(void)
   GPIO_InitStruct.Alternate = GPIO_AF11_ETH;
   HAL_GPIO_Init(RMII_TXD1_GPIO_Port, &GPIO_InitStruct);
 
-  /*Configure GPIO pins : STLK_RX_Pin STLK_TX_Pin */
-  GPIO_InitStruct.Pin = STLK_RX_Pin|STLK_TX_Pin;
-  GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
-  GPIO_InitStruct.Pull = GPIO_NOPULL;
-  GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
-  GPIO_InitStruct.Alternate = GPIO_AF7_USART3;
-  HAL_GPIO_Init(GPIOD, &GPIO_InitStruct);
-
   /*Configure GPIO pins : USB_PowerSwitchOn_Pin PG9 */
   GPIO_InitStruct.Pin = USB_PowerSwitchOn_Pin|GPIO_PIN_9;
   GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
@@ -566,6 +633,12 @@ static void MX_GPIO_Init(void)
 }
 
 /* USER CODE BEGIN 4 */
+void HAL_GPIO_EXTI_Callback( uint16_t GPIO_Pin )
+{
+  if ( GPIO_PIN_9 == GPIO_Pin ) {
+    Console_Wake(); // USART3 RX
+  }
+}
 
 /* USER CODE END 4 */
 
@@ -580,9 +653,8 @@ void StartCoreTask(void *argument)
 {
   /* USER CODE BEGIN 5 */
   Core_Set_RTC_Handle( &hrtc );
-  Core_Set_THP_Message_Queue( thpToCoreHandle );
-  Core_Set_GPS_Message_Queue( gpsToCoreHandle );
   Core_Set_Radio_Message_Queue( coreToRadioHandle );
+  Log_Mount(); // May have to erase a sector the very first time
   /* Infinite loop */
   for(;;)
   {
@@ -626,7 +698,7 @@ void StartTHPTask(void *argument)
 {
   /* USER CODE BEGIN StartTHPTask */
   THP_Set_I2C( &hi2c2 );
-  THP_Set_Message_Queue( thpToCoreHandle );
+  THP_Set_Notify( coreTaskHandle, CORE_FLAG_THP );
   /* Infinite loop */
   for(;;)
   {
@@ -647,7 +719,7 @@ void StartGPSTask(void *argument)
 {
   /* USER CODE BEGIN StartGPSTask */
   GPS_Set_UART( &huart5 );
-  GPS_Set_Message_Queue( gpsToCoreHandle );
+  GPS_Set_Notify( coreTaskHandle, CORE_FLAG_GPS );
   /* Infinite loop */
   for(;;)
   {
@@ -657,6 +729,27 @@ void StartGPSTask(void *argument)
   /* USER CODE END StartGPSTask */
 }
 
+/* USER CODE BEGIN Header_StartConsoleTask */
+/**
+* @brief Function implementing the consoleTask thread.
+* @param argument: Not used
+* @retval None
+*/
+/* USER CODE END Header_StartConsoleTask */
+void StartConsoleTask(void *argument)
+{
+  /* USER CODE BEGIN StartConsoleTask */
+  Console_Set_UART( &huart3 );
+  Console_Set_Wake_Pin( GPIOD, GPIO_PIN_9 );
+  /* Infinite loop */
+  for(;;)
+  {
+    Console_Run();
+    osThreadYield();
+  }
+  /* USER CODE END StartConsoleTask */
+}
+
  /**
   * @brief  Period elapsed callback in non blocking mode
   * @note   This function is called  when TIM7 interrupt took place, inside
@@ -0,0 +1,405 @@
+/**
+ * obs.c
+ * Allen Snook
+ * October 19, 2026
+ *
+ * Compact observation encoding
+ *
+ * Records are packed least significant bit first into increasing byte
+ * addresses, so the layout doesn't depend on the compiler or the CPU
+ *
+ * Record:
+ *   1 bit   key (1) or delta (0)
+ *   1 bit   position present
+ *   Key:    time 32, temperature 12 signed, pressure 12, humidity 10
+ *   Delta:  time, temperature, pressure and humidity as class coded
+ *           differences from the previous observation (see _OBS_Put_Delta)
+ *   Position (if present): latitude 20 signed, longitude 21 signed
+ *
+ * A delta record's previous observation is the reference for the first
+ * record in a frame and the record before it after that. Position is only
+ * sent in key records or when it differs from the previous observation.
+ */
+
+#include "obs.h"
+
+#ifndef TRUE
+#define TRUE UINT8_C(1)
+#endif
+#ifndef FALSE
+#define FALSE UINT8_C(0)
+#endif
+
+// Field Widths (bits)
+#define OBS_TIME_BITS 32
+#define OBS_TEMPERATURE_BITS 12
+#define OBS_PRESSURE_BITS 12
+#define OBS_HUMIDITY_BITS 10
+#define OBS_LATITUDE_BITS 20
+#define OBS_LONGITUDE_BITS 21
+
+// Pressure is sent as an offset from 800.0 mbar (8000), which covers up to 1209.5 mbar
+#define OBS_PRESSURE_OFFSET 8000
+
+// Delta Classes: 2 bits, then the value
+#define OBS_CLASS_BITS 2
+#define OBS_CLASS_ZERO 0
+#define OBS_CLASS_SMALL 1
+#define OBS_CLASS_MEDIUM 2
+#define OBS_CLASS_ABSOLUTE 3
+
+#define OBS_TIME_SMALL_BITS 8
+#define OBS_TIME_MEDIUM_BITS 16
+#define OBS_WEATHER_SMALL_BITS 4
+#define OBS_WEATHER_MEDIUM_BITS 8
+
+#define OBS_SECONDS_PER_DAY 86400UL
+
+typedef struct {
+	uint8_t *data;
+	const uint8_t *read_data;
+	uint16_t bit;
+	uint16_t max_bits;
+} obs_bits_type;
+
+static const uint16_t obs_days_before_month[12] = {
+	0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334
+};
+
+uint8_t _OBS_Is_Leap_Year( uint16_t year ) {
+	return ( ( year % 4 == 0 ) && ( year % 100 != 0 ) ) || ( year % 400 == 0 );
+}
+
+/**
+ * year is years since OBS_EPOCH_YEAR, month 1 to 12, day 1 to 31
+ */
+uint32_t OBS_Epoch_From_Date( uint8_t year, uint8_t month, uint8_t day, uint8_t hour, uint8_t minutes, uint8_t seconds ) {
+	if ( month < 1 || month > 12 || day < 1 ) {
+		return 0;
+	}
+
+	uint32_t days = 0;
+	for ( uint16_t y = OBS_EPOCH_YEAR; y < OBS_EPOCH_YEAR + year; y++ ) {
+		days += _OBS_Is_Leap_Year( y ) ? 366 : 365;
+	}
+
+	days += obs_days_before_month[month - 1];
+	if ( month > 2 && _OBS_Is_Leap_Year( OBS_EPOCH_YEAR + year ) ) {
+		days++;
+	}
+	days += day - 1;
+
+	return days * OBS_SECONDS_PER_DAY + hour * 3600UL + minutes * 60UL + seconds;
+}
+
+void OBS_Date_From_Epoch( uint32_t time, uint8_t *year, uint8_t *month, uint8_t *day, uint8_t *hour, uint8_t *minutes, uint8_t *seconds ) {
+	uint32_t days = time / OBS_SECONDS_PER_DAY;
+	uint32_t remainder = time % OBS_SECONDS_PER_DAY;
+
+	*hour = remainder / 3600;
+	*minutes = ( remainder % 3600 ) / 60;
+	*seconds = remainder % 60;
+
+	uint16_t y = OBS_EPOCH_YEAR;
+	while ( days >= ( _OBS_Is_Leap_Year( y ) ? 366U : 365U ) ) {
+		days -= _OBS_Is_Leap_Year( y ) ? 366 : 365;
+		y++;
+	}
+	*year = y - OBS_EPOCH_YEAR;
+
+	uint8_t m = 12;
+	while ( m > 1 ) {
+		uint16_t start = obs_days_before_month[m - 1] + ( ( m > 2 && _OBS_Is_Leap_Year( y ) ) ? 1 : 0 );
+		if ( days >= start ) {
+			days -= start;
+			break;
+		}
+		m--;
+	}
+	*month = m;
+	*day = days + 1;
+}
+
+/**
+ * Converts a GPS degrees / minutes / seconds / hemisphere position to signed arc seconds
+ */
+int32_t OBS_Arc_Seconds( uint8_t degrees, uint8_t minutes, uint8_t seconds, char hemisphere ) {
+	int32_t arc_seconds = (int32_t) degrees * 3600 + (int32_t) minutes * 60 + seconds;
+	if ( 'S' == hemisphere || 'W' == hemisphere ) {
+		arc_seconds = -arc_seconds;
+	}
+	return arc_seconds;
+}
+
+uint8_t _OBS_Put( obs_bits_type *bits, uint32_t value, uint8_t width ) {
+	if ( bits->bit + width > bits->max_bits ) {
+		return FALSE;
+	}
+
+	for ( uint8_t i = 0; i < width; i++ ) {
+		uint8_t mask = 1 << ( bits->bit & 7 );
+		if ( value & ( 1UL << i ) ) {
+			bits->data[bits->bit >> 3] |= mask;
+		} else {
+			bits->data[bits->bit >> 3] &= ~mask;
+		}
+		bits->bit++;
+	}
+
+	return TRUE;
+}
+
+uint8_t _OBS_Get( obs_bits_type *bits, uint32_t *value, uint8_t width ) {
+	if ( bits->bit + width > bits->max_bits ) {
+		return FALSE;
+	}
+
+	*value = 0;
+	for ( uint8_t i = 0; i < width; i++ ) {
+		if ( bits->read_data[bits->bit >> 3] & ( 1 << ( bits->bit & 7 ) ) ) {
+			*value |= 1UL << i;
+		}
+		bits->bit++;
+	}
+
+	return TRUE;
+}
+
+int32_t _OBS_Sign_Extend( uint32_t value, uint8_t width ) {
+	if ( width < 32 && ( value & ( 1UL << ( width - 1 ) ) ) ) {
+		value |= ~( ( 1UL << width ) - 1 );
+	}
+	return (int32_t) value;
+}
+
+uint8_t _OBS_Fits( int32_t value, uint8_t width ) {
+	int32_t limit = 1L << ( width - 1 );
+	return value >= -limit && value < limit;
+}
+
+/**
+ * Writes value as the smallest class that can hold value - previous,
+ * or as an absolute of full_width bits if the difference is too big
+ */
+uint8_t _OBS_Put_Delta( obs_bits_type *bits, int32_t value, int32_t previous, uint8_t small_width, uint8_t medium_width, uint8_t full_width ) {
+	int32_t delta = value - previous;
+
+	if ( 0 == delta ) {
+		return _OBS_Put( bits, OBS_CLASS_ZERO, OBS_CLASS_BITS );
+	}
+
+	if ( _OBS_Fits( delta, small_width ) ) {
+		return _OBS_Put( bits, OBS_CLASS_SMALL, OBS_CLASS_BITS ) && _OBS_Put( bits, (uint32_t) delta, small_width );
+	}
+
+	if ( _OBS_Fits( delta, medium_width ) ) {
+		return _OBS_Put( bits, OBS_CLASS_MEDIUM, OBS_CLASS_BITS ) && _OBS_Put( bits, (uint32_t) delta, medium_width );
+	}
+
+	return _OBS_Put( bits, OBS_CLASS_ABSOLUTE, OBS_CLASS_BITS ) && _OBS_Put( bits, (uint32_t) value, full_width );
+}
+
+uint8_t _OBS_Get_Delta( obs_bits_type *bits, int32_t *value, int32_t previous, uint8_t small_width, uint8_t medium_width, uint8_t full_width, uint8_t full_signed ) {
+	uint32_t class = 0;
+	uint32_t raw = 0;
+
+	if ( ! _OBS_Get( bits, &class, OBS_CLASS_BITS ) ) {
+		return FALSE;
+	}
+
+	switch ( class ) {
+		case OBS_CLASS_ZERO:
+			*value = previous;
+			return TRUE;
+		case OBS_CLASS_SMALL:
+			if ( ! _OBS_Get( bits, &raw, small_width ) ) {
+				return FALSE;
+			}
+			*value = previous + _OBS_Sign_Extend( raw, small_width );
+			return TRUE;
+		case OBS_CLASS_MEDIUM:
+			if ( ! _OBS_Get( bits, &raw, medium_width ) ) {
+				return FALSE;
+			}
+			*value = previous + _OBS_Sign_Extend( raw, medium_width );
+			return TRUE;
+		default:
+			if ( ! _OBS_Get( bits, &raw, full_width ) ) {
+				return FALSE;
+			}
+			*value = full_signed ? _OBS_Sign_Extend( raw, full_width ) : (int32_t) raw;
+			return TRUE;
+	}
+}
+
+int32_t _OBS_Pressure_Field( uint16_t pressure ) {
+	if ( pressure < OBS_PRESSURE_OFFSET ) {
+		return 0;
+	}
+	if ( pressure - OBS_PRESSURE_OFFSET >= ( 1 << OBS_PRESSURE_BITS ) ) {
+		return ( 1 << OBS_PRESSURE_BITS ) - 1;
+	}
+	return pressure - OBS_PRESSURE_OFFSET;
+}
+
+uint8_t _OBS_Put_Record( obs_bits_type *bits, const obs_data_type *previous, const obs_data_type *obs ) {
+	uint8_t key = ( 0 == previous );
+	uint8_t position = key || obs->latitude != previous->latitude || obs->longitude != previous->longitude;
+
+	if ( ! _OBS_Put( bits, key, 1 ) || ! _OBS_Put( bits, position, 1 ) ) {
+		return FALSE;
+	}
+
+	if ( key ) {
+		if ( ! _OBS_Put( bits, obs->time, OBS_TIME_BITS ) ||
+			! _OBS_Put( bits, (uint32_t) obs->temperature, OBS_TEMPERATURE_BITS ) ||
+			! _OBS_Put( bits, _OBS_Pressure_Field( obs->pressure ), OBS_PRESSURE_BITS ) ||
+			! _OBS_Put( bits, obs->humidity, OBS_HUMIDITY_BITS ) ) {
+			return FALSE;
+		}
+	} else {
+		if ( ! _OBS_Put_Delta( bits, (int32_t) obs->time, (int32_t) previous->time,
+				OBS_TIME_SMALL_BITS, OBS_TIME_MEDIUM_BITS, OBS_TIME_BITS ) ||
+			! _OBS_Put_Delta( bits, obs->temperature, previous->temperature,
+				OBS_WEATHER_SMALL_BITS, OBS_WEATHER_MEDIUM_BITS, OBS_TEMPERATURE_BITS ) ||
+			! _OBS_Put_Delta( bits, _OBS_Pressure_Field( obs->pressure ), _OBS_Pressure_Field( previous->pressure ),
+				OBS_WEATHER_SMALL_BITS, OBS_WEATHER_MEDIUM_BITS, OBS_PRESSURE_BITS ) ||
+			! _OBS_Put_Delta( bits, obs->humidity, previous->humidity,
+				OBS_WEATHER_SMALL_BITS, OBS_WEATHER_MEDIUM_BITS, OBS_HUMIDITY_BITS ) ) {
+			return FALSE;
+		}
+	}
+
+	if ( position ) {
+		if ( ! _OBS_Put( bits, (uint32_t) obs->latitude, OBS_LATITUDE_BITS ) ||
+			! _OBS_Put( bits, (uint32_t) obs->longitude, OBS_LONGITUDE_BITS ) ) {
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+uint8_t _OBS_Get_Record( obs_bits_type *bits, const obs_data_type *previous, obs_data_type *obs ) {
+	uint32_t key = 0;
+	uint32_t position = 0;
+	uint32_t raw = 0;
+	int32_t value = 0;
+
+	if ( ! _OBS_Get( bits, &key, 1 ) || ! _OBS_Get( bits, &position, 1 ) ) {
+		return FALSE;
+	}
+
+	if ( key ) {
+		if ( ! _OBS_Get( bits, &raw, OBS_TIME_BITS ) ) {
+			return FALSE;
+		}
+		obs->time = raw;
+		if ( ! _OBS_Get( bits, &raw, OBS_TEMPERATURE_BITS ) ) {
+			return FALSE;
+		}
+		obs->temperature = (int16_t) _OBS_Sign_Extend( raw, OBS_TEMPERATURE_BITS );
+		if ( ! _OBS_Get( bits, &raw, OBS_PRESSURE_BITS ) ) {
+			return FALSE;
+		}
+		obs->pressure = (uint16_t) ( raw + OBS_PRESSURE_OFFSET );
+		if ( ! _OBS_Get( bits, &raw, OBS_HUMIDITY_BITS ) ) {
+			return FALSE;
+		}
+		obs->humidity = (uint16_t) raw;
+	} else {
+		// A delta with nothing to be relative to can't be decoded
+		if ( ! previous ) {
+			return FALSE;
+		}
+
+		if ( ! _OBS_Get_Delta( bits, &value, (int32_t) previous->time,
+				OBS_TIME_SMALL_BITS, OBS_TIME_MEDIUM_BITS, OBS_TIME_BITS, FALSE ) ) {
+			return FALSE;
+		}
+		obs->time = (uint32_t) value;
+		if ( ! _OBS_Get_Delta( bits, &value, previous->temperature,
+				OBS_WEATHER_SMALL_BITS, OBS_WEATHER_MEDIUM_BITS, OBS_TEMPERATURE_BITS, TRUE ) ) {
+			return FALSE;
+		}
+		obs->temperature = (int16_t) value;
+		if ( ! _OBS_Get_Delta( bits, &value, _OBS_Pressure_Field( previous->pressure ),
+				OBS_WEATHER_SMALL_BITS, OBS_WEATHER_MEDIUM_BITS, OBS_PRESSURE_BITS, FALSE ) ) {
+			return FALSE;
+		}
+		obs->pressure = (uint16_t) ( value + OBS_PRESSURE_OFFSET );
+		if ( ! _OBS_Get_Delta( bits, &value, previous->humidity,
+				OBS_WEATHER_SMALL_BITS, OBS_WEATHER_MEDIUM_BITS, OBS_HUMIDITY_BITS, FALSE ) ) {
+			return FALSE;
+		}
+		obs->humidity = (uint16_t) value;
+	}
+
+	if ( position ) {
+		if ( ! _OBS_Get( bits, &raw, OBS_LATITUDE_BITS ) ) {
+			return FALSE;
+		}
+		obs->latitude = _OBS_Sign_Extend( raw, OBS_LATITUDE_BITS );
+		if ( ! _OBS_Get( bits, &raw, OBS_LONGITUDE_BITS ) ) {
+			return FALSE;
+		}
+		obs->longitude = _OBS_Sign_Extend( raw, OBS_LONGITUDE_BITS );
+	} else {
+		if ( ! previous ) {
+			return FALSE;
+		}
+		obs->latitude = previous->latitude;
+		obs->longitude = previous->longitude;
+	}
+
+	return TRUE;
+}
+
+/**
+ * Packs as many of the count observations as fit in max_length bytes
+ * reference may be 0, in which case the first record is a key record
+ * Returns the number of observations packed and sets length to the bytes used
+ */
+uint8_t OBS_Encode( const obs_data_type *reference, const obs_data_type *obs, uint8_t count,
+	uint8_t *records, uint8_t max_length, uint8_t *length ) {
+	obs_bits_type bits = { records, 0, 0, (uint16_t) max_length * 8 };
+	const obs_data_type *previous = reference;
+	uint8_t encoded = 0;
+
+	for ( uint8_t i = 0; i < count; i++ ) {
+		uint16_t start = bits.bit;
+		if ( ! _OBS_Put_Record( &bits, previous, &obs[i] ) ) {
+			bits.bit = start;
+			break;
+		}
+		previous = &obs[i];
+		encoded++;
+	}
+
+	// Zero the unused bits of the last byte
+	while ( bits.bit & 7 ) {
+		_OBS_Put( &bits, 0, 1 );
+	}
+
+	*length = bits.bit >> 3;
+	return encoded;
+}
+
+/**
+ * Unpacks count observations
+ * reference must be the observation the encoder used, or 0 if it had none
+ */
+uint8_t OBS_Decode( const obs_data_type *reference, const uint8_t *records, uint8_t length,
+	obs_data_type *obs, uint8_t count ) {
+	obs_bits_type bits = { 0, records, 0, (uint16_t) length * 8 };
+	const obs_data_type *previous = reference;
+
+	for ( uint8_t i = 0; i < count; i++ ) {
+		if ( ! _OBS_Get_Record( &bits, previous, &obs[i] ) ) {
+			return OBS_FAILURE;
+		}
+		previous = &obs[i];
+	}
+
+	return OBS_SUCCESS;
+}
@@ -0,0 +1,49 @@
+/**
+ * obs.h
+ * Allen Snook
+ * October 19, 2026
+ *
+ * Compact observation encoding, shared by the firmware and host tools
+ * No HAL or RTOS dependencies - this must build anywhere
+ */
+
+#ifndef __OBS_H
+#define __OBS_H
+
+#include <stdint.h>
+
+#define OBS_SUCCESS 1
+#define OBS_FAILURE 0
+
+// Frame Payload (follows the radio header)
+// Byte 0: sequence number of this frame
+// Byte 1: sequence number of the frame holding the reference observation,
+//         or OBS_NO_REFERENCE if the first record stands alone
+// Byte 2: number of records
+// Byte 3 onward: records, bit packed
+#define OBS_PAYLOAD_HEADER_LENGTH 3
+#define OBS_NO_REFERENCE 0xFF
+#define OBS_MAX_SEQUENCE 0xFE
+
+// Epoch seconds count from 2000-01-01 00:00:00 UTC (the GPS year is years since 2000)
+#define OBS_EPOCH_YEAR 2000
+
+typedef struct {
+	uint32_t time;			// Seconds since OBS_EPOCH_YEAR
+	int16_t temperature;	// deg C, 0.1 deg res
+	uint16_t pressure;		// mbar, 0.1 mbar res
+	uint16_t humidity;		// percent, 0.1 percent res
+	int32_t latitude;		// arc seconds, north positive
+	int32_t longitude;		// arc seconds, east positive
+} obs_data_type;
+
+uint32_t OBS_Epoch_From_Date( uint8_t year, uint8_t month, uint8_t day, uint8_t hour, uint8_t minutes, uint8_t seconds );
+void OBS_Date_From_Epoch( uint32_t time, uint8_t *year, uint8_t *month, uint8_t *day, uint8_t *hour, uint8_t *minutes, uint8_t *seconds );
+int32_t OBS_Arc_Seconds( uint8_t degrees, uint8_t minutes, uint8_t seconds, char hemisphere );
+
+uint8_t OBS_Encode( const obs_data_type *reference, const obs_data_type *obs, uint8_t count,
+	uint8_t *records, uint8_t max_length, uint8_t *length );
+uint8_t OBS_Decode( const obs_data_type *reference, const uint8_t *records, uint8_t length,
+	obs_data_type *obs, uint8_t count );
+
+#endif // __OBS_H
@@ -0,0 +1,107 @@
+/**
+ * pool.c
+ * Allen Snook
+ * October 19, 2026
+ */
+
+#include "pool.h"
+#include "stm32f4xx_hal.h"
+
+// Pools are listed here the first time they are used
+static pool_type *pool_pools[POOL_MAX_POOLS];
+static uint8_t pool_count = 0;
+
+/**
+ * The bookkeeping is a handful of instructions, so interrupts are simply held off around it
+ */
+uint32_t _Pool_Lock() {
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	return primask;
+}
+
+void _Pool_Unlock( uint32_t primask ) {
+	__set_PRIMASK( primask );
+}
+
+void _Pool_Register( pool_type *pool ) {
+	pool->registered = 1;
+	if ( pool_count < POOL_MAX_POOLS ) {
+		pool_pools[pool_count++] = pool;
+	}
+}
+
+/**
+ * Returns a free block, or 0 if they are all in use
+ */
+void *Pool_Alloc( pool_type *pool ) {
+	void *block = 0;
+	uint32_t primask = _Pool_Lock();
+
+	if ( ! pool->registered ) {
+		_Pool_Register( pool );
+	}
+
+	uint32_t free = ~pool->used;
+	if ( pool->block_count < POOL_MAX_BLOCKS ) {
+		free &= ( 1UL << pool->block_count ) - 1;
+	}
+
+	if ( free ) {
+		uint8_t index = __CLZ( __RBIT( free ) ); // Lowest free block
+		pool->used |= 1UL << index;
+		block = &(pool->blocks[(uint32_t) index * pool->block_size]);
+
+		pool->allocations++;
+		pool->in_use++;
+		if ( pool->in_use > pool->max_in_use ) {
+			pool->max_in_use = pool->in_use;
+		}
+	} else {
+		pool->exhaustions++;
+	}
+
+	_Pool_Unlock( primask );
+	return block;
+}
+
+void Pool_Free( pool_type *pool, void *block ) {
+	uint32_t offset = (uint8_t *) block - pool->blocks;
+	uint32_t index = offset / pool->block_size;
+	uint32_t primask = _Pool_Lock();
+
+	if ( (uint8_t *) block < pool->blocks || index >= pool->block_count ||
+		offset % pool->block_size != 0 || ! ( pool->used & ( 1UL << index ) ) ) {
+		pool->bad_frees++;
+	} else {
+		pool->used &= ~( 1UL << index );
+		pool->in_use--;
+	}
+
+	_Pool_Unlock( primask );
+}
+
+uint8_t Pool_Available( pool_type *pool ) {
+	return pool->block_count - pool->in_use;
+}
+
+/**
+ * Copies out the counters of the index'th pool to have been used
+ * Returns POOL_FAILURE past the last one
+ */
+uint8_t Pool_Get_Stats( uint8_t index, pool_stats_type *stats ) {
+	if ( index >= pool_count ) {
+		return POOL_FAILURE;
+	}
+
+	pool_type *pool = pool_pools[index];
+	stats->name = pool->name;
+	stats->block_size = pool->block_size;
+	stats->block_count = pool->block_count;
+	stats->in_use = pool->in_use;
+	stats->max_in_use = pool->max_in_use;
+	stats->allocations = pool->allocations;
+	stats->exhaustions = pool->exhaustions;
+	stats->bad_frees = pool->bad_frees;
+	return POOL_SUCCESS;
+}
@@ -0,0 +1,58 @@
+/**
+ * pool.h
+ * Allen Snook
+ * October 19, 2026
+ *
+ * Fixed-block memory pools, so a producer can build a message in place
+ * and queue a pointer to it (this CMSIS-RTOS2 port has no osMemoryPool)
+ * Blocks can be allocated and freed from any task or interrupt
+ */
+
+#ifndef __POOL_H
+#define __POOL_H
+
+#include <stdint.h>
+
+#define POOL_SUCCESS 1
+#define POOL_FAILURE 0
+
+#define POOL_MAX_BLOCKS 32 // One bit each in pool_type.used
+#define POOL_MAX_POOLS 8 // That Pool_Get_Stats can list
+
+typedef struct {
+	const char *name;
+	uint8_t *blocks;
+	uint16_t block_size;
+	uint8_t block_count;
+	uint32_t used;			// Bit n is set while block n is allocated
+	uint8_t registered;
+	uint8_t in_use;
+	uint8_t max_in_use;
+	uint32_t allocations;
+	uint32_t exhaustions;	// Allocations that found every block in use
+	uint32_t bad_frees;		// Pointers handed back that weren't allocated blocks
+} pool_type;
+
+typedef struct {
+	const char *name;
+	uint16_t block_size;
+	uint8_t block_count;
+	uint8_t in_use;
+	uint8_t max_in_use;
+	uint32_t allocations;
+	uint32_t exhaustions;
+	uint32_t bad_frees;
+} pool_stats_type;
+
+// Defines a pool of count blocks, each big enough for a type, ready to use without initializing
+#define POOL_DEFINE( name, type, count ) \
+	_Static_assert( (count) >= 1 && (count) <= POOL_MAX_BLOCKS, "Pool must have 1 to 32 blocks" ); \
+	static type name##_blocks[count]; \
+	static pool_type name = { #name, (uint8_t *) name##_blocks, sizeof( type ), (count) }
+
+void *Pool_Alloc( pool_type *pool );
+void Pool_Free( pool_type *pool, void *block );
+uint8_t Pool_Available( pool_type *pool );
+uint8_t Pool_Get_Stats( uint8_t index, pool_stats_type *stats );
+
+#endif // __POOL_H
@@ -9,19 +9,23 @@
 */
 
 #include "radio.h"
+#include "radio_config.h"
+#include "tdma.h"
+#include "fec.h"
+#include "drift.h"
+#include "pool.h"
+#include "cycles.h"
+#include "string.h"
 
 #define RADIO_MODE_UNKNOWN 0
 #define RADIO_MODE_IDLE 1
 #define RADIO_MODE_RX 2
 #define RADIO_MODE_TX 3
-
-#define RADIO_SUCCESS 1
-#define RADIO_FAILURE 0
+#define RADIO_MODE_SLEEP 4
+#define RADIO_MODE_COUNT 5
 
 #define RADIO_MAX_MODE_TIMEOUT 100
 
-#define RADIO_MAX_MESSAGE_LEN 60
-
 // Register Addresses
 #define RADIO_REG_00_FIFO 0x00
 #define RADIO_REG_01_OPMODE 0x01
@@ -36,18 +40,30 @@
 
 #define RADIO_REG_10_VERSION 0x10
 #define RADIO_REG_11_PALEVEL 0x11
+#define RADIO_REG_13_OCP 0x13
 #define RADIO_REG_19_RXBW 0x19
 #define RADIO_REG_1A_AFCBW 0x1A
+#define RADIO_REG_1E_AFCFEI 0x1E
+#define RADIO_REG_1F_AFCMSB 0x1F
+#define RADIO_REG_20_AFCLSB 0x20
 
+#define RADIO_REG_23_RSSICONFIG 0x23
 #define RADIO_REG_24_RSSI 0x24
 #define RADIO_REG_27_IRQFLAGS1 0x27
 #define RADIO_REG_28_IRQFLAGS2 0x28
+#define RADIO_REG_29_RSSITHRESH 0x29
+#define RADIO_REG_2A_RXTIMEOUT1 0x2A
+#define RADIO_REG_2B_RXTIMEOUT2 0x2B
 #define RADIO_REG_2C_PREAMBLEMSB 0x2C
 #define RADIO_REG_2D_PREAMBLELSB 0x2D
 
 #define RADIO_REG_3C_FIFOTHRESH 0x3C
 #define RADIO_REG_37_PACKETCONFIG1 0x37
+#define RADIO_REG_38_PAYLOADLENGTH 0x38
+#define RADIO_REG_39_NODEADRS 0x39
+#define RADIO_REG_3A_BROADCASTADRS 0x3A
 #define RADIO_REG_3D_PACKETCONFIG2 0x3D
+#define RADIO_REG_3E_AESKEY1 0x3E // through 0x4D
 
 #define RADIO_REG_5A_TESTPA1 0x5A
 #define RADIO_REG_5C_TESTPA2 0x5C
@@ -55,6 +71,8 @@
 #define RADIO_REG_2E_SYNCCONFIG 0x2E
 #define RADIO_REG_2F_SYNCVALUE1 0x2F
 #define RADIO_REG_30_SYNCVALUE2 0x30
+#define RADIO_REG_31_SYNCVALUE3 0x31
+#define RADIO_REG_32_SYNCVALUE4 0x32
 
 #define RADIO_REG_6F_TESTDAGC 0x6F
 
@@ -63,6 +81,7 @@
 #define RADIO_SYNCCONFIG_SYNCSIZE 0x38
 
 #define RADIO_PACKETCONFIG2_AESON 0x01
+#define RADIO_PACKETCONFIG2_AUTORXRESTARTON 0x02
 
 // Modulation Flags
 #define RADIO_DATAMODUL_DATAMODE_PACKET 0x0
@@ -74,33 +93,167 @@
 #define RADIO_PACKETCONFIG1_DCFREE_WHITENING 0x40
 #define RADIO_PACKETCONFIG1_CRC_ON 0x10
 #define RADIO_PACKETCONFIG1_ADDRESSFILTERING_NONE 0x00
+#define RADIO_PACKETCONFIG1_ADDRESSFILTERING_NODE_BROADCAST 0x04
+#define RADIO_PACKETCONFIG1 ( RADIO_PACKETCONFIG1_PACKETFORMAT_VARIABLE | \
+	RADIO_PACKETCONFIG1_DCFREE_WHITENING | \
+	RADIO_PACKETCONFIG1_CRC_ON ) // Address filtering is added by _Radio_Load_Address_Filter
 
 // IRQ Flags
 #define RADIO_IRQFLAGS1_MODEREADY 0x80
+#define RADIO_IRQFLAGS1_TIMEOUT 0x04
+
+// AFC
+#define RADIO_AFCFEI_AFCAUTOCLEARON 0x08
+#define RADIO_AFCFEI_AFCAUTOON 0x04
+
+// RSSI
+#define RADIO_RSSICONFIG_RSSISTART 0x01
+#define RADIO_RSSICONFIG_RSSIDONE 0x02
 
 // Op Mode Masks
 #define RADIO_OPMODE_MODE 0x1c
+#define RADIO_OPMODE_MODE_SLEEP 0x00
 #define RADIO_OPMODE_MODE_STDBY 0x04
 #define RADIO_OPMODE_MODE_TX 0x0c
 #define RADIO_OPMODE_MODE_RX 0x10
 
 // PA Masks
 #define RADIO_TESTPA1_NORMAL 0x55
+#define RADIO_TESTPA1_20DBM 0x5D
 #define RADIO_TESTPA2_NORMAL 0x70
+#define RADIO_TESTPA2_20DBM 0x7C
 #define RADIO_TESTDAGC_CONTINUOUSDAGC_IMPROVED_LOWBETAOFF 0x30
 
 // FIFO
 #define RADIO_FIFOTHRESH_TXSTARTCONDITION_NOTEMPTY 0x80
 
+// AES
+// The radio encrypts and decrypts the whole frame after the length byte in
+// the FIFO, so it can't stream and frames are limited to what fits
+#define RADIO_AES_KEY_LENGTH 16
+#define RADIO_AES_MAX_MESSAGE_LEN 65 // Including the length byte
+
+// Key Rotation Frame (after the header): key id, new key, Fletcher-16 of both
+// The check only catches corruption and a frame that didn't decrypt under the
+// current key - it is not a MAC, so it doesn't authenticate the new key
+#define RADIO_KEY_ROTATION_LENGTH ( 1 + RADIO_AES_KEY_LENGTH + 2 )
+
+// FIFO Streaming
+// Frames longer than the FIFO are fed in (and drained out) while on the air.
+// FifoLevel is set while more than RADIO_FIFO_THRESHOLD bytes are waiting.
+// DIO1, which could signal this, isn't wired, so the flags are polled over SPI
+#define RADIO_FIFO_SIZE 66
+#define RADIO_FIFO_THRESHOLD 32
+#define RADIO_FIFO_REFILL ( RADIO_FIFO_SIZE - RADIO_FIFO_THRESHOLD - 1 )
+
+// Encrypted frames are read whole once decrypted, so they must fit in the FIFO,
+// and they can be longer than the threshold, so they must not stream
+_Static_assert( RADIO_AES_MAX_MESSAGE_LEN <= RADIO_FIFO_SIZE, "Encrypted frames must fit in the FIFO" );
+_Static_assert( RADIO_AES_MAX_MESSAGE_LEN - 1 > RADIO_FIFO_THRESHOLD, "Encrypted frames no longer reach the FIFO threshold" );
+// Stop other tasks running while streaming if they could let the FIFO
+// run dry (or overflow) - i.e. when it holds less than this many us of data
+#define RADIO_STREAM_LOCK_BELOW 5000
+
 // IRQ Flags
+#define RADIO_IRQFLAGS2_FIFONOTEMPTY 0x40
+#define RADIO_IRQFLAGS2_FIFOLEVEL 0x20
+#define RADIO_IRQFLAGS2_FIFOOVERRUN 0x10
 #define RADIO_IRQFLAGS2_PAYLOADREADY 0x04
 #define RADIO_IRQFLAGS2_PACKETSENT 0x08
 
 // Output Power
 #define RADIO_PALEVEL_PA0ON 0x80
 #define RADIO_PALEVEL_PA1ON 0x40
+#define RADIO_PALEVEL_PA2ON 0x20
 #define RADIO_PALEVEL_OUTPUTPOWER 0x1F
 
+// Over Current Protection
+#define RADIO_OCP_ON 0x1A // 95 mA, the reset default
+#define RADIO_OCP_OFF 0x0F
+
+// Transmit Power Control
+// The RFM69HCW only brings out PA1 and PA2 (not PA0), which gives us
+// -2 to +13 dBm on PA1 alone, +14 to +17 dBm on PA1 + PA2 and
+// +18 to +20 dBm on PA1 + PA2 with the high power test registers set
+#define RADIO_TX_POWER_MIN -2
+#define RADIO_TX_POWER_MAX 20
+#define RADIO_TX_POWER_DEFAULT 13
+#define RADIO_TX_POWER_PA1_MAX 13
+#define RADIO_TX_POWER_PA1_PA2_MAX 17
+#define RADIO_TX_POWER_MAX_STEP 3
+
+// Link Margin (dB above the receiver's sensitivity at the current profile)
+#define RADIO_TARGET_LINK_MARGIN 12
+#define RADIO_LINK_MARGIN_HYSTERESIS 3
+#define RADIO_LINK_MARGIN_UNKNOWN INT8_MIN
+#define RADIO_MAX_MISSED_LINK_REPORTS 3
+
+// Receive Windows
+// After each frame goes out, the receiver gets two chances to answer: RX1 opens
+// RADIO_RX1_DELAY ms after the end of the frame and, if no link report came in
+// RX1, RX2 opens at RADIO_RX2_DELAY. The RxTimeout registers close a window
+// after RADIO_RX_WINDOW ms unless a signal turns up, and after the longest
+// downlink frame once one does, so the radio is back asleep within milliseconds
+#define RADIO_RX1_DELAY 5 // ms
+#define RADIO_RX2_DELAY 30 // ms
+#define RADIO_RX_WINDOW 10 // ms
+#define RADIO_DOWNLINK_MAX_MESSAGE_LEN 32 // Including the length byte
+#define RADIO_RX_THRESHOLD_MARGIN 3 // dB below the profile's sensitivity that counts as a signal
+#define RADIO_RX_NOTHING 0xFF
+
+// Bytes the radio adds around the frame: sync word and CRC
+#define RADIO_SYNC_LENGTH RADIO_CONFIG_SYNC_LENGTH
+#define RADIO_CRC_LENGTH 2
+
+// Listen Before Talk
+#define RADIO_LBT_THRESHOLD -90 // dBm, anything louder means the channel is busy
+#define RADIO_LBT_SAMPLES 5 // RSSI samples, 1 ms apart, that must all be clear
+#define RADIO_LBT_MAX_ATTEMPTS 6
+#define RADIO_BACKOFF_SLOT 20 // ms, doubled with each busy attempt
+#define RADIO_BACKOFF_MAX_EXPONENT 4
+
+// Duty Cycle (sliding window of airtime)
+#define RADIO_DUTY_CYCLE_BUCKETS 60
+#define RADIO_DUTY_CYCLE_BUCKET_LENGTH 60000 // ms, so the window is an hour
+#define RADIO_DUTY_CYCLE_LIMIT 10 // per mille of the window (1%)
+#define RADIO_DUTY_CYCLE_BUDGET \
+	( (uint64_t) RADIO_DUTY_CYCLE_BUCKETS * RADIO_DUTY_CYCLE_BUCKET_LENGTH * 1000 * RADIO_DUTY_CYCLE_LIMIT / 1000 ) // us
+
+// TDMA
+// One station per slot is what makes collisions between stations impossible
+_Static_assert( RADIO_NODE_ADDRESS >= 1 && RADIO_NODE_ADDRESS <= TDMA_SLOTS, "Node address has no TDMA slot" );
+#define RADIO_SLOT TDMA_SLOT_FOR_ADDRESS( RADIO_NODE_ADDRESS )
+
+// Extra time allowed for PacketSent beyond the frame's airtime
+#define RADIO_TX_TIMEOUT_MARGIN 20 // ms
+
+// Rate Adaptation
+#define RADIO_GOOD_REPORTS_BEFORE_RATE_UP 5
+
+// Frequency Correction
+// Once this many frames in a row arrive within RADIO_FREQUENCY_TRACKED_ERROR
+// of where they should be, the receive filter is narrowed (see radio_config.h)
+#define RADIO_FREQUENCY_TRACKED_ERROR ( RADIO_CONFIG_TRACKED_TOLERANCE / 2 ) // Hz
+#define RADIO_FREQUENCY_REPORTS_BEFORE_NARROW 3
+
+// Power States
+// The crystal takes a moment to start when leaving sleep, so wake up this much ahead of a TDMA slot
+#define RADIO_WAKE_AHEAD 5 // ms
+// How long to sleep before retrying a frame held back by a busy channel or the duty cycle
+#define RADIO_RETRY_DELAY 500 // ms
+
+// Relay
+// The FIFO holds over 100 ms at the listening profile, so looking at it every
+// tick is plenty. Copies of a frame (from the station itself and from other
+// relays) all turn up within a superframe, so that is as long as we remember one
+#define RADIO_RELAY_POLL 1 // ms
+#define RADIO_RELAY_CACHE_SIZE 16
+#define RADIO_RELAY_DUPLICATE_WINDOW TDMA_SUPERFRAME_LENGTH // ms
+#define RADIO_RELAY_PENDING 4 // At least the transmit queue's capacity
+
+// Link Statistics
+#define RADIO_PEER_AVERAGE_SHIFT 3 // Moving averages give each new frame 1/8 of the weight
+
 // Module variables
 static SPI_HandleTypeDef *radio_hspi = 0;
 static GPIO_TypeDef *radio_reset_gpio = 0;
@@ -110,12 +263,151 @@ static uint16_t radio_ncs_pin = 0;
 static osMessageQueueId_t radio_hqueue = 0;
 
 static uint8_t radio_mode = RADIO_MODE_UNKNOWN;
+static uint32_t radio_mode_since = 0;
+static uint32_t radio_mode_time[RADIO_MODE_COUNT];
+static uint32_t radio_wakeups = 0;
+static uint32_t radio_warm_up_time = 0;
 
 static volatile uint8_t radio_buffer_length = 0;
-static uint8_t radio_buffer[RADIO_MAX_MESSAGE_LEN];
+
+// The queue carries pointers to frames built in place in these blocks
+// Queue depth, plus the one being sent
+#define RADIO_FRAME_POOL_BLOCKS 4
+typedef uint8_t radio_frame_type[RADIO_MAX_MESSAGE_LEN];
+POOL_DEFINE( radio_frame_pool, radio_frame_type, RADIO_FRAME_POOL_BLOCKS );
+
+// radio_buffer is the frame being sent, or radio_rx_buffer the rest of the time
+static uint8_t radio_rx_buffer[RADIO_MAX_MESSAGE_LEN];
+static uint8_t *radio_buffer = radio_rx_buffer;
 
 static int8_t radio_rssi = 0;
 
+static int8_t radio_tx_power = RADIO_TX_POWER_DEFAULT;
+static uint8_t radio_high_power = 0;
+static int8_t radio_link_margin = RADIO_LINK_MARGIN_UNKNOWN;
+static uint8_t radio_missed_link_reports = 0;
+static uint8_t radio_acknowledged_sequence = 0;
+
+static uint8_t radio_has_pending_frame = 0;
+static uint32_t radio_random_state = 0;
+static uint32_t radio_airtime_buckets[RADIO_DUTY_CYCLE_BUCKETS];
+static uint32_t radio_airtime_bucket_start = 0;
+static uint8_t radio_airtime_bucket = 0;
+static radio_channel_stats_type radio_channel_stats = { 0 };
+static radio_rx_window_stats_type radio_rx_window_stats = { 0 };
+static uint8_t radio_fec_mode = RADIO_FEC_OFF;
+
+// Build with -DRADIO_AES_KEY=0x..,0x.. (16 bytes) to start encrypted
+#ifdef RADIO_AES_KEY
+static uint8_t radio_aes_key[RADIO_AES_KEY_LENGTH] = { RADIO_AES_KEY };
+static uint8_t radio_aes_enabled = 1;
+#else
+static uint8_t radio_aes_key[RADIO_AES_KEY_LENGTH] = { 0 };
+static uint8_t radio_aes_enabled = 0;
+#endif
+static uint8_t radio_aes_key_id = 0;
+static volatile uint8_t radio_aes_dirty = 1;
+static uint32_t radio_aes_rotations = 0;
+static uint32_t radio_aes_oversize_frames = 0;
+static uint32_t radio_aes_long_frames = 0;
+static radio_fec_stats_type radio_fec_stats = { 0 };
+static uint8_t radio_has_acknowledgement = 0;
+static uint8_t radio_backfill_base = 0;
+static uint16_t radio_backfill_bitmap = 0;
+static uint8_t radio_has_backfill_ack = 0;
+
+typedef struct {
+	const char *name;
+	uint32_t bitrate;		// bps
+	int8_t sensitivity;		// dBm, typical for the RFM69HCW at this bit rate
+	uint16_t bitrate_reg;
+	uint16_t fdev_reg;
+	uint8_t rxbw_reg;
+	uint8_t rxbw_tracked_reg;	// Narrower, once our frequency error is being corrected
+	uint8_t afcbw_reg;
+} radio_profile_type;
+
+#define RADIO_PROFILE_ENTRY( name, bps, fdev, sensitivity ) \
+	{ name, bps, sensitivity, RADIO_CONFIG_BITRATE( bps ), RADIO_CONFIG_FDEV( fdev ), \
+		RADIO_CONFIG_PROFILE_RXBW( bps, fdev ), RADIO_CONFIG_PROFILE_RXBW_TRACKED( bps, fdev ), \
+		RADIO_CONFIG_PROFILE_AFCBW( bps, fdev ) },
+
+// Ordered slowest (most robust) to fastest
+static const radio_profile_type radio_profiles[] = {
+	RADIO_CONFIG_PROFILES( RADIO_PROFILE_ENTRY )
+};
+
+_Static_assert( sizeof( radio_profiles ) / sizeof( radio_profiles[0] ) == RADIO_PROFILE_COUNT,
+	"RADIO_CONFIG_PROFILES and RADIO_PROFILE_COUNT disagree" );
+
+#define RADIO_FRF RADIO_CONFIG_FRF( RADIO_CONFIG_CARRIER )
+
+// Everything that doesn't change after reset, as register / value pairs
+static const uint8_t radio_config_image[][2] = {
+	{ RADIO_REG_02_DATAMODUL, RADIO_DATAMODUL_DATAMODE_PACKET |
+		RADIO_DATAMODUL_MODULATIONTYPE_FSK |
+		RADIO_DATAMODUL_MODULATIONSHAPING_FSK_BT1_0 },
+	{ RADIO_REG_07_FRFMSB, ( RADIO_FRF >> 16 ) & 0xFF },
+	{ RADIO_REG_08_FRFMID, ( RADIO_FRF >> 8 ) & 0xFF },
+	{ RADIO_REG_09_FRFLSB, RADIO_FRF & 0xFF },
+	{ RADIO_REG_13_OCP, RADIO_OCP_ON },
+	{ RADIO_REG_1E_AFCFEI, RADIO_AFCFEI_AFCAUTOON | RADIO_AFCFEI_AFCAUTOCLEARON }, // Fresh AFC for every frame
+	{ RADIO_REG_2C_PREAMBLEMSB, RADIO_CONFIG_PREAMBLE_LENGTH >> 8 },
+	{ RADIO_REG_2D_PREAMBLELSB, RADIO_CONFIG_PREAMBLE_LENGTH & 0xFF },
+	{ RADIO_REG_2E_SYNCCONFIG, RADIO_SYNCCONFIG_SYNCON |
+		( ( ( RADIO_CONFIG_SYNC_LENGTH - 1 ) << 3 ) & RADIO_SYNCCONFIG_SYNCSIZE ) },
+	{ RADIO_REG_2F_SYNCVALUE1, RADIO_CONFIG_SYNC_1 },
+	{ RADIO_REG_30_SYNCVALUE2, RADIO_CONFIG_SYNC_2 },
+	{ RADIO_REG_31_SYNCVALUE3, RADIO_CONFIG_SYNC_3 },
+	{ RADIO_REG_32_SYNCVALUE4, RADIO_CONFIG_SYNC_4 },
+	{ RADIO_REG_37_PACKETCONFIG1, RADIO_PACKETCONFIG1 | RADIO_PACKETCONFIG1_ADDRESSFILTERING_NODE_BROADCAST },
+	{ RADIO_REG_39_NODEADRS, RADIO_NODE_ADDRESS },
+	{ RADIO_REG_3A_BROADCASTADRS, RADIO_BROADCAST_ADDRESS },
+	{ RADIO_REG_38_PAYLOADLENGTH, RADIO_MAX_MESSAGE_LEN - 1 }, // Longest frame we accept
+	{ RADIO_REG_3C_FIFOTHRESH, RADIO_FIFOTHRESH_TXSTARTCONDITION_NOTEMPTY | RADIO_FIFO_THRESHOLD },
+	{ RADIO_REG_3D_PACKETCONFIG2, RADIO_PACKETCONFIG2_AUTORXRESTARTON }, // AES off
+	{ RADIO_REG_5A_TESTPA1, RADIO_TESTPA1_NORMAL },
+	{ RADIO_REG_5C_TESTPA2, RADIO_TESTPA2_NORMAL },
+	{ RADIO_REG_6F_TESTDAGC, RADIO_TESTDAGC_CONTINUOUSDAGC_IMPROVED_LOWBETAOFF }
+};
+
+static uint8_t radio_profile = RADIO_PROFILE_DEFAULT;
+static uint8_t radio_pending_profile = RADIO_PROFILE_DEFAULT;
+static uint8_t radio_announced_profile = RADIO_PROFILE_DEFAULT;
+static uint8_t radio_good_link_reports = 0;
+static uint8_t radio_register_profile = RADIO_PROFILE_DEFAULT; // What the modem registers are set to right now
+
+static volatile int16_t radio_temperature = 0;
+static volatile uint8_t radio_has_temperature = 0;
+static uint32_t radio_frf = RADIO_FRF;
+static int32_t radio_frequency_correction = 0;
+static uint8_t radio_frequency_tracked = 0;
+static uint8_t radio_good_frequency_reports = 0;
+static radio_frequency_stats_type radio_frequency_stats = { 0 };
+
+typedef struct {
+	uint8_t source;		// Station the frame started from, RADIO_GATEWAY_ADDRESS if unused
+	uint16_t digest;	// Fletcher-16 of its payload
+	uint32_t tick;		// When we queued it
+} radio_relay_seen_type;
+
+static uint8_t radio_relay_enabled = RADIO_RELAY;
+static volatile uint8_t radio_relay_dirty = 1;
+static radio_relay_seen_type radio_relay_seen[RADIO_RELAY_CACHE_SIZE];
+static uint8_t radio_relay_seen_next = 0;
+static uint32_t radio_relay_queued_at[RADIO_RELAY_PENDING]; // Ticks, oldest relayed frame in the queue first
+static uint8_t radio_relay_queued_head = 0;
+static uint8_t radio_relay_queued_tail = 0;
+static uint32_t radio_relay_pending_since = 0;
+static radio_relay_stats_type radio_relay_stats = { 0 };
+static uint8_t radio_queue_high_water = 0; // Frames ever waiting in the transmit queue at once, relaying or not
+
+static radio_peer_stats_type radio_peers[RADIO_PEERS];
+static int32_t radio_peer_rssi_filter[RADIO_PEERS]; // Averages, scaled up by 2^RADIO_PEER_AVERAGE_SHIFT
+static int32_t radio_peer_fei_filter[RADIO_PEERS];
+static uint8_t radio_peer_count = 0;
+static int32_t radio_fei = 0; // Hz, of the last frame received
+
 void _Radio_SPI_Select() {
 	if ( ! radio_ncs_gpio ) {
 		return;
@@ -144,18 +436,25 @@ void _Radio_SPI_FIFO_Read( uint8_t *data, uint8_t count ) {
 	_Radio_SPI_Unselect();
 }
 
-void _Radio_SPI_FIFO_Write( uint8_t *data, uint8_t count ) {
+/**
+ * Writes count bytes to consecutive registers starting at reg (the FIFO doesn't advance)
+ */
+void _Radio_SPI_Burst_Write( uint8_t reg, uint8_t *data, uint8_t count ) {
 	if ( ! radio_hspi ) {
 		return;
 	}
 
-	uint8_t reg = 0x80; // MSb high to indicate a write operation
+	reg |= 0x80; // MSb high to indicate a write operation
 	_Radio_SPI_Select();
 	HAL_SPI_Transmit( radio_hspi, &reg, 1, 10 );
 	HAL_SPI_Transmit( radio_hspi, data, count, 10 );
 	_Radio_SPI_Unselect();
 }
 
+void _Radio_SPI_FIFO_Write( uint8_t *data, uint8_t count ) {
+	_Radio_SPI_Burst_Write( RADIO_REG_00_FIFO, data, count );
+}
+
 uint8_t _Radio_SPI_Read( uint8_t reg ) {
 	if ( ! radio_hspi ) {
 		return 0;
@@ -214,246 +513,1639 @@ uint8_t _Radio_Set_Mode( uint8_t mode ) {
 	return RADIO_SUCCESS;
 }
 
+/**
+ * The +18 to +20 dBm settings must only be applied while transmitting
+ * The datasheet warns they can damage the receiver otherwise
+ */
+void _Radio_Set_High_Power_Regs( uint8_t enable ) {
+	if ( enable ) {
+		_Radio_SPI_Write( RADIO_REG_13_OCP, RADIO_OCP_OFF );
+		_Radio_SPI_Write( RADIO_REG_5A_TESTPA1, RADIO_TESTPA1_20DBM );
+		_Radio_SPI_Write( RADIO_REG_5C_TESTPA2, RADIO_TESTPA2_20DBM );
+	} else {
+		_Radio_SPI_Write( RADIO_REG_13_OCP, RADIO_OCP_ON );
+		_Radio_SPI_Write( RADIO_REG_5A_TESTPA1, RADIO_TESTPA1_NORMAL );
+		_Radio_SPI_Write( RADIO_REG_5C_TESTPA2, RADIO_TESTPA2_NORMAL );
+	}
+}
+
+/**
+ * Charges the time since the last change to the mode we are leaving
+ */
+void _Radio_Account_Mode( uint8_t mode ) {
+	uint32_t now = osKernelGetTickCount();
+	radio_mode_time[radio_mode] += now - radio_mode_since;
+	radio_mode_since = now;
+	radio_mode = mode;
+}
+
 void _Radio_Set_Mode_Idle() {
+	if ( radio_high_power ) {
+		_Radio_Set_High_Power_Regs( 0 );
+	}
+
+	// Leaving sleep means waiting for the crystal
+	uint32_t start = osKernelGetTickCount();
 	_Radio_Set_Mode( RADIO_OPMODE_MODE_STDBY );
-	radio_mode = RADIO_MODE_IDLE;
+	if ( RADIO_MODE_SLEEP == radio_mode ) {
+		radio_wakeups++;
+		radio_warm_up_time += osKernelGetTickCount() - start;
+		HAL_GPIO_WritePin( GPIOB, GPIO_PIN_14, GPIO_PIN_SET ); // Red PB14 LD3
+	}
+
+	_Radio_Account_Mode( RADIO_MODE_IDLE );
 }
 
 void _Radio_Set_Mode_Rx() {
+	if ( radio_high_power ) {
+		_Radio_Set_High_Power_Regs( 0 );
+	}
 	_Radio_Set_Mode( RADIO_OPMODE_MODE_RX );
-	radio_mode = RADIO_MODE_RX;
+	_Radio_Account_Mode( RADIO_MODE_RX );
 }
 
 void _Radio_Set_Mode_Tx() {
+	if ( radio_high_power ) {
+		_Radio_Set_High_Power_Regs( 1 );
+	}
 	_Radio_Set_Mode( RADIO_OPMODE_MODE_TX );
-	radio_mode = RADIO_MODE_TX;
+	_Radio_Account_Mode( RADIO_MODE_TX );
+}
+
+/**
+ * Everything but the SPI interface and the register contents powers down
+ * (about 0.1 uA against 1.25 mA in standby)
+ */
+void _Radio_Set_Mode_Sleep() {
+	if ( RADIO_MODE_SLEEP == radio_mode ) {
+		return;
+	}
+	if ( RADIO_MODE_IDLE != radio_mode ) {
+		_Radio_Set_Mode_Idle();
+	}
+	_Radio_Set_Mode( RADIO_OPMODE_MODE_SLEEP );
+	_Radio_Account_Mode( RADIO_MODE_SLEEP );
+	HAL_GPIO_WritePin( GPIOB, GPIO_PIN_14, GPIO_PIN_RESET ); // Red PB14 LD3
+}
+
+/**
+ * Time on air in us at profile for a frame of length bytes
+ * (including the length byte), with preamble, sync word and CRC
+ */
+uint32_t _Radio_Airtime_At( uint8_t profile, uint16_t length ) {
+	uint32_t bits = ( RADIO_CONFIG_PREAMBLE_LENGTH + RADIO_SYNC_LENGTH + length + RADIO_CRC_LENGTH ) * 8;
+	return (uint32_t) ( ( (uint64_t) bits * 1000000 ) / radio_profiles[profile].bitrate );
+}
+
+/**
+ * Programs bit rate, deviation and channel filters for a profile
+ * For the gateway's receive windows, with the narrow filter once we are tracking
+ * it and the RxTimeouts set. Otherwise (relaying) the receiver listens until
+ * a frame turns up. The radio should be in standby
+ */
+void _Radio_Write_Profile( uint8_t profile, uint8_t gateway ) {
+	const radio_profile_type *p = &radio_profiles[profile];
+
+	_Radio_SPI_Write( RADIO_REG_03_BITRATEMSB, p->bitrate_reg >> 8 );
+	_Radio_SPI_Write( RADIO_REG_04_BITRATELSB, p->bitrate_reg & 0xFF );
+	_Radio_SPI_Write( RADIO_REG_05_FDEVMSB, p->fdev_reg >> 8 );
+	_Radio_SPI_Write( RADIO_REG_06_FDEVLSB, p->fdev_reg & 0xFF );
+	_Radio_SPI_Write( RADIO_REG_19_RXBW, gateway && radio_frequency_tracked ? p->rxbw_tracked_reg : p->rxbw_reg );
+	_Radio_SPI_Write( RADIO_REG_1A_AFCBW, p->afcbw_reg );
+
+	// RxTimeout counts in units of 16 bit periods
+	uint32_t unit = 16000000UL / p->bitrate; // us
+	uint32_t timeout_1 = gateway ? ( RADIO_RX_WINDOW * 1000UL + unit - 1 ) / unit : 0;
+	uint32_t timeout_2 = gateway ? ( _Radio_Airtime_At( profile, RADIO_DOWNLINK_MAX_MESSAGE_LEN ) + unit - 1 ) / unit : 0;
+	_Radio_SPI_Write( RADIO_REG_2A_RXTIMEOUT1, timeout_1 > 0xFF ? 0xFF : timeout_1 );
+	_Radio_SPI_Write( RADIO_REG_2B_RXTIMEOUT2, timeout_2 > 0xFF ? 0xFF : timeout_2 );
+
+	// RssiThreshold is in -0.5 dB steps
+	_Radio_SPI_Write( RADIO_REG_29_RSSITHRESH, (uint8_t) ( -2 * ( p->sensitivity - RADIO_RX_THRESHOLD_MARGIN ) ) );
+
+	radio_register_profile = profile;
 }
 
 /**
- * Sets the sync words to 0x2d, 0xd4
+ * Switches to a profile for our own frames
+ * The radio should be in standby
  */
-void _Radio_Set_Sync_Words() {
-	uint8_t synclen = 2;
+void _Radio_Apply_Profile( uint8_t profile ) {
+	radio_profile = profile;
+	radio_announced_profile = profile;
+	radio_good_link_reports = 0;
 
-	uint8_t syncconfig = _Radio_SPI_Read( RADIO_REG_2E_SYNCCONFIG );
-	_Radio_SPI_Write( RADIO_REG_2F_SYNCVALUE1, 0x2D );
-	_Radio_SPI_Write( RADIO_REG_30_SYNCVALUE2, 0xD4 );
+	_Radio_Write_Profile( profile, 1 );
+}
 
-	// Clear all the bits in the sync config register except for the size
-	syncconfig &= ~RADIO_SYNCCONFIG_SYNCSIZE;
+/**
+ * Switches between the normal and the narrow receive filter
+ */
+void _Radio_Set_Frequency_Tracked( uint8_t tracked ) {
+	if ( ! tracked ) {
+		radio_good_frequency_reports = 0;
+	}
 
-	// Set the size
-	syncconfig |= ( synclen + 1 ) << 3;
+	if ( tracked == radio_frequency_tracked ) {
+		return;
+	}
 
-	// Make sure Sync is on
-	syncconfig |= RADIO_SYNCCONFIG_SYNCON;
+	radio_frequency_tracked = tracked;
+	const radio_profile_type *p = &radio_profiles[radio_profile];
+	_Radio_SPI_Write( RADIO_REG_19_RXBW, tracked ? p->rxbw_tracked_reg : p->rxbw_reg );
+}
 
-	// Write the result
-	_Radio_SPI_Write( RADIO_REG_2E_SYNCCONFIG, syncconfig );
+int32_t _Radio_Hz_To_Fstep( int32_t hz ) {
+	int64_t scaled = (int64_t) hz << RADIO_CONFIG_FSTEP_SHIFT;
+	int64_t half = (int64_t) RADIO_CONFIG_FXOSC / 2;
+	return (int32_t) ( ( scaled + ( scaled < 0 ? -half : half ) ) / (int64_t) RADIO_CONFIG_FXOSC );
 }
 
-void _Radio_Set_Modem_Config() {
-	// Data Modulation
-	uint8_t data_mod = RADIO_DATAMODUL_DATAMODE_PACKET |
-			RADIO_DATAMODUL_MODULATIONTYPE_FSK |
-			RADIO_DATAMODUL_MODULATIONSHAPING_FSK_BT1_0;
+int32_t _Radio_Fstep_To_Hz( int32_t fstep ) {
+	return (int32_t) ( ( (int64_t) fstep * (int64_t) RADIO_CONFIG_FXOSC ) >> RADIO_CONFIG_FSTEP_SHIFT );
+}
 
-	_Radio_SPI_Write( RADIO_REG_02_DATAMODUL, data_mod );
+/**
+ * Moves the carrier to cancel out the error we expect from our crystal
+ * at the current temperature. The radio should be in standby or sleep
+ */
+void _Radio_Update_Frequency() {
+	int32_t predicted = 0;
+	if ( radio_has_temperature && DRIFT_SUCCESS == Drift_Predict( radio_temperature, &predicted ) ) {
+		radio_frequency_correction = predicted;
+	}
 
-	// Set for bit rate of 4800 bps
-	// Divide 4800 into 32000000 clock to get 6667
-	// 6667 = 0x1A0B
-	_Radio_SPI_Write( RADIO_REG_03_BITRATEMSB, 0x1A );
-	_Radio_SPI_Write( RADIO_REG_04_BITRATELSB, 0x0B );
+	uint32_t frf = RADIO_FRF - _Radio_Hz_To_Fstep( radio_frequency_correction );
+	if ( frf == radio_frf ) {
+		return;
+	}
 
-	// Set for a FM deviation of 5 kHz
-	// Divide 5000 by Fstep (60) = 82 = 0x0052
-	_Radio_SPI_Write( RADIO_REG_05_FDEVMSB, 0x0 );
-	_Radio_SPI_Write( RADIO_REG_06_FDEVLSB, 0x52 );
+	// The new frequency takes effect when the LSB is written
+	_Radio_SPI_Write( RADIO_REG_07_FRFMSB, ( frf >> 16 ) & 0xFF );
+	_Radio_SPI_Write( RADIO_REG_08_FRFMID, ( frf >> 8 ) & 0xFF );
+	_Radio_SPI_Write( RADIO_REG_09_FRFLSB, frf & 0xFF );
+	radio_frf = frf;
+}
 
-	// RX BW
-	_Radio_SPI_Write( RADIO_REG_19_RXBW, 0xF4 );
+/**
+ * residual is how far (Hz) above the right frequency we were with the current
+ * correction in place, so our crystal's error is the two together
+ */
+void _Radio_Handle_Frequency_Error( int32_t residual ) {
+	int32_t error = residual + radio_frequency_correction;
 
-	// AFC BW
-	_Radio_SPI_Write( RADIO_REG_1A_AFCBW, 0xF4 );
+	if ( radio_has_temperature ) {
+		Drift_Record( radio_temperature, error );
+	}
 
-	// Packet Config (1)
-	uint8_t config = RADIO_PACKETCONFIG1_PACKETFORMAT_VARIABLE |
-			RADIO_PACKETCONFIG1_DCFREE_WHITENING |
-			RADIO_PACKETCONFIG1_CRC_ON |
-			RADIO_PACKETCONFIG1_ADDRESSFILTERING_NONE;
+	// Until the model can predict, correct for the latest measurement
+	radio_frequency_correction = error;
+
+	if ( residual <= RADIO_FREQUENCY_TRACKED_ERROR && residual >= - RADIO_FREQUENCY_TRACKED_ERROR ) {
+		if ( radio_good_frequency_reports < RADIO_FREQUENCY_REPORTS_BEFORE_NARROW ) {
+			radio_good_frequency_reports++;
+		}
+		if ( radio_good_frequency_reports >= RADIO_FREQUENCY_REPORTS_BEFORE_NARROW ) {
+			_Radio_Set_Frequency_Tracked( 1 );
+		}
+	} else {
+		_Radio_Set_Frequency_Tracked( 0 );
+	}
 
-	_Radio_SPI_Write( RADIO_REG_37_PACKETCONFIG1, config );
+	radio_frequency_stats.measurements++;
+	radio_frequency_stats.residual = residual;
 }
 
-void _Radio_Set_Preamble_Length( uint8_t length ) {
-	_Radio_SPI_Write( RADIO_REG_2C_PREAMBLEMSB, length >> 8 );
-	_Radio_SPI_Write( RADIO_REG_2D_PREAMBLELSB, length & 0xFF );
+/**
+ * A relay has to hear frames addressed to the gateway, so it filters in software instead
+ */
+void _Radio_Load_Address_Filter() {
+	radio_relay_dirty = 0;
+	_Radio_SPI_Write( RADIO_REG_37_PACKETCONFIG1, RADIO_PACKETCONFIG1 | ( radio_relay_enabled ?
+		RADIO_PACKETCONFIG1_ADDRESSFILTERING_NONE : RADIO_PACKETCONFIG1_ADDRESSFILTERING_NODE_BROADCAST ) );
 }
 
 /**
- * Frequency in kHz (e.g. 915000 = 915.0 MHz)
+ * Writes the constant register image, then the current profile
  */
-void _Radio_Set_Frequency( uint32_t frequency) {
-	// The radio has a crystal frequency of 32000 kHz (32 MHz)
-	// Each step is 32 MHz / 2^19 = 61 Hz
+void _Radio_Load_Config() {
+	for ( uint8_t i = 0; i < sizeof( radio_config_image ) / sizeof( radio_config_image[0] ); i++ ) {
+		_Radio_SPI_Write( radio_config_image[i][0], radio_config_image[i][1] );
+	}
 
-	uint32_t frf = frequency * 1000 / 61;
-	_Radio_SPI_Write( RADIO_REG_07_FRFMSB, (frf >> 16) & 0xFF );
-	_Radio_SPI_Write( RADIO_REG_08_FRFMID, (frf >> 8) & 0xFF );
-	_Radio_SPI_Write( RADIO_REG_09_FRFLSB, frf & 0xFF );
+	_Radio_Load_Address_Filter();
+	_Radio_Apply_Profile( radio_profile );
 }
 
 /**
- * Set to unencrypted
+ * Power in dBm, -2 to +20
  */
-void _Radio_Reset_Encryption_Key() {
-	uint8_t config = _Radio_SPI_Read( RADIO_REG_3D_PACKETCONFIG2 );
+void _Radio_Set_Tx_Power( int8_t power ) {
+	if ( power < RADIO_TX_POWER_MIN ) {
+		power = RADIO_TX_POWER_MIN;
+	}
 
-	// Disable AES Encryption
-	config &= ~RADIO_PACKETCONFIG2_AESON;
+	if ( power > RADIO_TX_POWER_MAX ) {
+		power = RADIO_TX_POWER_MAX;
+	}
 
-	// Write it back
-	_Radio_SPI_Write( RADIO_REG_3D_PACKETCONFIG2, config );
+	uint8_t palevel = 0;
+	if ( power <= RADIO_TX_POWER_PA1_MAX ) {
+		// PA1 alone: Pout = -18 + OutputPower
+		palevel = RADIO_PALEVEL_PA1ON | ( ( power + 18 ) & RADIO_PALEVEL_OUTPUTPOWER );
+	} else if ( power <= RADIO_TX_POWER_PA1_PA2_MAX ) {
+		// PA1 and PA2: Pout = -14 + OutputPower
+		palevel = RADIO_PALEVEL_PA1ON | RADIO_PALEVEL_PA2ON | ( ( power + 14 ) & RADIO_PALEVEL_OUTPUTPOWER );
+	} else {
+		// PA1 and PA2 with the high power settings: Pout = -11 + OutputPower
+		palevel = RADIO_PALEVEL_PA1ON | RADIO_PALEVEL_PA2ON | ( ( power + 11 ) & RADIO_PALEVEL_OUTPUTPOWER );
+	}
+
+	_Radio_SPI_Write( RADIO_REG_11_PALEVEL, palevel );
+
+	radio_tx_power = power;
+	radio_high_power = ( power > RADIO_TX_POWER_PA1_PA2_MAX );
 }
 
-void _Radio_Set_Tx_Power( int8_t power ) {
-	if ( power < -18 ) {
-		power = -18;
+/**
+ * Walks the transmit power toward RADIO_TARGET_LINK_MARGIN
+ * remote_rssi is the RSSI (dBm) the receiver measured on our last packet
+ */
+void _Radio_Update_Tx_Power( int8_t remote_rssi ) {
+	radio_missed_link_reports = 0;
+	radio_link_margin = remote_rssi - radio_profiles[radio_profile].sensitivity;
+
+	if ( radio_good_link_reports < UINT8_MAX ) {
+		radio_good_link_reports++;
 	}
 
-	if ( power > 13 ) {
-		power = 13;
+	int8_t error = radio_link_margin - RADIO_TARGET_LINK_MARGIN;
+	if ( error > RADIO_LINK_MARGIN_HYSTERESIS || error < -RADIO_LINK_MARGIN_HYSTERESIS ) {
+		// Power and margin move together dB for dB, so correct by the
+		// error directly, but limit the size of any one step
+		if ( error > RADIO_TX_POWER_MAX_STEP ) {
+			error = RADIO_TX_POWER_MAX_STEP;
+		}
+		if ( error < -RADIO_TX_POWER_MAX_STEP ) {
+			error = -RADIO_TX_POWER_MAX_STEP;
+		}
+		_Radio_Set_Tx_Power( radio_tx_power - error );
 	}
+}
 
-	uint8_t palevel = RADIO_PALEVEL_PA1ON | ( ( power + 18 ) & RADIO_PALEVEL_OUTPUTPOWER );
+/**
+ * No report heard - assume the link has faded and step the power up
+ */
+void _Radio_Handle_Missed_Link_Report() {
+	if ( radio_missed_link_reports < UINT8_MAX ) {
+		radio_missed_link_reports++;
+	}
 
-	_Radio_SPI_Write( RADIO_REG_11_PALEVEL, palevel );
+	if ( radio_missed_link_reports >= RADIO_MAX_MISSED_LINK_REPORTS ) {
+		radio_link_margin = RADIO_LINK_MARGIN_UNKNOWN;
+		_Radio_Set_Frequency_Tracked( 0 );
+		_Radio_Set_Tx_Power( radio_tx_power + RADIO_TX_POWER_MAX_STEP );
+
+		// The link is lost - go straight back to the rate the receiver falls back to
+		// (stepping down one at a time, we'd send frames it can't hear on the way)
+		if ( radio_profile != RADIO_PROFILE_DEFAULT ) {
+			radio_pending_profile = RADIO_PROFILE_DEFAULT;
+			radio_missed_link_reports = 0;
+		}
+	}
 }
 
-void Radio_Receive() {
-	uint8_t irq_flags = _Radio_SPI_Read( RADIO_REG_28_IRQFLAGS2 );
+/**
+ * Moves up a rate when the link could hold the target margin at the
+ * next profile's sensitivity, counting any transmit power we have left
+ */
+void _Radio_Update_Rate() {
+	if ( radio_pending_profile != radio_profile ) {
+		return;
+	}
 
-	if ( ( irq_flags & RADIO_IRQFLAGS2_PAYLOADREADY ) != 0 ) {
-		_Radio_Set_Mode_Idle();
+	if ( radio_profile + 1 >= RADIO_PROFILE_COUNT ) {
+		return;
+	}
 
-		// Read the entire FIFO
-		_Radio_SPI_FIFO_Read( &(radio_buffer[0]), RADIO_MAX_MESSAGE_LEN );
+	if ( radio_good_link_reports < RADIO_GOOD_REPORTS_BEFORE_RATE_UP ) {
+		return;
+	}
 
-		// Read the RSSI
-		// The register returns a positive number in 0.5 dB steps
-		// So we need to divide by 2 and switch the sign to get RSSI in dBm
-		// (-115 to 0 dBm)
-		uint8_t raw_rssi = _Radio_SPI_Read( RADIO_REG_24_RSSI );
-		radio_rssi = - (int8_t) ( raw_rssi >> 1 );
+	if ( RADIO_LINK_MARGIN_UNKNOWN == radio_link_margin ) {
+		return;
+	}
 
-		// TODO - send it all to core
+	int16_t penalty = radio_profiles[radio_profile].sensitivity - radio_profiles[radio_profile + 1].sensitivity;
+	int16_t headroom = radio_link_margin + ( RADIO_TX_POWER_MAX - radio_tx_power ) - penalty;
+	if ( headroom >= RADIO_TARGET_LINK_MARGIN + RADIO_LINK_MARGIN_HYSTERESIS ) {
+		radio_pending_profile = radio_profile + 1;
 	}
+}
 
-	_Radio_Set_Mode_Rx();
+/**
+ * Loads the key with one burst write and turns AES on or off to match
+ * The radio should be in standby or sleep
+ */
+void _Radio_Load_Key() {
+	radio_aes_dirty = 0;
+
+	if ( radio_aes_enabled ) {
+		_Radio_SPI_Burst_Write( RADIO_REG_3E_AESKEY1, radio_aes_key, RADIO_AES_KEY_LENGTH );
+	}
+
+	uint8_t config = _Radio_SPI_Read( RADIO_REG_3D_PACKETCONFIG2 );
+	if ( radio_aes_enabled ) {
+		config |= RADIO_PACKETCONFIG2_AESON;
+	} else {
+		config &= ~RADIO_PACKETCONFIG2_AESON;
+	}
+	_Radio_SPI_Write( RADIO_REG_3D_PACKETCONFIG2, config );
 }
 
-void _Radio_Handle_Transmit_Queue() {
-	if ( ! radio_hqueue ) {
+uint16_t _Radio_Fletcher16( const uint8_t *data, uint8_t length ) {
+	uint16_t sum1 = 0;
+	uint16_t sum2 = 0;
+	for ( uint8_t i = 0; i < length; i++ ) {
+		sum1 = ( sum1 + data[i] ) % 255;
+		sum2 = ( sum2 + sum1 ) % 255;
+	}
+	return ( sum2 << 8 ) | sum1;
+}
+
+/**
+ * A new key from the gateway. It only counts if it arrived encrypted under the
+ * current key (so it decrypted to something with the right check) and is newer
+ * than the current one, so a recorded rotation can't be replayed
+ * The check is no proof of who sent it - anyone with the current key can send one
+ */
+void _Radio_Handle_Key_Rotation() {
+	if ( ! radio_aes_enabled || radio_buffer[0] < RADIO_HEADER_LENGTH - 1 + RADIO_KEY_ROTATION_LENGTH ) {
 		return;
 	}
 
-	osStatus_t status = osMessageQueueGet( radio_hqueue, (void *) &(radio_buffer[0]), NULL, 0U );
-	if ( osOK != status ) {
-		// Nothing to transmit
-		HAL_GPIO_TogglePin( GPIOB, GPIO_PIN_14 ); // Red PB14 LD3
+	uint8_t *rotation = &(radio_buffer[RADIO_HEADER_LENGTH]);
+	uint16_t check = ( (uint16_t) rotation[1 + RADIO_AES_KEY_LENGTH] << 8 ) | rotation[2 + RADIO_AES_KEY_LENGTH];
+	if ( check != _Radio_Fletcher16( rotation, 1 + RADIO_AES_KEY_LENGTH ) ) {
 		return;
 	}
 
-	HAL_GPIO_WritePin( GPIOB, GPIO_PIN_14, GPIO_PIN_SET ); // Red PB14 LD3
+	if ( (int8_t) ( rotation[0] - radio_aes_key_id ) <= 0 ) {
+		return;
+	}
 
-	_Radio_SPI_FIFO_Write( &(radio_buffer[0]), radio_buffer[0] ); // radio_buffer[0] contains the packet length
+	radio_aes_key_id = rotation[0];
+	for ( uint8_t i = 0; i < RADIO_AES_KEY_LENGTH; i++ ) {
+		radio_aes_key[i] = rotation[1 + i];
+	}
+	radio_aes_rotations++;
 
-	// Start the transmitter
-	_Radio_Set_Mode_Tx();
+	// Radio_Receive has put the radio in standby
+	_Radio_Load_Key();
+}
 
-	uint8_t timeout_counter = 0;
-	uint8_t flags = 0;
-	do {
-		flags = _Radio_SPI_Read( RADIO_REG_28_IRQFLAGS2 );
-		HAL_Delay( 1 );
-		timeout_counter++;
-	} while ( ( timeout_counter < RADIO_MAX_MODE_TIMEOUT ) && !( flags & RADIO_IRQFLAGS2_PACKETSENT ) );
+/**
+ * Index of the statistics table entry for address, making one if need be
+ */
+uint8_t _Radio_Peer( uint8_t address ) {
+	uint8_t oldest = 0;
+	for ( uint8_t i = 0; i < radio_peer_count; i++ ) {
+		if ( radio_peers[i].address == address ) {
+			return i;
+		}
+		if ( (int32_t) ( radio_peers[i].last_heard - radio_peers[oldest].last_heard ) < 0 ) {
+			oldest = i;
+		}
+	}
 
-	_Radio_Set_Mode_Idle();
+	uint8_t index = radio_peer_count < RADIO_PEERS ? radio_peer_count++ : oldest;
+	radio_peers[index] = (radio_peer_stats_type) { 0 };
+	radio_peers[index].address = address;
+	radio_peers[index].last_heard = osKernelGetTickCount();
+	return index;
+}
+
+int32_t _Radio_Peer_Average( int32_t *filter, int32_t value, uint8_t first ) {
+	if ( first ) {
+		*filter = value * ( 1 << RADIO_PEER_AVERAGE_SHIFT );
+	} else {
+		*filter += value - *filter / ( 1 << RADIO_PEER_AVERAGE_SHIFT );
+	}
+	return *filter / ( 1 << RADIO_PEER_AVERAGE_SHIFT );
 }
+
 /**
- * Takes the pin high, briefly, to reset the radio
+ * The frame in radio_buffer was heard with radio_rssi and radio_fei
  */
-void _Radio_Reset() {
-	if ( ! radio_reset_gpio ) {
+void _Radio_Record_Received() {
+	uint8_t i = _Radio_Peer( radio_buffer[2] );
+	radio_peer_stats_type *peer = &radio_peers[i];
+	uint8_t first = 0 == peer->received;
+
+	int32_t fei = _Radio_Peer_Average( &radio_peer_fei_filter[i], radio_fei, first );
+	peer->fei = fei > INT16_MAX ? INT16_MAX : ( fei < INT16_MIN ? INT16_MIN : fei );
+	peer->rssi = (int8_t) _Radio_Peer_Average( &radio_peer_rssi_filter[i], radio_rssi, first );
+	peer->received++;
+	peer->last_heard = osKernelGetTickCount();
+}
+
+/**
+ * The frame in radio_buffer has been held back for another try
+ */
+void _Radio_Record_Retry() {
+	radio_peers[_Radio_Peer( radio_buffer[1] )].retried++;
+}
+
+/**
+ * The frame in radio_buffer has gone out (or failed to), taking
+ * airtime us and tx_done ms to PacketSent
+ */
+void _Radio_Record_Sent( uint32_t airtime, uint8_t result, uint32_t tx_done ) {
+	radio_peer_stats_type *peer = &radio_peers[_Radio_Peer( radio_buffer[1] )];
+
+	peer->sent++;
+	peer->airtime += airtime / 1000;
+	peer->last_heard = osKernelGetTickCount();
+
+	if ( RADIO_SUCCESS != result ) {
+		peer->failed++;
 		return;
 	}
 
-	HAL_GPIO_WritePin( radio_reset_gpio, radio_reset_pin, GPIO_PIN_SET );
-	HAL_Delay( 15 );
-	HAL_GPIO_WritePin( radio_reset_gpio, radio_reset_pin, GPIO_PIN_RESET );
-	HAL_Delay( 15 );
+	uint8_t bucket = 0;
+	while ( tx_done > 0 && bucket < RADIO_TX_DONE_BUCKETS - 1 ) {
+		tx_done >>= 1;
+		bucket++;
+	}
+	if ( peer->tx_done[bucket] < UINT16_MAX ) {
+		peer->tx_done[bucket]++;
+	}
 }
 
-uint8_t Radio_Init() {
-	// Reset the radio
-	_Radio_Reset();
+uint8_t _Radio_Frame_Is_For_Us() {
+	return RADIO_NODE_ADDRESS == radio_buffer[1] || RADIO_BROADCAST_ADDRESS == radio_buffer[1];
+}
 
-	// Read the radio chip ID. Should be 0x24
-	uint8_t device_type = _Radio_SPI_Read( RADIO_REG_10_VERSION );
+/**
+ * Have we queued this frame from source within the last superframe?
+ */
+uint8_t _Radio_Relay_Is_Duplicate( uint8_t source, uint16_t digest ) {
+	uint32_t now = osKernelGetTickCount();
+	for ( uint8_t i = 0; i < RADIO_RELAY_CACHE_SIZE; i++ ) {
+		radio_relay_seen_type *seen = &radio_relay_seen[i];
+		if ( seen->source == source && seen->digest == digest && now - seen->tick < RADIO_RELAY_DUPLICATE_WINDOW ) {
+			return 1;
+		}
+	}
+	return 0;
+}
 
-	if ( device_type != 0x24 ) {
-		return RADIO_FAILURE;
+void _Radio_Relay_Remember( uint8_t source, uint16_t digest ) {
+	radio_relay_seen_type *seen = &radio_relay_seen[radio_relay_seen_next];
+	seen->source = source;
+	seen->digest = digest;
+	seen->tick = osKernelGetTickCount();
+	radio_relay_seen_next = ( radio_relay_seen_next + 1 ) % RADIO_RELAY_CACHE_SIZE;
+}
+
+/**
+ * Wraps another station's frame for the gateway (in radio_buffer) in a
+ * RADIO_FRAME_RELAYED frame, or bumps the hop count of one that is already
+ * wrapped, and queues it behind our own frames
+ * There is no sequence number common to every frame type (and FEC hides the
+ * observation one), so a digest of the payload stands in for it
+ */
+void _Radio_Relay_Frame() {
+	radio_relay_stats.heard++;
+
+	uint8_t type = radio_buffer[3] & RADIO_CONTROL_TYPE;
+	uint8_t source = radio_buffer[2];
+	uint8_t hops = 0;
+	uint16_t payload = RADIO_HEADER_LENGTH;
+	if ( RADIO_FRAME_RELAYED == type ) {
+		if ( radio_buffer[0] < RADIO_HEADER_LENGTH - 1 + RADIO_RELAY_HEADER_LENGTH ) {
+			return;
+		}
+		hops = radio_buffer[4];
+		source = radio_buffer[5];
+		payload += RADIO_RELAY_HEADER_LENGTH;
 	}
 
-	_Radio_Set_Mode_Idle();
+	// Our own frame, come back through another relay
+	if ( RADIO_NODE_ADDRESS == source || RADIO_GATEWAY_ADDRESS == source ) {
+		return;
+	}
 
-	_Radio_SPI_Write( RADIO_REG_3C_FIFOTHRESH, RADIO_FIFOTHRESH_TXSTARTCONDITION_NOTEMPTY | 0x0F );
-	_Radio_SPI_Write( RADIO_REG_6F_TESTDAGC, RADIO_TESTDAGC_CONTINUOUSDAGC_IMPROVED_LOWBETAOFF );
-	_Radio_SPI_Write( RADIO_REG_5A_TESTPA1, RADIO_TESTPA1_NORMAL );
-	_Radio_SPI_Write( RADIO_REG_5C_TESTPA2, RADIO_TESTPA2_NORMAL );
+	if ( hops >= RADIO_RELAY_MAX_HOPS ) {
+		radio_relay_stats.hop_limit_drops++;
+		return;
+	}
 
-	_Radio_Set_Sync_Words();
-	_Radio_Set_Modem_Config();
-	_Radio_Set_Preamble_Length( 44 ); // Was 4
-	_Radio_Set_Frequency( 915000 ); // 915000 kHz = 915.000 MHz
-	_Radio_Reset_Encryption_Key();
-	_Radio_Set_Tx_Power( 13 ); // +13 dBm
+	uint16_t digest = _Radio_Fletcher16( &(radio_buffer[payload]), radio_buffer[0] + 1 - payload );
+	if ( _Radio_Relay_Is_Duplicate( source, digest ) ) {
+		radio_relay_stats.duplicates++;
+		return;
+	}
 
-	return RADIO_SUCCESS;
+	uint16_t length = radio_buffer[0] + 1;
+	if ( RADIO_FRAME_RELAYED != type ) {
+		length += RADIO_RELAY_HEADER_LENGTH;
+	}
+	if ( length > Radio_Get_Max_Frame_Length() ) {
+		radio_relay_stats.oversize_drops++;
+		return;
+	}
+
+	// Always leave room in the queue, and a block, for a frame of our own
+	if ( osMessageQueueGetSpace( radio_hqueue ) <= 1 || Pool_Available( &radio_frame_pool ) <= 1 ) {
+		radio_relay_stats.queue_full_drops++;
+		return;
+	}
+
+	if ( RADIO_FRAME_RELAYED != type ) {
+		for ( uint16_t i = length - 1; i >= RADIO_HEADER_LENGTH + RADIO_RELAY_HEADER_LENGTH; i-- ) {
+			radio_buffer[i] = radio_buffer[i - RADIO_RELAY_HEADER_LENGTH];
+		}
+		radio_buffer[0] = length - 1;
+		radio_buffer[6] = radio_buffer[3];
+		radio_buffer[5] = source;
+	}
+	radio_buffer[2] = RADIO_NODE_ADDRESS;
+	radio_buffer[3] = RADIO_FRAME_RELAYED;
+	radio_buffer[4] = hops + 1;
+
+	// radio_rx_buffer is needed for the next frame, so this is the one copy we can't avoid
+	uint8_t *frame = Radio_Alloc_Frame();
+	if ( ! frame ) {
+		radio_relay_stats.queue_full_drops++;
+		return;
+	}
+	memcpy( frame, radio_buffer, length );
+
+	if ( osOK != osMessageQueuePut( radio_hqueue, (void *) &frame, 0U, 0U ) ) {
+		Radio_Free_Frame( frame );
+		radio_relay_stats.queue_full_drops++;
+		return;
+	}
+
+	_Radio_Relay_Remember( source, digest );
+	radio_relay_queued_at[radio_relay_queued_head] = osKernelGetTickCount();
+	radio_relay_queued_head = ( radio_relay_queued_head + 1 ) % RADIO_RELAY_PENDING;
+	radio_relay_stats.queued++;
+
+	uint8_t depth = (uint8_t) osMessageQueueGetCount( radio_hqueue );
+	if ( depth > radio_relay_stats.max_queue_depth ) {
+		radio_relay_stats.max_queue_depth = depth;
+	}
 }
 
-void Radio_Set_SPI( SPI_HandleTypeDef *hspi ) {
-	radio_hspi = hspi;
+/**
+ * A relayed frame has just been taken off the queue
+ */
+void _Radio_Relay_Dequeued() {
+	radio_relay_pending_since = radio_relay_queued_at[radio_relay_queued_tail];
+	radio_relay_queued_tail = ( radio_relay_queued_tail + 1 ) % RADIO_RELAY_PENDING;
 }
 
-void Radio_Set_Reset_Pin( GPIO_TypeDef* gpio, uint16_t pin ) {
-	radio_reset_gpio = gpio;
-	radio_reset_pin = pin;
+/**
+ * ... and has now gone out
+ */
+void _Radio_Relay_Forwarded( uint32_t sent_at ) {
+	uint32_t latency = sent_at - radio_relay_pending_since;
+
+	radio_relay_stats.forwarded++;
+	radio_relay_stats.latency = latency;
+	radio_relay_stats.total_latency += latency;
+	if ( latency > radio_relay_stats.max_latency ) {
+		radio_relay_stats.max_latency = latency;
+	}
 }
 
-void Radio_Set_NCS_Pin( GPIO_TypeDef* gpio, uint16_t pin ) {
-	radio_ncs_gpio = gpio;
-	radio_ncs_pin = pin;
+void _Radio_Handle_Received_Frame() {
+	// radio_buffer[0] contains the number of bytes following the length byte
+	if ( radio_buffer[0] < RADIO_HEADER_LENGTH - 1 ) {
+		return;
+	}
+
+	// With relaying on, the radio doesn't filter addresses for us
+	if ( radio_relay_enabled && RADIO_GATEWAY_ADDRESS == radio_buffer[1] ) {
+		_Radio_Relay_Frame();
+		return;
+	}
+	if ( ! _Radio_Frame_Is_For_Us() ) {
+		return;
+	}
+
+	uint8_t frame_type = radio_buffer[3] & RADIO_CONTROL_TYPE;
+	if ( RADIO_FRAME_LINK_REPORT == frame_type && radio_buffer[0] >= RADIO_HEADER_LENGTH ) {
+		_Radio_Update_Tx_Power( (int8_t) radio_buffer[4] );
+		_Radio_Update_Rate();
+
+		if ( radio_buffer[0] >= RADIO_HEADER_LENGTH + 1 ) {
+			radio_acknowledged_sequence = radio_buffer[5];
+			radio_has_acknowledgement = 1;
+		}
+
+		// The receiver's measurement of our last frame is best. Failing that, the
+		// AFC's correction to receive this report tells us our own error, reversed
+		if ( radio_buffer[0] >= RADIO_HEADER_LENGTH + 3 ) {
+			_Radio_Handle_Frequency_Error( (int16_t) ( ( radio_buffer[6] << 8 ) | radio_buffer[7] ) );
+		} else {
+			_Radio_Handle_Frequency_Error( - radio_fei );
+		}
+
+		if ( radio_buffer[0] >= RADIO_HEADER_LENGTH + 6 ) {
+			radio_backfill_base = radio_buffer[8];
+			radio_backfill_bitmap = ( radio_buffer[9] << 8 ) | radio_buffer[10];
+			radio_has_backfill_ack = 1;
+		}
+	} else if ( RADIO_FRAME_KEY_ROTATION == frame_type ) {
+		_Radio_Handle_Key_Rotation();
+	}
 }
 
-void Radio_Set_Message_Queue( osMessageQueueId_t hqueue ) {
-	radio_hqueue = hqueue;
+/**
+ * Should other tasks be kept off the CPU while streaming at the current profile?
+ */
+uint8_t _Radio_Stream_Needs_Lock() {
+	uint32_t fifo_time = (uint32_t) ( (uint64_t) RADIO_FIFO_THRESHOLD * 8 * 1000000 / radio_profiles[radio_register_profile].bitrate );
+	return fifo_time < RADIO_STREAM_LOCK_BELOW;
 }
 
-void Radio_Run() {
-	// If we haven't spoken to the radio yet, try again
-	if ( RADIO_MODE_UNKNOWN == radio_mode ) {
-		HAL_GPIO_WritePin( GPIOB, GPIO_PIN_14, GPIO_PIN_RESET ); // Red PB14 LD3
-		Radio_Init();
+/**
+ * Waits for an IRQFLAGS2 flag to be set (or cleared), giving up after timeout ms
+ * Timed by the HAL tick, which keeps counting while the kernel is locked
+ */
+uint8_t _Radio_Wait_For_Flag( uint8_t flag, uint8_t set, uint32_t start, uint32_t timeout ) {
+	while ( HAL_GetTick() - start < timeout ) {
+		uint8_t flags = _Radio_SPI_Read( RADIO_REG_28_IRQFLAGS2 );
+		if ( ( ( flags & flag ) != 0 ) == ( set != 0 ) ) {
+			return RADIO_SUCCESS;
+		}
+	}
+	return RADIO_FAILURE;
+}
+
+/**
+ * Reads an encrypted frame into radio_buffer in one go once the radio has decrypted it
+ * The AES engine works on the FIFO in place only after the whole frame is in,
+ * so nothing is read before PayloadReady
+ */
+uint8_t _Radio_Rx_Decrypted( uint32_t start ) {
+	uint32_t timeout = _Radio_Airtime_At( radio_register_profile, RADIO_AES_MAX_MESSAGE_LEN ) / 1000 + RADIO_TX_TIMEOUT_MARGIN;
+	if ( RADIO_SUCCESS != _Radio_Wait_For_Flag( RADIO_IRQFLAGS2_PAYLOADREADY, 1, start, timeout ) ) {
+		return RADIO_FAILURE;
+	}
+
+	_Radio_SPI_FIFO_Read( &(radio_buffer[0]), 1 );
+	uint16_t length = radio_buffer[0] + 1;
+	if ( length > RADIO_AES_MAX_MESSAGE_LEN ) {
+		radio_aes_oversize_frames++;
+		return RADIO_FAILURE;
+	}
+
+	_Radio_SPI_FIFO_Read( &(radio_buffer[1]), length - 1 );
+	if ( length - 1 > RADIO_FIFO_THRESHOLD ) {
+		radio_aes_long_frames++;
 	}
+	return RADIO_SUCCESS;
+}
+
+/**
+ * Drains a frame out of the FIFO into radio_buffer as it arrives
+ * The radio must be in RX with at least the length byte in the FIFO
+ */
+uint8_t _Radio_Stream_Rx() {
+	uint32_t start = HAL_GetTick();
+
+	// Encrypted frames can't be streamed (see _Radio_Rx_Decrypted)
+	if ( radio_aes_enabled ) {
+		return _Radio_Rx_Decrypted( start );
+	}
+
+	// The length byte says how long to wait and whether there is enough to stream
+	_Radio_SPI_FIFO_Read( &(radio_buffer[0]), 1 );
+	uint16_t received = 1;
+	uint16_t length = radio_buffer[0] + 1;
+	uint32_t timeout = _Radio_Airtime_At( radio_register_profile, length ) / 1000 + RADIO_TX_TIMEOUT_MARGIN;
+	uint8_t result = RADIO_SUCCESS;
 
-	if ( RADIO_MODE_IDLE == radio_mode ) {
-		_Radio_Handle_Transmit_Queue();
+	uint8_t lock = ( length - received > RADIO_FIFO_THRESHOLD ) && _Radio_Stream_Needs_Lock();
+	if ( lock ) {
+		osKernelLock();
+	}
+
+	// Take it in threshold sized pieces while there is more to come...
+	while ( length - received > RADIO_FIFO_THRESHOLD ) {
+		if ( RADIO_SUCCESS != _Radio_Wait_For_Flag( RADIO_IRQFLAGS2_FIFOLEVEL, 1, start, timeout ) ) {
+			result = RADIO_FAILURE;
+			break;
+		}
+		_Radio_SPI_FIFO_Read( &(radio_buffer[received]), RADIO_FIFO_THRESHOLD );
+		received += RADIO_FIFO_THRESHOLD;
+	}
+
+	// ... then the rest once the CRC has checked out (a bad CRC clears the FIFO instead)
+	if ( RADIO_SUCCESS == result ) {
+		result = _Radio_Wait_For_Flag( RADIO_IRQFLAGS2_PAYLOADREADY, 1, start, timeout );
+	}
+	if ( RADIO_SUCCESS == result && length > received ) {
+		_Radio_SPI_FIFO_Read( &(radio_buffer[received]), length - received );
+	}
 
+	if ( lock ) {
+		osKernelUnlock();
 	}
 
-	// Sleep before returning
-	osDelay( 500 );
+	return result;
+}
+
+/**
+ * Feeds radio_buffer into the FIFO as it goes out, then waits for it to finish
+ * tx_done is set to the ms from starting the transmitter until PacketSent
+ */
+uint8_t _Radio_Stream_Tx( uint32_t airtime, uint32_t *tx_done ) {
+	uint32_t start = HAL_GetTick();
+	uint32_t timeout = airtime / 1000 + RADIO_TX_TIMEOUT_MARGIN;
+	uint16_t length = radio_buffer[0] + 1;
+	uint16_t sent = length < RADIO_FIFO_SIZE ? length : RADIO_FIFO_SIZE;
+	uint8_t result = RADIO_SUCCESS;
+
+	_Radio_SPI_FIFO_Write( &(radio_buffer[0]), sent );
+
+	uint8_t lock = ( sent < length ) && _Radio_Stream_Needs_Lock();
+	if ( lock ) {
+		osKernelLock();
+	}
+
+	// Start the transmitter
+	_Radio_Set_Mode_Tx();
+	uint32_t started = HAL_GetTick();
+
+	// Top the FIFO up each time it falls to the threshold
+	while ( sent < length ) {
+		if ( RADIO_SUCCESS != _Radio_Wait_For_Flag( RADIO_IRQFLAGS2_FIFOLEVEL, 0, start, timeout ) ) {
+			result = RADIO_FAILURE;
+			break;
+		}
+		uint16_t refill = length - sent < RADIO_FIFO_REFILL ? length - sent : RADIO_FIFO_REFILL;
+		_Radio_SPI_FIFO_Write( &(radio_buffer[sent]), refill );
+		sent += refill;
+	}
+
+	if ( lock ) {
+		osKernelUnlock();
+	}
+
+	// Wait for the whole frame to go out - at 4.8 kbps that is well over 100 ms
+	uint8_t flags = 0;
+	do {
+		flags = _Radio_SPI_Read( RADIO_REG_28_IRQFLAGS2 );
+		osDelay( 1 );
+	} while ( ( HAL_GetTick() - start < timeout ) && !( flags & RADIO_IRQFLAGS2_PACKETSENT ) );
+
+	if ( !( flags & RADIO_IRQFLAGS2_PACKETSENT ) ) {
+		result = RADIO_FAILURE;
+	}
+	*tx_done = HAL_GetTick() - started;
+
+	return result;
+}
+
+/**
+ * Returns RADIO_SUCCESS if a frame was read into radio_buffer
+ */
+uint8_t Radio_Receive() {
+	uint8_t irq_flags = _Radio_SPI_Read( RADIO_REG_28_IRQFLAGS2 );
+
+	// Anything in the FIFO means a frame has started arriving
+	if ( ( irq_flags & ( RADIO_IRQFLAGS2_FIFONOTEMPTY | RADIO_IRQFLAGS2_PAYLOADREADY ) ) == 0 ) {
+		return RADIO_FAILURE;
+	}
+
+	uint8_t result = _Radio_Stream_Rx();
+
+	_Radio_Set_Mode_Idle();
+
+	if ( RADIO_SUCCESS != result ) {
+		// Throw away whatever is left of it
+		_Radio_SPI_Write( RADIO_REG_28_IRQFLAGS2, RADIO_IRQFLAGS2_FIFOOVERRUN );
+		return RADIO_FAILURE;
+	}
+
+	// Read the RSSI
+	// The register returns a positive number in 0.5 dB steps
+	// So we need to divide by 2 and switch the sign to get RSSI in dBm
+	// (-115 to 0 dBm)
+	uint8_t raw_rssi = _Radio_SPI_Read( RADIO_REG_24_RSSI );
+	radio_rssi = - (int8_t) ( raw_rssi >> 1 );
+
+	// The AFC's correction to receive it is how far above our frequency it was
+	int16_t afc = (int16_t) ( ( _Radio_SPI_Read( RADIO_REG_1F_AFCMSB ) << 8 ) | _Radio_SPI_Read( RADIO_REG_20_AFCLSB ) );
+	radio_fei = _Radio_Fstep_To_Hz( afc );
+
+	if ( radio_buffer[0] >= RADIO_HEADER_LENGTH - 1 ) {
+		_Radio_Record_Received();
+	}
+
+	_Radio_Handle_Received_Frame();
+
+	return RADIO_SUCCESS;
+}
+
+/**
+ * ms from the end of a frame until the second receive window has certainly closed
+ */
+uint32_t _Radio_Rx_Windows_Time() {
+	return RADIO_RX2_DELAY + RADIO_RX_WINDOW + Radio_Get_Airtime( RADIO_DOWNLINK_MAX_MESSAGE_LEN ) / 1000 + RADIO_TX_TIMEOUT_MARGIN;
+}
+
+/**
+ * Sleeps until opens_at (kernel ticks), then listens until a frame has been
+ * received or the RxTimeout registers say nothing is coming
+ * Returns the type of frame received, or RADIO_RX_NOTHING
+ */
+uint8_t _Radio_Rx_Window( uint32_t opens_at ) {
+	int32_t wait = (int32_t) ( opens_at - osKernelGetTickCount() );
+	if ( wait > 0 ) {
+		osDelay( wait );
+	}
+
+	_Radio_Set_Mode_Rx();
+	radio_rx_window_stats.windows++;
+
+	// In case the timeouts never fire, give up after as long as they could take
+	uint32_t start = osKernelGetTickCount();
+	uint32_t limit = RADIO_RX_WINDOW + Radio_Get_Airtime( RADIO_DOWNLINK_MAX_MESSAGE_LEN ) / 1000 + RADIO_TX_TIMEOUT_MARGIN;
+	uint8_t received = RADIO_RX_NOTHING;
+
+	while ( osKernelGetTickCount() - start < limit ) {
+		if ( RADIO_SUCCESS == Radio_Receive() ) {
+			if ( _Radio_Frame_Is_For_Us() ) {
+				received = radio_buffer[3] & RADIO_CONTROL_TYPE;
+				break;
+			}
+
+			// Someone else's (we are relaying), keep listening
+			_Radio_Set_Mode_Rx();
+		} else if ( RADIO_MODE_RX != radio_mode ) {
+			// A frame started but was lost (bad CRC or timed out), leaving the radio in
+			// standby where RxTimeout can't fire - whatever it was, the window is spent
+			radio_rx_window_stats.rx_errors++;
+			break;
+		}
+
+		if ( _Radio_SPI_Read( RADIO_REG_27_IRQFLAGS1 ) & RADIO_IRQFLAGS1_TIMEOUT ) {
+			radio_rx_window_stats.timeouts++;
+			break;
+		}
+
+		osDelay( 1 );
+	}
+
+	_Radio_Set_Mode_Sleep();
+	return received;
+}
+
+/**
+ * Class A style: two short receive windows at fixed offsets after each uplink
+ * Returns RADIO_SUCCESS if a link report came back
+ */
+uint8_t _Radio_Listen_After_Uplink( uint32_t sent_at ) {
+	uint8_t received = _Radio_Rx_Window( sent_at + RADIO_RX1_DELAY );
+	if ( RADIO_RX_NOTHING != received ) {
+		radio_rx_window_stats.rx1_frames++;
+	}
+
+	if ( RADIO_FRAME_LINK_REPORT != received ) {
+		received = _Radio_Rx_Window( sent_at + RADIO_RX2_DELAY );
+		if ( RADIO_RX_NOTHING != received ) {
+			radio_rx_window_stats.rx2_frames++;
+		}
+	}
+
+	if ( RADIO_FRAME_LINK_REPORT != received ) {
+		_Radio_Handle_Missed_Link_Report();
+	}
+
+	// The frame we just sent announced a rate change, so the
+	// receiver follows us to the new rate from the next frame on
+	if ( radio_announced_profile != radio_profile ) {
+		_Radio_Apply_Profile( radio_announced_profile );
+	}
+
+	return RADIO_FRAME_LINK_REPORT == received ? RADIO_SUCCESS : RADIO_FAILURE;
+}
+
+/**
+ * Seeds the backoff generator from the device's unique ID, so co-located nodes draw different sequences
+ * (The hardware RNG needs the 48 MHz PLL clock, which this board leaves off)
+ */
+void _Radio_Seed_Random() {
+	radio_random_state = HAL_GetUIDw0() ^ HAL_GetUIDw1() ^ HAL_GetUIDw2() ^ HAL_GetTick();
+	if ( 0 == radio_random_state ) {
+		radio_random_state = 1;
+	}
+}
+
+/**
+ * xorshift32, seeded by _Radio_Seed_Random and stirred with RSSI noise
+ */
+uint32_t _Radio_Random() {
+	radio_random_state ^= radio_random_state << 13;
+	radio_random_state ^= radio_random_state >> 17;
+	radio_random_state ^= radio_random_state << 5;
+	return radio_random_state;
+}
+
+/**
+ * RSSI in dBm, the radio must be in RX
+ */
+int8_t _Radio_Read_RSSI() {
+	_Radio_SPI_Write( RADIO_REG_23_RSSICONFIG, RADIO_RSSICONFIG_RSSISTART );
+
+	uint8_t timeout_counter = 0;
+	while ( ! ( _Radio_SPI_Read( RADIO_REG_23_RSSICONFIG ) & RADIO_RSSICONFIG_RSSIDONE ) ) {
+		if ( ++timeout_counter >= RADIO_MAX_MODE_TIMEOUT ) {
+			break;
+		}
+	}
+
+	uint8_t raw_rssi = _Radio_SPI_Read( RADIO_REG_24_RSSI );
+
+	// Stir the low bit of every sample into the random state, which xorshift can't leave once it is 0
+	radio_random_state ^= raw_rssi & 0x01;
+	if ( 0 == radio_random_state ) {
+		radio_random_state = 1;
+	}
+
+	return - (int8_t) ( raw_rssi >> 1 );
+}
+
+/**
+ * Samples the channel and returns RADIO_SUCCESS if it is clear
+ */
+uint8_t _Radio_Channel_Is_Clear() {
+	uint8_t clear = RADIO_SUCCESS;
+
+	_Radio_Set_Mode_Rx();
+
+	for ( uint8_t i = 0; i < RADIO_LBT_SAMPLES; i++ ) {
+		int8_t rssi = _Radio_Read_RSSI();
+		if ( rssi > RADIO_LBT_THRESHOLD ) {
+			if ( 0 == radio_channel_stats.busy || rssi > radio_channel_stats.loudest_busy_rssi ) {
+				radio_channel_stats.loudest_busy_rssi = rssi;
+			}
+			clear = RADIO_FAILURE;
+			break;
+		}
+		osDelay( 1 );
+	}
+
+	_Radio_Set_Mode_Idle();
+
+	radio_channel_stats.assessments++;
+	if ( RADIO_FAILURE == clear ) {
+		radio_channel_stats.busy++;
+	}
+
+	return clear;
+}
+
+/**
+ * Listen before talk, backing off a random number of slots from a
+ * window that doubles each time the channel is busy
+ * Gives up rather than back off for longer than max_backoff ms in all
+ */
+uint8_t _Radio_Acquire_Channel( uint32_t max_backoff ) {
+	uint32_t start = osKernelGetTickCount();
+
+	for ( uint8_t attempt = 0; attempt < RADIO_LBT_MAX_ATTEMPTS; attempt++ ) {
+		if ( RADIO_SUCCESS == _Radio_Channel_Is_Clear() ) {
+			return RADIO_SUCCESS;
+		}
+
+		uint8_t exponent = attempt < RADIO_BACKOFF_MAX_EXPONENT ? attempt + 1 : RADIO_BACKOFF_MAX_EXPONENT;
+		uint32_t slots = 1 + _Radio_Random() % ( 1UL << exponent );
+		uint32_t jitter = _Radio_Random() % RADIO_BACKOFF_SLOT;
+		uint32_t backoff = slots * RADIO_BACKOFF_SLOT + jitter;
+		if ( osKernelGetTickCount() - start + backoff > max_backoff ) {
+			break;
+		}
+
+		radio_channel_stats.backoffs++;
+		radio_channel_stats.backoff_time += backoff;
+		osDelay( backoff );
+	}
+
+	radio_channel_stats.channel_access_failures++;
+	return RADIO_FAILURE;
+}
+
+/**
+ * Moves the airtime window along to now, forgetting buckets that have aged out
+ */
+void _Radio_Advance_Airtime_Window() {
+	uint32_t now = osKernelGetTickCount();
+
+	if ( 0 == radio_airtime_bucket_start ) {
+		radio_airtime_bucket_start = now;
+	}
+
+	uint8_t steps = 0;
+	while ( now - radio_airtime_bucket_start >= RADIO_DUTY_CYCLE_BUCKET_LENGTH && steps < RADIO_DUTY_CYCLE_BUCKETS ) {
+		radio_airtime_bucket = ( radio_airtime_bucket + 1 ) % RADIO_DUTY_CYCLE_BUCKETS;
+		radio_airtime_buckets[radio_airtime_bucket] = 0;
+		radio_airtime_bucket_start += RADIO_DUTY_CYCLE_BUCKET_LENGTH;
+		steps++;
+	}
+
+	// Been away longer than the whole window
+	if ( now - radio_airtime_bucket_start >= RADIO_DUTY_CYCLE_BUCKET_LENGTH ) {
+		radio_airtime_bucket_start = now;
+	}
+}
+
+uint32_t _Radio_Airtime_In_Window() {
+	uint32_t total = 0;
+	for ( uint8_t i = 0; i < RADIO_DUTY_CYCLE_BUCKETS; i++ ) {
+		total += radio_airtime_buckets[i];
+	}
+	return total;
+}
+
+/**
+ * Returns RADIO_SUCCESS if sending airtime us now stays within the duty cycle limit
+ */
+uint8_t _Radio_Duty_Cycle_Allows( uint32_t airtime ) {
+	_Radio_Advance_Airtime_Window();
+	return ( (uint64_t) _Radio_Airtime_In_Window() + airtime <= RADIO_DUTY_CYCLE_BUDGET ) ? RADIO_SUCCESS : RADIO_FAILURE;
+}
+
+void _Radio_Record_Airtime( uint32_t airtime ) {
+	_Radio_Advance_Airtime_Window();
+	radio_airtime_buckets[radio_airtime_bucket] += airtime;
+	radio_channel_stats.airtime += airtime;
+}
+
+uint8_t _Radio_FEC_Is_Active() {
+	if ( RADIO_FEC_AUTO == radio_fec_mode ) {
+		return RADIO_PROFILE_4K8 == radio_profile;
+	}
+	return RADIO_FEC_ON == radio_fec_mode;
+}
+
+/**
+ * FEC encodes everything after the header of the frame in radio_buffer, in place
+ * A frame too long to encode goes as it is
+ */
+void _Radio_Apply_FEC() {
+	if ( ! _Radio_FEC_Is_Active() || radio_buffer[0] < RADIO_HEADER_LENGTH - 1 ) {
+		return;
+	}
+
+	uint8_t length = radio_buffer[0] - ( RADIO_HEADER_LENGTH - 1 );
+	uint16_t encoded_length = 0;
+
+	uint32_t start = Cycles_Now();
+	uint8_t result = FEC_Encode( &(radio_buffer[RADIO_HEADER_LENGTH]), length, &(radio_buffer[RADIO_HEADER_LENGTH]),
+		RADIO_MAX_MESSAGE_LEN - RADIO_HEADER_LENGTH, &encoded_length );
+	uint32_t cycles = Cycles_Now() - start;
+
+	if ( FEC_SUCCESS != result ) {
+		return;
+	}
+
+	radio_buffer[0] = ( RADIO_HEADER_LENGTH - 1 ) + encoded_length;
+	radio_buffer[3] |= RADIO_CONTROL_FEC;
+
+	radio_fec_stats.frames++;
+	radio_fec_stats.bytes += encoded_length;
+	radio_fec_stats.cycles += cycles;
+}
+
+/**
+ * Time for a relay to stop listening and send what it has queued?
+ */
+uint8_t _Radio_Relay_Has_Turn() {
+	if ( 0 == osMessageQueueGetCount( radio_hqueue ) ) {
+		return 0;
+	}
+
+	if ( ! TDMA_Is_Synchronized() ) {
+		return 1;
+	}
+
+	return TDMA_Time_Left_In_Slot( RADIO_SLOT ) > 0 || TDMA_Time_Until_Slot( RADIO_SLOT ) <= RADIO_WAKE_AHEAD;
+}
+
+/**
+ * Takes the next frame off the queue, noting how deep the queue got
+ */
+osStatus_t _Radio_Get_Frame( uint32_t timeout ) {
+	osStatus_t status = osMessageQueueGet( radio_hqueue, (void *) &radio_buffer, NULL, timeout );
+	if ( osOK == status ) {
+		uint8_t depth = (uint8_t) osMessageQueueGetCount( radio_hqueue ) + 1;
+		if ( depth > radio_queue_high_water ) {
+			radio_queue_high_water = depth;
+		}
+	}
+	return status;
+}
+
+/**
+ * Blocks until there is a frame in the queue, then points radio_buffer at it
+ * A relay listens for other stations in the meantime, at the slowest profile
+ * since that is where a station that can't reach the gateway will have fallen
+ * back to. It leaves queued frames where they are until its slot comes round,
+ * as it is receiving into radio_buffer until then
+ */
+osStatus_t _Radio_Wait_For_Frame() {
+	if ( radio_relay_dirty ) {
+		_Radio_Load_Address_Filter();
+	}
+
+	if ( ! radio_relay_enabled ) {
+		return _Radio_Get_Frame( osWaitForever );
+	}
+
+	_Radio_Set_Mode_Idle();
+	_Radio_Write_Profile( RADIO_PROFILE_DEFAULT, 0 );
+	_Radio_Set_Mode_Rx();
+
+	while ( radio_relay_enabled && ! _Radio_Relay_Has_Turn() ) {
+		osDelay( RADIO_RELAY_POLL );
+		Radio_Receive();
+		if ( RADIO_MODE_RX != radio_mode ) {
+			_Radio_Set_Mode_Rx();
+		}
+	}
+
+	_Radio_Set_Mode_Idle();
+	_Radio_Write_Profile( radio_profile, 1 );
+
+	return _Radio_Get_Frame( 0U );
+}
+
+/**
+ * Gives the frame that was just sent (or dropped) back to the pool
+ */
+void _Radio_Release_Frame() {
+	if ( radio_buffer != radio_rx_buffer ) {
+		Radio_Free_Frame( radio_buffer );
+		radio_buffer = radio_rx_buffer;
+	}
+}
+
+void _Radio_Handle_Transmit_Queue() {
+	if ( ! radio_hqueue ) {
+		return;
+	}
+
+	// A frame held back by a busy channel or the duty cycle goes before anything new
+	// Otherwise sleep (or relay) until the core hands us one
+	if ( radio_has_pending_frame ) {
+		osDelay( RADIO_RETRY_DELAY );
+	} else {
+		osStatus_t status = _Radio_Wait_For_Frame();
+		if ( osOK != status ) {
+			return;
+		}
+		radio_has_pending_frame = 1;
+
+		if ( RADIO_FRAME_RELAYED == ( radio_buffer[3] & RADIO_CONTROL_TYPE ) ) {
+			_Radio_Relay_Dequeued();
+		}
+
+		if ( radio_aes_dirty ) {
+			_Radio_Load_Key();
+		}
+
+		_Radio_Update_Frequency();
+
+		_Radio_Apply_FEC();
+
+		// The AES engine only works on a frame that fits in the FIFO
+		if ( radio_aes_enabled && radio_buffer[0] + 1 > RADIO_AES_MAX_MESSAGE_LEN ) {
+			radio_aes_oversize_frames++;
+			radio_peers[_Radio_Peer( radio_buffer[1] )].failed++;
+			radio_has_pending_frame = 0;
+			_Radio_Release_Frame();
+			return;
+		}
+	}
+
+	// radio_buffer[0] contains the number of bytes following the length byte
+	uint32_t airtime = Radio_Get_Airtime( radio_buffer[0] + 1 );
+	if ( RADIO_SUCCESS != _Radio_Duty_Cycle_Allows( airtime ) ) {
+		radio_channel_stats.duty_cycle_deferrals++;
+		_Radio_Record_Retry();
+		return;
+	}
+
+	// Once we have GPS time, wait for our own slot and don't let backing off
+	// push the frame or its link report window past the end of it. If there is
+	// still room in the slot we are in (after our frame, say), a relayed frame goes now
+	uint8_t is_scheduled = TDMA_Is_Synchronized();
+	uint32_t max_backoff = UINT32_MAX;
+	if ( is_scheduled ) {
+		uint32_t needed = airtime / 1000 + RADIO_TX_TIMEOUT_MARGIN + _Radio_Rx_Windows_Time();
+		uint32_t left = TDMA_Time_Left_In_Slot( RADIO_SLOT );
+		if ( left < needed ) {
+			uint32_t wait = TDMA_Time_Until_Slot( RADIO_SLOT );
+			if ( wait > RADIO_WAKE_AHEAD ) {
+				osDelay( wait - RADIO_WAKE_AHEAD );
+			}
+			_Radio_Set_Mode_Idle();
+			osDelay( TDMA_Time_Until_Slot( RADIO_SLOT ) );
+			left = TDMA_Time_Left_In_Slot( RADIO_SLOT );
+		}
+		_Radio_Set_Mode_Idle();
+
+		if ( left < needed ) {
+			TDMA_Record_Slot( 0 );
+			_Radio_Record_Retry();
+			return;
+		}
+		max_backoff = left - needed;
+	} else {
+		_Radio_Set_Mode_Idle();
+	}
+
+	if ( RADIO_SUCCESS != _Radio_Acquire_Channel( max_backoff ) ) {
+		if ( is_scheduled ) {
+			TDMA_Record_Slot( 0 );
+		}
+		_Radio_Record_Retry();
+		return;
+	}
+
+	if ( is_scheduled ) {
+		TDMA_Record_Slot( 1 );
+	}
+
+	radio_has_pending_frame = 0;
+
+	// Tell the receiver which profile to expect from the next frame on
+	radio_announced_profile = radio_pending_profile;
+	radio_buffer[3] &= ~RADIO_CONTROL_PROFILE;
+	radio_buffer[3] |= ( radio_announced_profile << RADIO_CONTROL_PROFILE_SHIFT ) & RADIO_CONTROL_PROFILE;
+
+	uint32_t tx_done = 0;
+	uint8_t result = _Radio_Stream_Tx( airtime, &tx_done );
+	uint32_t sent_at = osKernelGetTickCount();
+
+	_Radio_Set_Mode_Sleep();
+
+	_Radio_Record_Airtime( airtime );
+	_Radio_Record_Sent( airtime, result, tx_done );
+	uint8_t peer = _Radio_Peer( radio_buffer[1] );
+
+	if ( RADIO_FRAME_RELAYED == ( radio_buffer[3] & RADIO_CONTROL_TYPE ) ) {
+		_Radio_Relay_Forwarded( sent_at );
+	}
+
+	// The windows receive into radio_rx_buffer
+	_Radio_Release_Frame();
+
+	if ( RADIO_SUCCESS == _Radio_Listen_After_Uplink( sent_at ) ) {
+		radio_peers[peer].acked++;
+	} else if ( RADIO_SUCCESS == result ) {
+		radio_peers[peer].failed++;
+	}
+}
+
+/**
+ * Takes the pin high, briefly, to reset the radio
+ */
+void _Radio_Reset() {
+	if ( ! radio_reset_gpio ) {
+		return;
+	}
+
+	HAL_GPIO_WritePin( radio_reset_gpio, radio_reset_pin, GPIO_PIN_SET );
+	HAL_Delay( 15 );
+	HAL_GPIO_WritePin( radio_reset_gpio, radio_reset_pin, GPIO_PIN_RESET );
+	HAL_Delay( 15 );
+}
+
+uint8_t Radio_Init() {
+	// Reset the radio
+	_Radio_Reset();
+
+	// Read the radio chip ID. Should be 0x24
+	uint8_t device_type = _Radio_SPI_Read( RADIO_REG_10_VERSION );
+
+	if ( device_type != 0x24 ) {
+		return RADIO_FAILURE;
+	}
+
+	// Before the first channel scan stirs in RSSI noise
+	_Radio_Seed_Random();
+
+	radio_mode_since = osKernelGetTickCount();
+	_Radio_Set_Mode_Idle();
+
+	_Radio_Load_Config();
+	_Radio_Load_Key();
+	_Radio_Set_Tx_Power( radio_tx_power ); // Starts at +13 dBm, then follows the link margin
+
+	// The registers keep their values in sleep
+	_Radio_Set_Mode_Sleep();
+
+	return RADIO_SUCCESS;
+}
+
+void Radio_Set_SPI( SPI_HandleTypeDef *hspi ) {
+	radio_hspi = hspi;
+}
+
+void Radio_Set_Reset_Pin( GPIO_TypeDef* gpio, uint16_t pin ) {
+	radio_reset_gpio = gpio;
+	radio_reset_pin = pin;
+}
+
+void Radio_Set_NCS_Pin( GPIO_TypeDef* gpio, uint16_t pin ) {
+	radio_ncs_gpio = gpio;
+	radio_ncs_pin = pin;
+}
+
+void Radio_Set_Message_Queue( osMessageQueueId_t hqueue ) {
+	radio_hqueue = hqueue;
+}
+
+/**
+ * A block to build a frame in, for queueing to the radio by pointer
+ * Returns 0 if they are all in use
+ * The radio frees it once sent - free it yourself if it never makes it into the queue
+ */
+uint8_t *Radio_Alloc_Frame() {
+	return Pool_Alloc( &radio_frame_pool );
+}
+
+void Radio_Free_Frame( uint8_t *frame ) {
+	Pool_Free( &radio_frame_pool, frame );
+}
+
+int8_t Radio_Get_Tx_Power() {
+	return radio_tx_power;
+}
+
+int8_t Radio_Get_Link_Margin() {
+	return radio_link_margin;
+}
+
+/**
+ * The sequence number of the last observation frame the receiver acknowledged
+ * Returns RADIO_SUCCESS once for each new acknowledgement
+ */
+uint8_t Radio_Get_Acknowledged_Sequence( uint8_t *sequence ) {
+	if ( ! radio_has_acknowledgement ) {
+		return RADIO_FAILURE;
+	}
+
+	*sequence = radio_acknowledged_sequence;
+	radio_has_acknowledgement = 0;
+	return RADIO_SUCCESS;
+}
+
+/**
+ * The gateway's latest bitmap of the backfill frames it has received (see backfill.h)
+ * Returns RADIO_SUCCESS once for each new one
+ */
+uint8_t Radio_Get_Backfill_Ack( uint8_t *base, uint16_t *bitmap ) {
+	if ( ! radio_has_backfill_ack ) {
+		return RADIO_FAILURE;
+	}
+
+	*base = radio_backfill_base;
+	*bitmap = radio_backfill_bitmap;
+	radio_has_backfill_ack = 0;
+	return RADIO_SUCCESS;
+}
+
+/**
+ * Channel access and duty cycle counters
+ * Like Radio_Get_Duty_Cycle_Of_Limit, it leaves the window for the radio task to move along
+ */
+void Radio_Get_Channel_Stats( radio_channel_stats_type *stats ) {
+	*stats = radio_channel_stats;
+	stats->airtime_in_window = _Radio_Airtime_In_Window();
+	stats->duty_cycle = (uint16_t) ( (uint64_t) stats->airtime_in_window * RADIO_DUTY_CYCLE_LIMIT / RADIO_DUTY_CYCLE_BUDGET );
+}
+
+/**
+ * Airtime used in the last hour, per mille of what the duty cycle limit allows
+ * Safe from other tasks - it doesn't move the window along, so it can read high until the radio does
+ */
+uint16_t Radio_Get_Duty_Cycle_Of_Limit() {
+	return (uint16_t) ( (uint64_t) _Radio_Airtime_In_Window() * 1000 / RADIO_DUTY_CYCLE_BUDGET );
+}
+
+/**
+ * Switches modem profile (RADIO_PROFILE_*) before the next transmission
+ */
+uint8_t Radio_Set_Profile( uint8_t profile ) {
+	if ( profile >= RADIO_PROFILE_COUNT ) {
+		return RADIO_FAILURE;
+	}
+
+	radio_pending_profile = profile;
+	return RADIO_SUCCESS;
+}
+
+/**
+ * The profile that the next frame will be sent with
+ */
+uint8_t Radio_Get_Profile() {
+	return radio_profile;
+}
+
+/**
+ * Time on air in us at the current profile for a frame of length bytes
+ * (including the length byte), with preamble, sync word and CRC
+ */
+uint32_t Radio_Get_Airtime( uint16_t length ) {
+	return _Radio_Airtime_At( radio_profile, length );
+}
+
+/**
+ * The longest frame (including the length byte) that fits in a TDMA slot,
+ * with its link report window, at the current profile
+ */
+uint16_t Radio_Get_Max_Frame_Length() {
+	return Radio_Get_Max_Frame_Length_In( TDMA_SLOT_LENGTH - TDMA_GUARD_TIME );
+}
+
+/**
+ * ms a frame of length bytes (including the length byte) takes out of the slot,
+ * from starting to send it until its link report window has closed
+ */
+uint32_t Radio_Get_Frame_Time( uint16_t length ) {
+	return Radio_Get_Airtime( length ) / 1000 + RADIO_TX_TIMEOUT_MARGIN + _Radio_Rx_Windows_Time();
+}
+
+/**
+ * As Radio_Get_Max_Frame_Length, for the frame that has to fit in what is left of the slot
+ */
+uint16_t Radio_Get_Max_Frame_Length_In( uint32_t time ) {
+	uint32_t windows = _Radio_Rx_Windows_Time();
+	uint32_t budget = time > RADIO_TX_TIMEOUT_MARGIN ? time - RADIO_TX_TIMEOUT_MARGIN : 0; // ms
+	budget = budget > windows ? budget - windows : 0;
+	uint32_t bytes = (uint32_t) ( (uint64_t) budget * radio_profiles[radio_profile].bitrate / 8000 );
+	uint32_t overhead = RADIO_CONFIG_PREAMBLE_LENGTH + RADIO_SYNC_LENGTH + RADIO_CRC_LENGTH;
+
+	if ( bytes <= overhead + RADIO_HEADER_LENGTH ) {
+		return RADIO_HEADER_LENGTH;
+	}
+
+	bytes -= overhead;
+	if ( bytes > RADIO_MAX_MESSAGE_LEN ) {
+		bytes = RADIO_MAX_MESSAGE_LEN;
+	}
+	if ( radio_aes_enabled && bytes > RADIO_AES_MAX_MESSAGE_LEN ) {
+		bytes = RADIO_AES_MAX_MESSAGE_LEN;
+	}
+
+	// FEC doubles what follows the header
+	if ( _Radio_FEC_Is_Active() ) {
+		bytes = RADIO_HEADER_LENGTH + FEC_MAX_DATA_LENGTH( bytes - RADIO_HEADER_LENGTH );
+	}
+
+	return (uint16_t) bytes;
+}
+
+/**
+ * Sets the 16 byte AES key, which the radio task loads before its next frame
+ */
+void Radio_Set_Encryption_Key( const uint8_t *key, uint8_t key_id ) {
+	// The radio task mustn't load the key half copied
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	for ( uint8_t i = 0; i < RADIO_AES_KEY_LENGTH; i++ ) {
+		radio_aes_key[i] = key[i];
+	}
+	radio_aes_key_id = key_id;
+	radio_aes_dirty = 1;
+
+	__set_PRIMASK( primask );
+}
+
+void Radio_Set_Encryption( uint8_t enable ) {
+	radio_aes_enabled = enable ? 1 : 0;
+	radio_aes_dirty = 1;
+}
+
+uint8_t Radio_Get_Encryption_Key_Id() {
+	return radio_aes_key_id;
+}
+
+void Radio_Get_Encryption_Stats( radio_encryption_stats_type *stats ) {
+	stats->enabled = radio_aes_enabled;
+	stats->key_id = radio_aes_key_id;
+	stats->rotations = radio_aes_rotations;
+	stats->oversize_frames = radio_aes_oversize_frames;
+	stats->long_frames = radio_aes_long_frames;
+}
+
+/**
+ * Temperature in 0.1 deg C from the BME280, for the crystal drift model
+ */
+void Radio_Set_Temperature( int16_t temperature ) {
+	radio_temperature = temperature;
+	radio_has_temperature = 1;
+}
+
+void Radio_Get_Frequency_Stats( radio_frequency_stats_type *stats ) {
+	*stats = radio_frequency_stats;
+	stats->correction = radio_frequency_correction;
+	stats->tracked = radio_frequency_tracked;
+}
+
+void Radio_Get_Rx_Window_Stats( radio_rx_window_stats_type *stats ) {
+	*stats = radio_rx_window_stats;
+}
+
+/**
+ * Turns relay mode on or off from the radio task's next frame
+ */
+void Radio_Set_Relay( uint8_t enable ) {
+	radio_relay_enabled = enable ? 1 : 0;
+	radio_relay_dirty = 1;
+}
+
+/**
+ * Copies out entry index of the link statistics table
+ * Returns RADIO_FAILURE past the last entry in use
+ */
+uint8_t Radio_Get_Peer_Stats( uint8_t index, radio_peer_stats_type *stats ) {
+	if ( index >= radio_peer_count ) {
+		return RADIO_FAILURE;
+	}
+
+	*stats = radio_peers[index];
+	return RADIO_SUCCESS;
+}
+
+void Radio_Get_Relay_Stats( radio_relay_stats_type *stats ) {
+	*stats = radio_relay_stats;
+	stats->enabled = radio_relay_enabled;
+	stats->queue_depth = radio_hqueue ? (uint8_t) osMessageQueueGetCount( radio_hqueue ) : 0;
+}
+
+/**
+ * Most frames there have been in the transmit queue at once, as seen when taking one off
+ */
+uint8_t Radio_Get_Queue_High_Water() {
+	return radio_queue_high_water;
+}
+
+void Radio_Set_FEC( uint8_t mode ) {
+	radio_fec_mode = mode;
+}
+
+/**
+ * cycles / bytes is the cost per encoded byte
+ */
+void Radio_Get_FEC_Stats( radio_fec_stats_type *stats ) {
+	*stats = radio_fec_stats;
+}
+
+const char *Radio_Get_Profile_Name( uint8_t profile ) {
+	if ( profile >= RADIO_PROFILE_COUNT ) {
+		return "";
+	}
+
+	return radio_profiles[profile].name;
+}
+
+/**
+ * Time spent in each state, for working out what the radio costs in energy
+ */
+void Radio_Get_Power_Stats( radio_power_stats_type *stats ) {
+	uint32_t current = osKernelGetTickCount() - radio_mode_since;
+
+	stats->sleep = radio_mode_time[RADIO_MODE_SLEEP] + ( RADIO_MODE_SLEEP == radio_mode ? current : 0 );
+	stats->standby = radio_mode_time[RADIO_MODE_IDLE] + ( RADIO_MODE_IDLE == radio_mode ? current : 0 );
+	stats->rx = radio_mode_time[RADIO_MODE_RX] + ( RADIO_MODE_RX == radio_mode ? current : 0 );
+	stats->tx = radio_mode_time[RADIO_MODE_TX] + ( RADIO_MODE_TX == radio_mode ? current : 0 );
+	stats->wakeups = radio_wakeups;
+	stats->warm_up_time = radio_warm_up_time;
+}
+
+void Radio_Run() {
+	// If we haven't spoken to the radio yet, try again
+	if ( RADIO_MODE_UNKNOWN == radio_mode ) {
+		HAL_GPIO_WritePin( GPIOB, GPIO_PIN_14, GPIO_PIN_RESET ); // Red PB14 LD3
+		if ( RADIO_SUCCESS != Radio_Init() ) {
+			osDelay( 500 );
+			return;
+		}
+	}
+
+	// Blocks until there is a frame to send
+	_Radio_Handle_Transmit_Queue();
+
+	_Radio_Set_Mode_Sleep();
 }
@@ -10,11 +10,213 @@
 #include "stm32f4xx_hal.h"
 #include "cmsis_os.h"
 
+#define RADIO_SUCCESS 1
+#define RADIO_FAILURE 0
+
+// The length byte allows up to 255 more, streamed through the 66 byte FIFO
+#define RADIO_MAX_MESSAGE_LEN 256
+
+// Frame Header: length, destination address, source address, control (frame type)
+// The length byte counts the bytes that follow it
+#define RADIO_HEADER_LENGTH 4
+
+// Addresses
+// The receiver is the gateway, stations are numbered from 1 and each one
+// owns the TDMA slot of its address (see tdma.h). Build each station with
+// its own -DRADIO_NODE_ADDRESS=n
+#define RADIO_GATEWAY_ADDRESS 0x00
+#define RADIO_BROADCAST_ADDRESS 0xFF
+#ifndef RADIO_NODE_ADDRESS
+#define RADIO_NODE_ADDRESS 0x01
+#endif
+
+// Relay Mode
+// A station built with -DRADIO_RELAY=1 (or switched with Radio_Set_Relay) listens
+// between its own frames and forwards other stations' frames to the gateway in
+// its own slot. It keeps its receiver on, so it wants a power supply, not a battery
+#ifndef RADIO_RELAY
+#define RADIO_RELAY 0
+#endif
+#define RADIO_RELAY_MAX_HOPS 2
+
+// Control Byte
+// The low nibble is the frame type. The radio fills in the upper bits
+// with the modem profile the receiver should expect from the next frame on,
+// and whether everything after the header is FEC encoded (see fec.h)
+#define RADIO_CONTROL_TYPE 0x0F
+#define RADIO_CONTROL_PROFILE 0x70
+#define RADIO_CONTROL_PROFILE_SHIFT 4
+#define RADIO_CONTROL_FEC 0x80
+
+// FEC Modes
+// A receiver decoding FEC frames must accept them with CRC errors (CrcAutoClearOff)
+// and check the CRC inside the FEC block instead
+#define RADIO_FEC_OFF 0
+#define RADIO_FEC_ON 1
+#define RADIO_FEC_AUTO 2 // Only once rate adaptation has fallen back to the slowest profile
+
+// Frame Types
+// 0x00 and 0x02 carried raw thp_data_type / gps_data_type structs and are no longer sent
+#define RADIO_FRAME_LINK_REPORT 0x01 // From the receiver: int8_t RSSI (dBm) of our last frame, the sequence
+                                     // number of the last observation frame it decoded and, optionally, an
+                                     // int16_t (big endian) of how many Hz above its frequency our frame was
+                                     // and then the backfill sequence number of the last backfill frame it
+                                     // decoded with a uint16_t (big endian) bitmap of those before it
+                                     // (see backfill.h)
+#define RADIO_FRAME_OBSERVATION_COMPACT 0x03 // Link telemetry then an obs.h payload
+#define RADIO_FRAME_KEY_ROTATION 0x04 // From the receiver, encrypted: key id, 16 byte AES key, Fletcher-16 of both (an integrity check, not authentication)
+                                      // The receiver should keep the old key until it hears us under the new one
+#define RADIO_FRAME_RELAYED 0x05 // From a relay: hop count, original source, original control byte, then the
+                                 // original frame's payload. Sent at the relay's profile, under its FEC
+#define RADIO_RELAY_HEADER_LENGTH 3
+#define RADIO_FRAME_LINK_STATS 0x06 // Our statistics for one peer (see radio_peer_stats_type), big endian:
+                                    // address, RSSI, FEI (2), received, sent, retried, acked, failed (2 each,
+                                    // wrapping), airtime (4), then the TX done histogram (2 each, saturating)
+#define RADIO_FRAME_BACKFILL 0x07 // Logged observations being sent again, with a backfill.h payload
+#define RADIO_FRAME_HEALTH 0x08 // Our runtime health (see health.h), big endian: reset cause, uptime (4, s),
+                                // heap free and least ever free (2 each), transmit queue high water,
+                                // load, interrupt handler and idle shares (2 each, per mille), a pool
+                                // count and each pool's most blocks in use, then a task count and for
+                                // each task its number, least stack free (2, bytes) and CPU share (2,
+                                // per mille)
+
+// Modem Profiles (bit rate / deviation), slowest to fastest
+// Both ends start at RADIO_PROFILE_DEFAULT and fall back to it if they lose each other
+#define RADIO_PROFILE_4K8 0
+#define RADIO_PROFILE_9K6 1
+#define RADIO_PROFILE_19K2 2
+#define RADIO_PROFILE_38K4 3
+#define RADIO_PROFILE_55K5 4
+#define RADIO_PROFILE_100K 5
+#define RADIO_PROFILE_200K 6
+#define RADIO_PROFILE_COUNT 7
+#define RADIO_PROFILE_DEFAULT RADIO_PROFILE_4K8
+
+typedef struct {
+	uint32_t assessments;				// Clear channel assessments made
+	uint32_t busy;						// ... that found the channel busy
+	uint32_t backoffs;
+	uint32_t backoff_time;				// ms spent backing off
+	uint32_t channel_access_failures;	// Gave up for this pass, frame kept for the next one
+	uint32_t duty_cycle_deferrals;		// Held back to stay under the duty cycle limit
+	uint32_t airtime;					// us, total
+	uint32_t airtime_in_window;			// us, in the last hour
+	uint16_t duty_cycle;				// per mille of the last hour (not of the limit, see Radio_Get_Duty_Cycle_Of_Limit)
+	int8_t loudest_busy_rssi;			// dBm
+} radio_channel_stats_type;
+
+typedef struct {
+	uint32_t sleep;			// ms in each state
+	uint32_t standby;
+	uint32_t rx;
+	uint32_t tx;
+	uint32_t wakeups;		// Times out of sleep
+	uint32_t warm_up_time;	// ms spent waiting for the crystal after sleep
+} radio_power_stats_type;
+
+typedef struct {
+	uint32_t frames;	// Frames sent FEC encoded
+	uint32_t bytes;		// Encoded bytes produced
+	uint32_t cycles;	// CPU cycles spent encoding them
+} radio_fec_stats_type;
+
+typedef struct {
+	uint8_t enabled;
+	uint8_t key_id;
+	uint32_t rotations;			// Keys received over the air
+	uint32_t oversize_frames;	// Dropped for being too long to encrypt or decrypt
+	uint32_t long_frames;		// Received longer than the FIFO threshold, read whole after PayloadReady
+} radio_encryption_stats_type;
+
+typedef struct {
+	int32_t correction;		// Hz the carrier is moved down by
+	int32_t residual;		// Hz we were still off by, as last measured
+	uint8_t tracked;		// Using the narrow receive filter
+	uint32_t measurements;
+} radio_frequency_stats_type;
+
+typedef struct {
+	uint32_t windows;		// Receive windows opened
+	uint32_t rx1_frames;	// Frames received in the first window
+	uint32_t rx2_frames;	// ... and the second
+	uint32_t timeouts;		// Windows closed early because nothing turned up
+	uint32_t rx_errors;		// ... or because a frame arrived but couldn't be read
+} radio_rx_window_stats_type;
+
+typedef struct {
+	uint8_t enabled;
+	uint32_t heard;				// Frames for the gateway from other stations
+	uint32_t queued;			// ... passed to the transmit queue
+	uint32_t forwarded;			// ... and sent
+	uint32_t duplicates;		// Already forwarded (by us) recently
+	uint32_t hop_limit_drops;	// Had already come RADIO_RELAY_MAX_HOPS hops
+	uint32_t oversize_drops;	// Too long to wrap and still fit our slot
+	uint32_t queue_full_drops;	// No room left in the transmit queue
+	uint8_t queue_depth;		// Frames in the transmit queue, ours and relayed
+	uint8_t max_queue_depth;	// ... just after queueing a relayed frame
+	uint32_t latency;			// ms from hearing the last forwarded frame to sending it
+	uint32_t max_latency;
+	uint32_t total_latency;		// total_latency / forwarded is the average
+} radio_relay_stats_type;
+
+// Link Statistics
+// Kept for each station we hear from or send to, up to RADIO_PEERS of them
+// (the one heard from least recently makes way for a new one)
+#define RADIO_PEERS 8
+
+// Bucket 0 counts TX done latencies under 1 ms, and bucket n from 2^(n-1)
+// up to 2^n ms. The last bucket takes everything longer
+#define RADIO_TX_DONE_BUCKETS 12
+
+typedef struct {
+	uint8_t address;
+	int8_t rssi;			// dBm, moving average over the frames heard from it
+	int16_t fei;			// Hz, moving average of how far above our frequency they were
+	uint32_t received;		// Frames heard from it
+	uint32_t sent;			// Frames sent to it
+	uint32_t retried;		// Times a frame to it was held back for another try
+	uint32_t acked;			// Frames sent to it that a link report came back for
+	uint32_t failed;		// ... and that none did (or that never got out)
+	uint32_t airtime;		// ms spent sending to it
+	uint32_t last_heard;	// Kernel ticks, last time we heard from or sent to it
+	uint16_t tx_done[RADIO_TX_DONE_BUCKETS];	// ms from starting the transmitter to PacketSent
+} radio_peer_stats_type;
+
 void Radio_Set_SPI( SPI_HandleTypeDef *spi );
 void Radio_Set_Reset_Pin( GPIO_TypeDef* gpio, uint16_t pin );
 void Radio_Set_NCS_Pin( GPIO_TypeDef* gpio, uint16_t pin );
 
 void Radio_Set_Message_Queue( osMessageQueueId_t hqueue );
+uint8_t *Radio_Alloc_Frame();
+void Radio_Free_Frame( uint8_t *frame );
+
+int8_t Radio_Get_Tx_Power();
+int8_t Radio_Get_Link_Margin();
+uint8_t Radio_Set_Profile( uint8_t profile );
+uint8_t Radio_Get_Profile();
+const char *Radio_Get_Profile_Name( uint8_t profile );
+uint32_t Radio_Get_Airtime( uint16_t length );
+uint16_t Radio_Get_Max_Frame_Length();
+uint16_t Radio_Get_Max_Frame_Length_In( uint32_t time );
+uint32_t Radio_Get_Frame_Time( uint16_t length );
+void Radio_Set_Temperature( int16_t temperature );
+void Radio_Get_Frequency_Stats( radio_frequency_stats_type *stats );
+void Radio_Get_Rx_Window_Stats( radio_rx_window_stats_type *stats );
+void Radio_Set_Relay( uint8_t enable );
+uint8_t Radio_Get_Peer_Stats( uint8_t index, radio_peer_stats_type *stats );
+void Radio_Get_Relay_Stats( radio_relay_stats_type *stats );
+uint8_t Radio_Get_Queue_High_Water();
+void Radio_Set_FEC( uint8_t mode );
+void Radio_Get_FEC_Stats( radio_fec_stats_type *stats );
+void Radio_Set_Encryption_Key( const uint8_t *key, uint8_t key_id );
+void Radio_Set_Encryption( uint8_t enable );
+uint8_t Radio_Get_Encryption_Key_Id();
+void Radio_Get_Encryption_Stats( radio_encryption_stats_type *stats );
+uint8_t Radio_Get_Acknowledged_Sequence( uint8_t *sequence );
+uint8_t Radio_Get_Backfill_Ack( uint8_t *base, uint16_t *bitmap );
+void Radio_Get_Channel_Stats( radio_channel_stats_type *stats );
+uint16_t Radio_Get_Duty_Cycle_Of_Limit();
+void Radio_Get_Power_Stats( radio_power_stats_type *stats );
 
 uint8_t Radio_Init();
 void Radio_Run();
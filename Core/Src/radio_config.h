@@ -0,0 +1,130 @@
+/**
+ * radio_config.h
+ * Allen Snook
+ * October 19, 2026
+ *
+ * RFM69HCW configuration in human units
+ * Everything here is reduced to register values by the compiler, with
+ * the legal ranges from the SX1231 datasheet checked at compile time
+ */
+
+#ifndef __RADIO_CONFIG_H
+#define __RADIO_CONFIG_H
+
+#include <stdint.h>
+
+// Crystal frequency, Hz
+#define RADIO_CONFIG_FXOSC 32000000ULL
+
+// Fstep = FXOSC / 2^19 (about 61.035 Hz)
+#define RADIO_CONFIG_FSTEP_SHIFT 19
+
+// Carrier frequency, Hz
+#define RADIO_CONFIG_CARRIER 915000000ULL
+
+// Preamble length, bytes
+#define RADIO_CONFIG_PREAMBLE_LENGTH 44
+
+// Sync words
+// The receiver expects four sync bytes: 0x2D, 0xD4 and then the
+// 0x01, 0x01 reset values of SYNCVALUE3 and SYNCVALUE4
+#define RADIO_CONFIG_SYNC_LENGTH 4
+#define RADIO_CONFIG_SYNC_1 0x2D
+#define RADIO_CONFIG_SYNC_2 0xD4
+#define RADIO_CONFIG_SYNC_3 0x01
+#define RADIO_CONFIG_SYNC_4 0x01
+
+// Crystal offset (Hz) between the two radios that the channel filter must absorb
+#define RADIO_CONFIG_FREQUENCY_TOLERANCE 12500
+
+// What is left of it once the drift model is tracking our crystal (see drift.h)
+#define RADIO_CONFIG_TRACKED_TOLERANCE 2500
+
+// Modem profiles: name, bit rate (bps), deviation (Hz), typical sensitivity (dBm)
+// Slowest to fastest, in the same order as RADIO_PROFILE_* in radio.h
+#define RADIO_CONFIG_PROFILES( X ) \
+	X( "4k8",   4800,   5000,   -105 ) \
+	X( "9k6",   9600,   9600,   -102 ) \
+	X( "19k2",  19200,  19200,  -99 ) \
+	X( "38k4",  38400,  38400,  -96 ) \
+	X( "55k5",  55555,  50000,  -94 ) \
+	X( "100k",  100000, 100000, -91 ) \
+	X( "200k",  200000, 100000, -88 )
+
+// Register Math (rounded to the nearest step)
+
+#define RADIO_CONFIG_ROUND_DIV( n, d ) ( ( (n) + (d) / 2 ) / (d) )
+
+// Carrier: Frf = Fstep * register
+#define RADIO_CONFIG_FRF( hz ) \
+	( (uint32_t) RADIO_CONFIG_ROUND_DIV( (uint64_t) (hz) << RADIO_CONFIG_FSTEP_SHIFT, RADIO_CONFIG_FXOSC ) )
+
+// Bit rate = FXOSC / register
+#define RADIO_CONFIG_BITRATE( bps ) \
+	( (uint16_t) RADIO_CONFIG_ROUND_DIV( RADIO_CONFIG_FXOSC, (uint64_t) (bps) ) )
+
+// Fdev = Fstep * register
+#define RADIO_CONFIG_FDEV( hz ) \
+	( (uint16_t) RADIO_CONFIG_ROUND_DIV( (uint64_t) (hz) << RADIO_CONFIG_FSTEP_SHIFT, RADIO_CONFIG_FXOSC ) )
+
+// Channel filter (single side) = FXOSC / ( mant * 2^(exp + 2) ) in FSK mode
+// RADIO_CONFIG_RXBW picks the narrowest filter at least hz wide
+#define RADIO_CONFIG_RXBW_DCCFREQ 0xE0 // DC cancellation cutoff, 4% of RxBw
+#define RADIO_CONFIG_RXBW_MANT_16 0x00
+#define RADIO_CONFIG_RXBW_MANT_20 0x08
+#define RADIO_CONFIG_RXBW_MANT_24 0x10
+#define RADIO_CONFIG_RXBW_MAX 500000
+
+#define RADIO_CONFIG_RXBW_HZ( mant, exp ) ( RADIO_CONFIG_FXOSC / ( (mant) * ( 1ULL << ( (exp) + 2 ) ) ) )
+#define RADIO_CONFIG_RXBW_TRY( hz, mant, exp, next ) \
+	( RADIO_CONFIG_RXBW_HZ( mant, exp ) >= (uint64_t) (hz) ? ( RADIO_CONFIG_RXBW_MANT_##mant | (exp) ) : (next) )
+
+#define RADIO_CONFIG_RXBW( hz ) ( (uint8_t) ( RADIO_CONFIG_RXBW_DCCFREQ | \
+	RADIO_CONFIG_RXBW_TRY( hz, 24, 7, RADIO_CONFIG_RXBW_TRY( hz, 20, 7, RADIO_CONFIG_RXBW_TRY( hz, 16, 7, \
+	RADIO_CONFIG_RXBW_TRY( hz, 24, 6, RADIO_CONFIG_RXBW_TRY( hz, 20, 6, RADIO_CONFIG_RXBW_TRY( hz, 16, 6, \
+	RADIO_CONFIG_RXBW_TRY( hz, 24, 5, RADIO_CONFIG_RXBW_TRY( hz, 20, 5, RADIO_CONFIG_RXBW_TRY( hz, 16, 5, \
+	RADIO_CONFIG_RXBW_TRY( hz, 24, 4, RADIO_CONFIG_RXBW_TRY( hz, 20, 4, RADIO_CONFIG_RXBW_TRY( hz, 16, 4, \
+	RADIO_CONFIG_RXBW_TRY( hz, 24, 3, RADIO_CONFIG_RXBW_TRY( hz, 20, 3, RADIO_CONFIG_RXBW_TRY( hz, 16, 3, \
+	RADIO_CONFIG_RXBW_TRY( hz, 24, 2, RADIO_CONFIG_RXBW_TRY( hz, 20, 2, RADIO_CONFIG_RXBW_TRY( hz, 16, 2, \
+	RADIO_CONFIG_RXBW_TRY( hz, 24, 1, RADIO_CONFIG_RXBW_TRY( hz, 20, 1, RADIO_CONFIG_RXBW_TRY( hz, 16, 1, \
+	RADIO_CONFIG_RXBW_TRY( hz, 24, 0, RADIO_CONFIG_RXBW_TRY( hz, 20, 0, \
+	( RADIO_CONFIG_RXBW_MANT_16 | 0 ) ) ) ) ) ) ) ) ) ) ) ) ) ) ) ) ) ) ) ) ) ) ) ) ) )
+
+// Carson's rule plus room for the crystal offset between the two radios
+// The AFC sees the signal before correction, so give it twice the room
+#define RADIO_CONFIG_OCCUPIED_BW( bps, fdev ) ( (fdev) + (bps) / 2 )
+#define RADIO_CONFIG_PROFILE_RXBW( bps, fdev ) \
+	RADIO_CONFIG_RXBW( RADIO_CONFIG_OCCUPIED_BW( bps, fdev ) + RADIO_CONFIG_FREQUENCY_TOLERANCE )
+#define RADIO_CONFIG_PROFILE_RXBW_TRACKED( bps, fdev ) \
+	RADIO_CONFIG_RXBW( RADIO_CONFIG_OCCUPIED_BW( bps, fdev ) + RADIO_CONFIG_TRACKED_TOLERANCE )
+#define RADIO_CONFIG_PROFILE_AFCBW( bps, fdev ) \
+	RADIO_CONFIG_RXBW( RADIO_CONFIG_OCCUPIED_BW( bps, fdev ) + 2 * RADIO_CONFIG_FREQUENCY_TOLERANCE )
+
+// Range Checks
+
+// The RFM69HCW-915 covers the 862 to 1020 MHz band
+_Static_assert( RADIO_CONFIG_CARRIER >= 862000000ULL && RADIO_CONFIG_CARRIER <= 1020000000ULL,
+	"Carrier frequency is outside the 862 to 1020 MHz band" );
+_Static_assert( RADIO_CONFIG_FRF( RADIO_CONFIG_CARRIER ) <= 0xFFFFFF, "FRF does not fit in 24 bits" );
+
+_Static_assert( RADIO_CONFIG_PREAMBLE_LENGTH <= 0xFFFF, "Preamble is longer than 65535 bytes" );
+
+// Sync bytes of 0x00 are not allowed and the radio supports 1 to 8 of them
+_Static_assert( RADIO_CONFIG_SYNC_LENGTH >= 1 && RADIO_CONFIG_SYNC_LENGTH <= 8, "Sync word must be 1 to 8 bytes" );
+_Static_assert( RADIO_CONFIG_SYNC_1 != 0x00 && RADIO_CONFIG_SYNC_2 != 0x00 &&
+	RADIO_CONFIG_SYNC_3 != 0x00 && RADIO_CONFIG_SYNC_4 != 0x00, "Sync word bytes must not be 0x00" );
+
+// FSK bit rate of 1.2 to 300 kbps, Fdev of 600 Hz up to the point where
+// Fdev + BR/2 reaches 500 kHz, and a modulation index of 0.5 to 10
+#define RADIO_CONFIG_CHECK_PROFILE( name, bps, fdev, sensitivity ) \
+	_Static_assert( (bps) >= 1200 && (bps) <= 300000, "Profile bit rate is outside 1.2 to 300 kbps" ); \
+	_Static_assert( (fdev) >= 600, "Profile deviation is below 600 Hz" ); \
+	_Static_assert( RADIO_CONFIG_OCCUPIED_BW( bps, fdev ) <= 500000, "Profile Fdev + BR/2 exceeds 500 kHz" ); \
+	_Static_assert( 2ULL * (fdev) * 10 >= 5ULL * (bps) && 2ULL * (fdev) <= 10ULL * (bps), \
+		"Profile modulation index is outside 0.5 to 10" ); \
+	_Static_assert( RADIO_CONFIG_OCCUPIED_BW( bps, fdev ) + 2 * RADIO_CONFIG_FREQUENCY_TOLERANCE <= RADIO_CONFIG_RXBW_MAX, \
+		"Profile needs a wider filter than the radio has" );
+
+RADIO_CONFIG_PROFILES( RADIO_CONFIG_CHECK_PROFILE )
+
+#endif // __RADIO_CONFIG_H
@@ -0,0 +1,314 @@
+/**
+ * sleep.c
+ * Allen Snook
+ * October 19, 2026
+ *
+ * FreeRTOS calls vPortSuppressTicksAndSleep (configUSE_TICKLESS_IDLE 2)
+ * from the idle task. Time asleep is measured on the RTC sub-second
+ * counter, which keeps running in STOP, and stepped onto both ticks.
+ */
+
+#include "sleep.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "trace.h"
+
+// The RTC prescalers (see MX_RTC_Init) - the sub-second counter runs at LSI / 32
+#define SLEEP_RTC_ASYNCH_DIVIDER 32
+#define SLEEP_RTC_SYNCH_DIVIDER 1000
+#define SLEEP_RTC_DAY ( 86400UL * SLEEP_RTC_SYNCH_DIVIDER ) // Sub-second counts in a day
+
+// The wakeup timer runs at LSI / 16
+#define SLEEP_WAKEUP_DIVIDER 16
+
+// Nominal LSI and how long to count it for against the HSI-derived HAL tick
+#define SLEEP_LSI_NOMINAL 32000
+#define SLEEP_LSI_MIN 17000 // Datasheet limits
+#define SLEEP_LSI_MAX 47000
+#define SLEEP_CALIBRATION_TIME 500 // ms
+
+// Most passes to wait on an RTC flag, as the HAL counts them - we sleep with
+// interrupts masked and the HAL tick stopped, so its HAL_GetTick timeouts never expire
+#define SLEEP_RTC_SPINS ( RTC_TIMEOUT_VALUE * ( SystemCoreClock / 32U / 1000U ) )
+
+extern TIM_HandleTypeDef htim7; // The HAL tick (stm32f4xx_hal_timebase_tim.c)
+void SystemClock_Config( void ); // main.c
+
+static RTC_HandleTypeDef *sleep_hrtc = 0;
+static uint32_t sleep_lsi = SLEEP_LSI_NOMINAL;
+static volatile uint8_t sleep_stop_prevented = 0;
+
+// Fraction of a ms left over from each sleep, us, so the HAL tick doesn't drift
+// (SysTick takes care of the RTOS tick's - see the end of vPortSuppressTicksAndSleep)
+static uint32_t sleep_hal_carry = 0;
+
+static sleep_stats_type sleep_stats = { 0 };
+
+/**
+ * The RTC time of day in sub-second counts
+ * Reading SSR locks the shadow time and date until DR is read
+ */
+uint32_t _Sleep_RTC_Counts() {
+	uint32_t ssr = sleep_hrtc->Instance->SSR;
+	uint32_t tr = sleep_hrtc->Instance->TR;
+	(void) sleep_hrtc->Instance->DR;
+
+	uint32_t hours = RTC_Bcd2ToByte( ( tr & ( RTC_TR_HT | RTC_TR_HU ) ) >> RTC_TR_HU_Pos );
+	uint32_t minutes = RTC_Bcd2ToByte( ( tr & ( RTC_TR_MNT | RTC_TR_MNU ) ) >> RTC_TR_MNU_Pos );
+	uint32_t seconds = RTC_Bcd2ToByte( ( tr & ( RTC_TR_ST | RTC_TR_SU ) ) >> RTC_TR_SU_Pos );
+
+	return ( ( hours * 60 + minutes ) * 60 + seconds ) * SLEEP_RTC_SYNCH_DIVIDER +
+		( SLEEP_RTC_SYNCH_DIVIDER - 1 - ssr );
+}
+
+/**
+ * us between two readings of _Sleep_RTC_Counts, at the calibrated LSI
+ */
+uint32_t _Sleep_RTC_Elapsed( uint32_t start, uint32_t end ) {
+	uint32_t counts = ( end + SLEEP_RTC_DAY - start ) % SLEEP_RTC_DAY;
+	return (uint32_t) ( (uint64_t) counts * SLEEP_RTC_ASYNCH_DIVIDER * 1000000 / sleep_lsi );
+}
+
+/**
+ * After STOP the shadow registers hold the time we went to sleep until they resync
+ */
+void _Sleep_RTC_Resync() {
+	__HAL_RTC_WRITEPROTECTION_DISABLE( sleep_hrtc );
+	sleep_hrtc->Instance->ISR &= RTC_RSF_MASK;
+	uint32_t spins = SLEEP_RTC_SPINS;
+	while ( ! ( sleep_hrtc->Instance->ISR & RTC_ISR_RSF ) && --spins );
+	__HAL_RTC_WRITEPROTECTION_ENABLE( sleep_hrtc );
+}
+
+/**
+ * Sets the wakeup timer going for counter + 1 periods of LSI / 16 - by hand,
+ * as HAL_RTCEx_SetWakeUpTimer_IT can wait on the HAL tick and takes the handle's lock
+ * Returns SLEEP_FAILURE if the timer never became writable
+ */
+uint8_t _Sleep_Arm_Wakeup( uint32_t counter ) {
+	RTC_TypeDef *rtc = sleep_hrtc->Instance;
+	__HAL_RTC_WRITEPROTECTION_DISABLE( sleep_hrtc );
+
+	rtc->CR &= ~( RTC_CR_WUTE | RTC_CR_WUTIE );
+	uint32_t spins = SLEEP_RTC_SPINS;
+	while ( ! ( rtc->ISR & RTC_ISR_WUTWF ) && --spins );
+	if ( ! spins ) {
+		__HAL_RTC_WRITEPROTECTION_ENABLE( sleep_hrtc );
+		return SLEEP_FAILURE;
+	}
+
+	rtc->WUTR = counter;
+	rtc->CR = ( rtc->CR & ~RTC_CR_WUCKSEL ) | RTC_WAKEUPCLOCK_RTCCLK_DIV16;
+	__HAL_RTC_WAKEUPTIMER_EXTI_ENABLE_IT();
+	EXTI->RTSR |= RTC_EXTI_LINE_WAKEUPTIMER_EVENT;
+	__HAL_RTC_WAKEUPTIMER_CLEAR_FLAG( sleep_hrtc, RTC_FLAG_WUTF );
+	rtc->CR |= RTC_CR_WUTIE | RTC_CR_WUTE;
+
+	__HAL_RTC_WRITEPROTECTION_ENABLE( sleep_hrtc );
+	return SLEEP_SUCCESS;
+}
+
+void _Sleep_Disarm_Wakeup() {
+	__HAL_RTC_WRITEPROTECTION_DISABLE( sleep_hrtc );
+	sleep_hrtc->Instance->CR &= ~( RTC_CR_WUTE | RTC_CR_WUTIE );
+	__HAL_RTC_WRITEPROTECTION_ENABLE( sleep_hrtc );
+}
+
+/**
+ * STOP always comes back on the HSI with the PLL off, which is how
+ * SystemClock_Config leaves it today - only reconfigure if that changes
+ */
+void _Sleep_Restore_Clocks() {
+	if ( RCC_SYSCLKSOURCE_STATUS_HSI != __HAL_RCC_GET_SYSCLK_SOURCE() ||
+		__HAL_RCC_GET_FLAG( RCC_FLAG_PLLRDY ) ) {
+		SystemClock_Config();
+	}
+}
+
+void _Sleep_Record( uint8_t depth, uint32_t ms ) {
+	sleep_stats.sleeps[depth]++;
+	sleep_stats.time[depth] += ms;
+
+	uint8_t bucket = 0;
+	while ( ms > 0 && bucket < SLEEP_HISTOGRAM_BUCKETS - 1 ) {
+		ms >>= 1;
+		bucket++;
+	}
+	sleep_stats.histogram[bucket]++;
+}
+
+void Sleep_Set_RTC( RTC_HandleTypeDef *hrtc ) {
+	sleep_hrtc = hrtc;
+}
+
+/**
+ * Measures the LSI against the HAL tick (HSI, +/- 1%) - the LSI itself can be
+ * anywhere from 17 to 47 kHz, and we count on it for the time spent asleep
+ * Blocks for SLEEP_CALIBRATION_TIME ms
+ */
+uint8_t Sleep_Calibrate() {
+	if ( ! sleep_hrtc ) {
+		return SLEEP_FAILURE;
+	}
+
+	// Start on a tick edge
+	uint32_t tick = HAL_GetTick();
+	while ( HAL_GetTick() == tick );
+	tick = HAL_GetTick();
+	uint32_t start = _Sleep_RTC_Counts();
+
+	while ( HAL_GetTick() - tick < SLEEP_CALIBRATION_TIME );
+	uint32_t counts = ( _Sleep_RTC_Counts() + SLEEP_RTC_DAY - start ) % SLEEP_RTC_DAY;
+
+	uint32_t lsi = counts * SLEEP_RTC_ASYNCH_DIVIDER * ( 1000 / SLEEP_CALIBRATION_TIME );
+	if ( lsi < SLEEP_LSI_MIN || lsi > SLEEP_LSI_MAX ) {
+		return SLEEP_FAILURE;
+	}
+
+	sleep_lsi = lsi;
+	sleep_stats.lsi = lsi;
+	return SLEEP_SUCCESS;
+}
+
+/**
+ * While anything has STOP prevented (a peripheral that needs its clock, say)
+ * idle only goes as far as SLEEP
+ * Calls nest
+ */
+void Sleep_Prevent_Stop() {
+	__disable_irq();
+	sleep_stop_prevented++;
+	__enable_irq();
+}
+
+void Sleep_Allow_Stop() {
+	__disable_irq();
+	if ( sleep_stop_prevented > 0 ) {
+		sleep_stop_prevented--;
+	}
+	__enable_irq();
+}
+
+void Sleep_Get_Stats( sleep_stats_type *stats ) {
+	*stats = sleep_stats;
+	stats->lsi = sleep_lsi;
+}
+
+/**
+ * Estimated MCU charge since boot, mC, from the time at each depth and the
+ * SLEEP_*_CURRENT figures
+ */
+uint32_t Sleep_Get_Charge() {
+	uint32_t uptime = HAL_GetTick();
+	uint32_t asleep = sleep_stats.time[SLEEP_DEPTH_SLEEP] + sleep_stats.time[SLEEP_DEPTH_STOP];
+	uint32_t run = uptime > asleep ? uptime - asleep : 0;
+
+	// ms * uA = nC
+	uint64_t charge = (uint64_t) run * SLEEP_RUN_CURRENT +
+		(uint64_t) sleep_stats.time[SLEEP_DEPTH_SLEEP] * SLEEP_SLEEP_CURRENT +
+		(uint64_t) sleep_stats.time[SLEEP_DEPTH_STOP] * SLEEP_STOP_CURRENT;
+	return (uint32_t) ( charge / 1000000 );
+}
+
+/**
+ * Called by the idle task with the scheduler suspended, when no task is due
+ * for at least configEXPECTED_IDLE_TIME_BEFORE_SLEEP ticks
+ */
+void vPortSuppressTicksAndSleep( TickType_t expected_idle ) {
+	if ( ! sleep_hrtc ) {
+		return;
+	}
+
+	if ( expected_idle > SLEEP_MAX_TIME ) {
+		expected_idle = SLEEP_MAX_TIME;
+	}
+
+	// Interrupts still end the WFI with PRIMASK set, they just aren't taken until we are done
+	__disable_irq();
+	__DSB();
+	__ISB();
+
+	if ( eAbortSleep == eTaskConfirmSleepModeStatus() ) {
+		sleep_stats.aborted++;
+		__enable_irq();
+		return;
+	}
+
+	// Stop the RTOS tick, noting how far into the current one we are
+	uint32_t cycles_per_tick = SysTick->LOAD + 1;
+	SysTick->CTRL &= ~SysTick_CTRL_ENABLE_Msk;
+	uint32_t into_tick = ( cycles_per_tick - SysTick->VAL ) / ( SystemCoreClock / 1000000 ); // us
+
+	// Wake for the next task (less what we are into this tick), and stop the HAL tick too
+	uint32_t wakeup = (uint32_t) ( (uint64_t) ( expected_idle * 1000 - into_tick ) * sleep_lsi / SLEEP_WAKEUP_DIVIDER / 1000000 );
+	if ( wakeup < 1 ) {
+		wakeup = 1;
+	}
+	if ( wakeup > 0x10000 ) {
+		wakeup = 0x10000; // A fast LSI can't reach SLEEP_MAX_TIME, so just wake and go back to sleep
+	}
+	if ( SLEEP_SUCCESS != _Sleep_Arm_Wakeup( wakeup - 1 ) ) {
+		// Nothing would wake us, so stay up and carry on from where the tick stopped
+		sleep_stats.wakeup_failures++;
+		SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+		__enable_irq();
+		return;
+	}
+	HAL_SuspendTick();
+	__HAL_TIM_DISABLE( &htim7 );
+
+	uint8_t depth = ( expected_idle >= SLEEP_STOP_MIN_TIME && 0 == sleep_stop_prevented ) ?
+		SLEEP_DEPTH_STOP : SLEEP_DEPTH_SLEEP;
+	uint32_t start = _Sleep_RTC_Counts();
+	Trace_Record( TRACE_SLEEP_ENTER, depth, 0 );
+
+	if ( SLEEP_DEPTH_STOP == depth ) {
+		HAL_PWR_EnterSTOPMode( PWR_LOWPOWERREGULATOR_ON, PWR_STOPENTRY_WFI );
+		_Sleep_Restore_Clocks();
+		_Sleep_RTC_Resync();
+	} else {
+		__DSB();
+		__WFI();
+		__ISB();
+	}
+
+	uint32_t slept = _Sleep_RTC_Elapsed( start, _Sleep_RTC_Counts() ); // us
+	uint32_t traced = slept > 0xFFFFFF ? 0xFFFFFF : slept;
+	Trace_Record( TRACE_SLEEP_EXIT, traced >> 16, traced & 0xFFFF );
+
+	if ( ! __HAL_RTC_WAKEUPTIMER_GET_FLAG( sleep_hrtc, RTC_FLAG_WUTF ) ) {
+		sleep_stats.early_wakes++;
+	}
+	_Sleep_Disarm_Wakeup();
+	__HAL_RTC_WAKEUPTIMER_CLEAR_FLAG( sleep_hrtc, RTC_FLAG_WUTF );
+	__HAL_RTC_WAKEUPTIMER_EXTI_CLEAR_FLAG();
+	HAL_NVIC_ClearPendingIRQ( RTC_WKUP_IRQn );
+
+	// Catch the HAL tick up
+	sleep_hal_carry += slept;
+	uwTick += sleep_hal_carry / 1000;
+	sleep_hal_carry %= 1000;
+	__HAL_TIM_CLEAR_FLAG( &htim7, TIM_FLAG_UPDATE );
+	__HAL_TIM_ENABLE( &htim7 );
+	HAL_ResumeTick();
+
+	// Catch the RTOS tick up, leaving the last (partial) tick to SysTick
+	// If we overslept, the time past the next task's deadline is lost
+	uint32_t total = into_tick + slept;
+	uint32_t ticks = total / 1000;
+	uint32_t partial = total % 1000;
+	if ( ticks > expected_idle - 1 ) {
+		ticks = expected_idle - 1;
+		partial = 0;
+	}
+	vTaskStepTick( ticks );
+
+	SysTick->LOAD = ( 1000 - partial ) * ( SystemCoreClock / 1000000 ) - 1;
+	SysTick->VAL = 0;
+	SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+	SysTick->LOAD = cycles_per_tick - 1; // Takes effect at the end of the partial tick
+
+	_Sleep_Record( depth, slept / 1000 );
+
+	__enable_irq();
+}
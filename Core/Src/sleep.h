@@ -0,0 +1,58 @@
+/**
+ * sleep.h
+ * Allen Snook
+ * October 19, 2026
+ *
+ * Tickless idle - when every task is blocked, the idle task stops the
+ * RTOS and HAL ticks and sleeps until the next one is due, woken by the
+ * RTC wakeup timer (or any other interrupt). Long enough idles go down
+ * to STOP mode.
+ */
+
+#ifndef __SLEEP_H
+#define __SLEEP_H
+
+#include "stm32f4xx_hal.h"
+
+#define SLEEP_SUCCESS 1
+#define SLEEP_FAILURE 0
+
+// Sleep depths
+#define SLEEP_DEPTH_SLEEP 0		// WFI - the core clock stops, everything else runs
+#define SLEEP_DEPTH_STOP 1		// All clocks but the LSI stop, the regulator goes to low power
+#define SLEEP_DEPTHS 2
+
+// Idle periods at least this long (ms) go to STOP
+// Coming out costs a few hundred us for the regulator, HSI and RTC shadow registers
+#define SLEEP_STOP_MIN_TIME 5
+
+// Longest single sleep (ms) - the wakeup timer runs at LSI/16 and has 16 bits
+#define SLEEP_MAX_TIME 30000
+
+// Time asleep, log2 ms buckets: < 1, < 2, < 4 ... and the rest in the last one
+#define SLEEP_HISTOGRAM_BUCKETS 16
+
+// Typical STM32F429 supply current (uA) at 16 MHz HSI without the PLL,
+// from the datasheet - for estimating charge, measure your own board to be sure
+#define SLEEP_RUN_CURRENT 6000
+#define SLEEP_SLEEP_CURRENT 2500
+#define SLEEP_STOP_CURRENT 300
+
+typedef struct {
+	uint32_t sleeps[SLEEP_DEPTHS];		// Times entered
+	uint32_t time[SLEEP_DEPTHS];		// ms in each
+	uint32_t early_wakes;				// Woken by something other than the wakeup timer
+	uint32_t aborted;					// A task became ready just as we were going to sleep
+	uint32_t wakeup_failures;			// The wakeup timer couldn't be set, so we didn't sleep
+	uint32_t lsi;						// Hz, as calibrated against the HSI
+	uint32_t histogram[SLEEP_HISTOGRAM_BUCKETS];
+} sleep_stats_type;
+
+void Sleep_Set_RTC( RTC_HandleTypeDef *hrtc );
+uint8_t Sleep_Calibrate();
+void Sleep_Prevent_Stop();
+void Sleep_Allow_Stop();
+void Sleep_Get_Stats( sleep_stats_type *stats );
+uint32_t Sleep_Get_Charge();
+
+#endif // __SLEEP_H
@@ -0,0 +1,141 @@
+/**
+ * tdma.c
+ * Allen Snook
+ * October 19, 2026
+ *
+ * The schedule is anchored to the kernel tick at which the GPS task finished
+ * reading an RMC sentence, rather than to the RTC. The RTC runs from the LSI
+ * (several percent off) and is only set when the core task gets around to
+ * its queue, while the kernel tick runs from the HSI (about 1%) and the GPS
+ * re-anchors it every second or so.
+ *
+ * Every station has the same GPS receiver, so the delay between the top of
+ * the UTC second and the end of the sentence is the same everywhere and
+ * cancels out.
+ */
+
+#include "tdma.h"
+
+_Static_assert( 86400000UL % TDMA_SUPERFRAME_LENGTH == 0, "Superframes must divide a day evenly" );
+_Static_assert( TDMA_SUPERFRAME_LENGTH % TDMA_SLOT_LENGTH == 0, "Slots must divide the superframe evenly" );
+_Static_assert( TDMA_GUARD_TIME < TDMA_SLOT_LENGTH, "Guard time must leave room in the slot" );
+
+// If the GPS goes quiet for longer than this, the HSI may have drifted
+// further than the guard time and the schedule can't be trusted
+#define TDMA_MAX_ANCHOR_AGE 10000 // ms
+
+// How late into its slot a station may still start
+#define TDMA_LATE_START 20 // ms
+
+static uint8_t tdma_is_anchored = 0;
+static uint32_t tdma_anchor_tick = 0;		// Kernel tick ...
+static uint32_t tdma_anchor_offset = 0;		// ... at this many ms into the superframe
+static tdma_stats_type tdma_stats = { 0 };
+
+/**
+ * Called by the GPS task with the UTC time of a sentence and the tick it arrived at
+ */
+void TDMA_Synchronize( uint8_t hour, uint8_t minutes, uint8_t seconds, uint32_t tick ) {
+	uint32_t second_of_day = (uint32_t) hour * 3600 + (uint32_t) minutes * 60 + seconds;
+	uint32_t offset = ( second_of_day * 1000 ) % TDMA_SUPERFRAME_LENGTH;
+
+	osKernelLock();
+
+	if ( tdma_is_anchored ) {
+		// Where the old anchor put this moment, versus where the GPS says it is
+		uint32_t predicted = ( tdma_anchor_offset + ( tick - tdma_anchor_tick ) ) % TDMA_SUPERFRAME_LENGTH;
+		int32_t correction = (int32_t) offset - (int32_t) predicted;
+		if ( correction > TDMA_SUPERFRAME_LENGTH / 2 ) {
+			correction -= TDMA_SUPERFRAME_LENGTH;
+		} else if ( correction < - TDMA_SUPERFRAME_LENGTH / 2 ) {
+			correction += TDMA_SUPERFRAME_LENGTH;
+		}
+		tdma_stats.last_correction = correction;
+	}
+
+	tdma_anchor_tick = tick;
+	tdma_anchor_offset = offset;
+	tdma_is_anchored = 1;
+	tdma_stats.synchronizations++;
+
+	osKernelUnlock();
+}
+
+/**
+ * ms into the superframe right now
+ * Returns TDMA_FAILURE if there is no recent GPS time to go by
+ */
+uint8_t _TDMA_Get_Offset( uint32_t *offset ) {
+	osKernelLock();
+	uint8_t is_anchored = tdma_is_anchored;
+	uint32_t anchor_tick = tdma_anchor_tick;
+	uint32_t anchor_offset = tdma_anchor_offset;
+	osKernelUnlock();
+
+	if ( ! is_anchored ) {
+		return TDMA_FAILURE;
+	}
+
+	uint32_t age = osKernelGetTickCount() - anchor_tick;
+	tdma_stats.anchor_age = age;
+	if ( age > TDMA_MAX_ANCHOR_AGE ) {
+		return TDMA_FAILURE;
+	}
+
+	*offset = ( anchor_offset + age ) % TDMA_SUPERFRAME_LENGTH;
+	return TDMA_SUCCESS;
+}
+
+uint8_t TDMA_Is_Synchronized() {
+	uint32_t offset;
+	return _TDMA_Get_Offset( &offset );
+}
+
+/**
+ * ms until slot next starts, 0 if it has only just started
+ * Returns 0 if not synchronized, so unscheduled stations send straight away
+ */
+uint32_t TDMA_Time_Until_Slot( uint8_t slot ) {
+	uint32_t offset;
+	if ( TDMA_SUCCESS != _TDMA_Get_Offset( &offset ) ) {
+		return 0;
+	}
+
+	uint32_t start = (uint32_t) slot * TDMA_SLOT_LENGTH;
+	uint32_t since_start = ( offset + TDMA_SUPERFRAME_LENGTH - start ) % TDMA_SUPERFRAME_LENGTH;
+	if ( since_start <= TDMA_LATE_START ) {
+		return 0;
+	}
+
+	return TDMA_SUPERFRAME_LENGTH - since_start;
+}
+
+/**
+ * ms left in slot before its guard time, 0 if we are outside it
+ */
+uint32_t TDMA_Time_Left_In_Slot( uint8_t slot ) {
+	uint32_t offset;
+	if ( TDMA_SUCCESS != _TDMA_Get_Offset( &offset ) ) {
+		return 0;
+	}
+
+	uint32_t start = (uint32_t) slot * TDMA_SLOT_LENGTH;
+	uint32_t since_start = ( offset + TDMA_SUPERFRAME_LENGTH - start ) % TDMA_SUPERFRAME_LENGTH;
+	if ( since_start >= TDMA_SLOT_LENGTH - TDMA_GUARD_TIME ) {
+		return 0;
+	}
+
+	return TDMA_SLOT_LENGTH - TDMA_GUARD_TIME - since_start;
+}
+
+void TDMA_Record_Slot( uint8_t used ) {
+	if ( used ) {
+		tdma_stats.slots_used++;
+	} else {
+		tdma_stats.slots_missed++;
+	}
+}
+
+void TDMA_Get_Stats( tdma_stats_type *stats ) {
+	*stats = tdma_stats;
+}
@@ -0,0 +1,49 @@
+/**
+ * tdma.h
+ * Allen Snook
+ * October 19, 2026
+ *
+ * GPS synchronized transmit slots
+ * Every station shares the same superframe, lined up on the UTC second,
+ * and owns one slot of it chosen by its node address
+ */
+
+#ifndef __TDMA_H
+#define __TDMA_H
+
+#include "cmsis_os.h"
+
+#define TDMA_SUCCESS 1
+#define TDMA_FAILURE 0
+
+// One superframe per transmit interval, so every station gets one slot each time it has something to send
+// (86400 s must divide evenly into superframes so they line up again across midnight)
+#define TDMA_SUPERFRAME_LENGTH 10000 // ms
+
+// Long enough for a full length frame at the slowest profile (about 195 ms),
+// the link report window after it (100 ms) and some listen before talk
+#define TDMA_SLOT_LENGTH 500 // ms
+#define TDMA_SLOTS ( TDMA_SUPERFRAME_LENGTH / TDMA_SLOT_LENGTH )
+
+// Left clear at the end of each slot for clock error between stations
+#define TDMA_GUARD_TIME 100 // ms
+
+// Node addresses start at 1, so address 1 has slot 0
+#define TDMA_SLOT_FOR_ADDRESS( address ) ( ( (address) - 1 ) % TDMA_SLOTS )
+
+typedef struct {
+	uint32_t synchronizations;
+	uint32_t anchor_age;		// ms since the last GPS time
+	int32_t last_correction;	// ms the last GPS time moved the schedule by
+	uint32_t slots_used;
+	uint32_t slots_missed;		// Frames that couldn't get out inside their slot
+} tdma_stats_type;
+
+void TDMA_Synchronize( uint8_t hour, uint8_t minutes, uint8_t seconds, uint32_t tick );
+uint8_t TDMA_Is_Synchronized();
+uint32_t TDMA_Time_Until_Slot( uint8_t slot );
+uint32_t TDMA_Time_Left_In_Slot( uint8_t slot );
+void TDMA_Record_Slot( uint8_t used );
+void TDMA_Get_Stats( tdma_stats_type *stats );
+
+#endif // __TDMA_H
@@ -9,16 +9,25 @@
 #include "thp.h"
 #include "stm32f4xx_hal.h"
 #include "bme280.h"
+#include "pool.h"
+#include "mailbox.h"
 
 #define THP_STATE_UNKNOWN 0
 #define THP_STATE_READY 1
 
 static I2C_HandleTypeDef *thp_hi2c;
-static osMessageQueueId_t thp_hqueue;
+static osThreadId_t thp_notify_thread = 0;
+static uint32_t thp_notify_flags = 0;
 static struct bme280_dev thp_dev;
 static struct bme280_data thp_bme_data;
 
-static thp_data_type thp_data;
+// Readings are built in a block and the block itself is posted
+// One in the mailbox, one held by the consumer and one being filled
+#define THP_POOL_BLOCKS 3
+POOL_DEFINE( thp_pool, thp_data_type, THP_POOL_BLOCKS );
+MAILBOX_DEFINE( thp_mailbox );
+
+static uint32_t thp_read_failures = 0;
 
 static uint8_t thp_settings = 0;
 static uint8_t thp_result = 0;
@@ -100,20 +109,54 @@ void THP_Set_I2C( I2C_HandleTypeDef *hi2c ) {
 	thp_hi2c = hi2c;
 }
 
-void THP_Set_Message_Queue( osMessageQueueId_t hqueue ) {
-	thp_hqueue = hqueue;
+/**
+ * Sets flags on thread each time new data is posted
+ */
+void THP_Set_Notify( osThreadId_t thread, uint32_t flags ) {
+	thp_notify_thread = thread;
+	thp_notify_flags = flags;
+}
+
+/**
+ * The newest reading since the last call, or 0 if there isn't one
+ * Never blocks. The caller owns the block and gives it back with THP_Free_Data
+ */
+thp_data_type *THP_Take_Data() {
+	return Mailbox_Take( &thp_mailbox );
+}
+
+void THP_Free_Data( thp_data_type *data ) {
+	Pool_Free( &thp_pool, data );
+}
+
+/**
+ * Readings lost to the sensor not answering
+ */
+uint32_t THP_Get_Read_Failures() {
+	return thp_read_failures;
 }
 
-void _THP_Enqueue_Data() {
-	if ( ! thp_hqueue ) {
-		return;
+/**
+ * Posts a new reading, freeing any older one the consumer didn't get to
+ */
+void _THP_Post_Data() {
+	thp_data_type *data = Pool_Alloc( &thp_pool );
+	if ( ! data ) {
+		return; // Counted as an exhaustion - the consumer has fallen behind
 	}
 
-	thp_data.pressure = (uint16_t) ( thp_bme_data.pressure / 10 );
-	thp_data.temperature = (int16_t) ( thp_bme_data.temperature / 10 );
-	thp_data.humidity = (uint16_t) ( thp_bme_data.humidity / 100 );
+	data->pressure = (uint16_t) ( thp_bme_data.pressure / 10 );
+	data->temperature = (int16_t) ( thp_bme_data.temperature / 10 );
+	data->humidity = (uint16_t) ( thp_bme_data.humidity / 100 );
 
-	osMessageQueuePut( thp_hqueue, (void *) &(thp_data), 0U, 0U );
+	thp_data_type *stale = Mailbox_Post( &thp_mailbox, data );
+	if ( stale ) {
+		THP_Free_Data( stale );
+	}
+
+	if ( thp_notify_thread ) {
+		osThreadFlagsSet( thp_notify_thread, thp_notify_flags );
+	}
 }
 
 void THP_Run() {
@@ -129,9 +172,13 @@ void THP_Run() {
 			thp_result = bme280_get_sensor_data( BME280_ALL, &thp_bme_data, &thp_dev );
 			if ( BME280_OK == thp_result ) {
 				HAL_GPIO_WritePin( GPIOB, GPIO_PIN_7, GPIO_PIN_SET ); // Blue PB7 LD2
-				_THP_Enqueue_Data();
+				_THP_Post_Data();
 			}
 		}
+
+		if ( BME280_OK != thp_result ) {
+			thp_read_failures++;
+		}
 	}
 
 	osDelay( 1000 ); // This task should sleep for 1 second after running
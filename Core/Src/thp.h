@@ -17,7 +17,10 @@ typedef struct {
 } thp_data_type; // 6 bytes
 
 void THP_Set_I2C( I2C_HandleTypeDef *hi2c );
-void THP_Set_Message_Queue( osMessageQueueId_t hqueue );
+void THP_Set_Notify( osThreadId_t thread, uint32_t flags );
+thp_data_type *THP_Take_Data();
+void THP_Free_Data( thp_data_type *data );
+uint32_t THP_Get_Read_Failures();
 void THP_Run();
 
 #endif // __THP_H
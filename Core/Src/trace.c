@@ -0,0 +1,85 @@
+/**
+ * trace.c
+ * Allen Snook
+ * October 19, 2026
+ *
+ * Trace_Record runs inside the kernel (often in PendSV) and in interrupt
+ * handlers, so it only masks interrupts long enough to claim a slot and
+ * fill it - a few dozen cycles
+ */
+
+#include "trace.h"
+#include "stm32f4xx_hal.h"
+
+// Survives a reset (see the .ccmram section in STM32F429ZITX_FLASH.ld)
+__attribute__(( section( ".ccmram" ) )) static trace_buffer_type trace_buffer;
+
+static volatile uint8_t trace_paused = 1; // Until Trace_Init
+
+/**
+ * Carries on from before the reset if the buffer looks intact, marking where it happened
+ */
+void Trace_Init( uint8_t reset_cause ) {
+	if ( TRACE_MAGIC != trace_buffer.magic ) {
+		Trace_Clear();
+	}
+
+	trace_paused = 0;
+	Trace_Record( TRACE_BOOT, 0, reset_cause );
+}
+
+void Trace_Record( uint8_t event, uint8_t id, uint16_t value ) {
+	if ( trace_paused ) {
+		return;
+	}
+
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	trace_record_type *record = &(trace_buffer.records[trace_buffer.head++ & ( TRACE_RECORDS - 1 )]);
+	record->cycles = DWT->CYCCNT;
+	record->event = event;
+	record->id = id;
+	record->value = value;
+
+	__set_PRIMASK( primask );
+}
+
+/**
+ * Stops recording so the buffer holds still while it is dumped
+ */
+void Trace_Pause() {
+	trace_paused = 1;
+}
+
+void Trace_Resume() {
+	trace_paused = 0;
+}
+
+void Trace_Clear() {
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	trace_buffer.magic = TRACE_MAGIC;
+	trace_buffer.head = 0;
+	__set_PRIMASK( primask );
+}
+
+/**
+ * Records held, up to TRACE_RECORDS
+ */
+uint32_t Trace_Count() {
+	return trace_buffer.head < TRACE_RECORDS ? trace_buffer.head : TRACE_RECORDS;
+}
+
+/**
+ * The index'th oldest record held
+ */
+uint8_t Trace_Read( uint32_t index, trace_record_type *record ) {
+	uint32_t count = Trace_Count();
+	if ( index >= count ) {
+		return TRACE_FAILURE;
+	}
+
+	*record = trace_buffer.records[( trace_buffer.head - count + index ) & ( TRACE_RECORDS - 1 )];
+	return TRACE_SUCCESS;
+}
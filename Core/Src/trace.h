@@ -0,0 +1,70 @@
+/**
+ * trace.h
+ * Allen Snook
+ * October 19, 2026
+ *
+ * RAM trace of RTOS events - task switches and notifications, queue sends
+ * and receives, interrupt handlers and sleeps - for when timing goes wrong
+ * FreeRTOSConfig.h points the kernel's trace macros here. Records go round
+ * a buffer in CCM RAM that isn't cleared at startup, so the events leading
+ * up to a reset are still there afterwards. The console "trace" command
+ * dumps it and Tools/trace_decode turns the dump into a timeline
+ * Included by FreeRTOSConfig.h and the decoder, so no HAL here
+ */
+
+#ifndef __TRACE_H
+#define __TRACE_H
+
+#include <stdint.h>
+
+#define TRACE_SUCCESS 1
+#define TRACE_FAILURE 0
+
+// A power of two, 8 bytes each
+#define TRACE_RECORDS 2048
+
+#define TRACE_MAGIC 0x54524345 // "TRCE"
+
+// Events
+#define TRACE_BOOT 0x00					// value: reset cause (see health.h)
+#define TRACE_TASK_SWITCHED_IN 0x01		// id: task number
+#define TRACE_TASK_SWITCHED_OUT 0x02	// id: task number
+#define TRACE_TASK_NOTIFY 0x03			// id: task notified (thread flags set)
+#define TRACE_TASK_NOTIFY_FROM_ISR 0x04
+#define TRACE_QUEUE_SEND 0x05			// id: queue number, value: messages waiting before
+#define TRACE_QUEUE_SEND_FAILED 0x06
+#define TRACE_QUEUE_SEND_FROM_ISR 0x07
+#define TRACE_QUEUE_RECEIVE 0x08
+#define TRACE_QUEUE_RECEIVE_FAILED 0x09
+#define TRACE_QUEUE_RECEIVE_FROM_ISR 0x0A
+#define TRACE_ISR_ENTER 0x0B			// id: handler (see cycles.h)
+#define TRACE_ISR_EXIT 0x0C
+#define TRACE_SLEEP_ENTER 0x0D			// id: depth (see sleep.h)
+#define TRACE_SLEEP_EXIT 0x0E			// id and value: us asleep, 24 bits, saturating
+#define TRACE_EVENTS 0x0F
+
+// Queue numbers - queues we don't number (the timer task's, semaphores) are 0
+#define TRACE_QUEUE_CORE_TO_RADIO 1
+
+typedef struct {
+	uint32_t cycles;	// DWT cycle count, which stops while the core sleeps
+	uint8_t event;
+	uint8_t id;
+	uint16_t value;
+} trace_record_type;
+
+typedef struct {
+	uint32_t magic;
+	uint32_t head;		// Records ever written - the next goes at head % TRACE_RECORDS
+	trace_record_type records[TRACE_RECORDS];
+} trace_buffer_type;
+
+void Trace_Init( uint8_t reset_cause );
+void Trace_Record( uint8_t event, uint8_t id, uint16_t value );
+void Trace_Pause();
+void Trace_Resume();
+void Trace_Clear();
+uint32_t Trace_Count();
+uint8_t Trace_Read( uint32_t index, trace_record_type *record );
+
+#endif // __TRACE_H
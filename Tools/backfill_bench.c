@@ -0,0 +1,279 @@
+/**
+ * backfill_bench.c
+ * Allen Snook
+ * October 19, 2026
+ *
+ * Sustained backfill throughput, in records per second, at each modem profile
+ * and frame loss rate. A full log of 10 second observations is drained through
+ * the same window and bitmap code the firmware runs, one TDMA slot per
+ * superframe, with a live frame going first in each slot. The gateway's side
+ * decodes every frame it receives and the result is checked against the log.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "obs.h"
+#include "backfill.h"
+#include "radio_config.h"
+
+// Mirrors of the firmware's timing (tdma.h, radio.c, core.c, log.h)
+#define BENCH_SUPERFRAME 10000 // ms
+#define BENCH_SLOT_BUDGET ( 500 - 100 ) // ms, slot less guard time
+#define BENCH_TX_MARGIN 20 // ms
+#define BENCH_RX2_DELAY 30 // ms
+#define BENCH_RX_WINDOW 10 // ms
+#define BENCH_DOWNLINK_LENGTH 32
+#define BENCH_HEADER_LENGTH 4
+#define BENCH_LIVE_LENGTH ( BENCH_HEADER_LENGTH + 2 + OBS_PAYLOAD_HEADER_LENGTH + 12 ) // One observation, roughly
+#define BENCH_MAX_MESSAGE_LENGTH 256
+#define BENCH_FRAMES_PER_SLOT 2 // CORE_BACKFILL_FRAMES
+#define BENCH_TIMEOUT ( 3 * BENCH_SUPERFRAME ) // CORE_BACKFILL_TIMEOUT
+#define BENCH_DUTY_CYCLE_BUDGET 36000000ULL // us, 1% of an hour
+#define BENCH_MAX_DUTY_CYCLE 700 // per mille of the limit, CORE_BACKFILL_MAX_DUTY_CYCLE_OF_LIMIT
+#define BENCH_HOUR ( 3600000 / BENCH_SUPERFRAME ) // superframes
+
+#define BENCH_RECORDS 16380 // LOG_CAPACITY
+#define BENCH_INTERVAL 10
+#define BENCH_MAX_SUPERFRAMES 20000 // Over two days - give up
+
+typedef struct {
+	const char *name;
+	uint32_t bitrate;
+} bench_profile_type;
+
+#define BENCH_PROFILE_ENTRY( name, bps, fdev, sensitivity ) { name, bps },
+static const bench_profile_type bench_profiles[] = {
+	RADIO_CONFIG_PROFILES( BENCH_PROFILE_ENTRY )
+};
+#define BENCH_PROFILES ( sizeof( bench_profiles ) / sizeof( bench_profiles[0] ) )
+
+static const double bench_losses[] = { 0.0, 0.1, 0.3 };
+#define BENCH_LOSSES ( sizeof( bench_losses ) / sizeof( bench_losses[0] ) )
+
+static obs_data_type bench_obs[BENCH_RECORDS];
+static uint8_t bench_acked[BENCH_RECORDS];
+static uint32_t bench_acked_count;
+static uint8_t bench_received[BENCH_RECORDS];
+
+// The gateway's view
+static uint8_t bench_gateway_started;
+static uint8_t bench_gateway_base;
+static uint16_t bench_gateway_bitmap;
+static uint8_t bench_report_waiting;
+
+static uint8_t _Bench_Read( uint32_t id, obs_data_type *obs, uint8_t *acknowledged ) {
+	if ( id >= BENCH_RECORDS ) {
+		return BACKFILL_FAILURE;
+	}
+	*obs = bench_obs[id];
+	*acknowledged = bench_acked[id];
+	return BACKFILL_SUCCESS;
+}
+
+static void _Bench_Acknowledge( uint32_t first, uint32_t last ) {
+	for ( uint32_t id = first; id <= last && id < BENCH_RECORDS; id++ ) {
+		bench_acked_count += ! bench_acked[id];
+		bench_acked[id] = 1;
+	}
+}
+
+static const backfill_store_type bench_store = { _Bench_Read, _Bench_Acknowledge };
+
+static void _Bench_Generate() {
+	uint32_t time = OBS_Epoch_From_Date( 26, 7, 4, 0, 0, 0 );
+	int16_t temperature = 215;
+	int32_t pressure = 10132;
+	int32_t humidity = 550;
+
+	srand( 1 );
+	for ( int i = 0; i < BENCH_RECORDS; i++ ) {
+		temperature += ( rand() % 3 ) - 1;
+		pressure += ( rand() % 5 == 0 ) ? ( rand() % 3 ) - 1 : 0;
+		humidity += ( rand() % 4 == 0 ) ? ( rand() % 5 ) - 2 : 0;
+		if ( humidity < 0 ) humidity = 0;
+		if ( humidity > 1000 ) humidity = 1000;
+
+		bench_obs[i].time = time + i * BENCH_INTERVAL;
+		bench_obs[i].temperature = temperature;
+		bench_obs[i].pressure = (uint16_t) pressure;
+		bench_obs[i].humidity = (uint16_t) humidity;
+		bench_obs[i].latitude = OBS_Arc_Seconds( 47, 36, 35, 'N' );
+		bench_obs[i].longitude = OBS_Arc_Seconds( 122, 19, 59, 'W' );
+	}
+}
+
+static int _Bench_Same( const obs_data_type *a, const obs_data_type *b ) {
+	return a->time == b->time && a->temperature == b->temperature && a->pressure == b->pressure &&
+		a->humidity == b->humidity && a->latitude == b->latitude && a->longitude == b->longitude;
+}
+
+static double _Bench_Random() {
+	return (double) rand() / ( (double) RAND_MAX + 1.0 );
+}
+
+// ms, as _Radio_Airtime_At
+static double _Bench_Airtime( const bench_profile_type *profile, uint16_t length ) {
+	return ( RADIO_CONFIG_PREAMBLE_LENGTH + RADIO_CONFIG_SYNC_LENGTH + length + 2 ) * 8 * 1000.0 / profile->bitrate;
+}
+
+// ms from the end of a frame until its second receive window has closed
+static double _Bench_Windows( const bench_profile_type *profile ) {
+	return BENCH_RX2_DELAY + BENCH_RX_WINDOW + _Bench_Airtime( profile, BENCH_DOWNLINK_LENGTH ) + BENCH_TX_MARGIN;
+}
+
+// ms a frame takes out of the slot, as Radio_Get_Frame_Time
+static double _Bench_Frame_Time( const bench_profile_type *profile, uint16_t length ) {
+	return _Bench_Airtime( profile, length ) + BENCH_TX_MARGIN + _Bench_Windows( profile );
+}
+
+// As Radio_Get_Max_Frame_Length_In
+static uint16_t _Bench_Max_Frame_Length( const bench_profile_type *profile, double time ) {
+	double budget = time - BENCH_TX_MARGIN - _Bench_Windows( profile );
+	double bytes = budget * profile->bitrate / 8000 - ( RADIO_CONFIG_PREAMBLE_LENGTH + RADIO_CONFIG_SYNC_LENGTH + 2 );
+	if ( bytes <= BENCH_HEADER_LENGTH ) {
+		return BENCH_HEADER_LENGTH;
+	}
+	return bytes > BENCH_MAX_MESSAGE_LENGTH ? BENCH_MAX_MESSAGE_LENGTH : (uint16_t) bytes;
+}
+
+/**
+ * The gateway decodes a frame, checks it against the log and updates its bitmap
+ */
+static void _Bench_Gateway_Receive( const uint8_t *payload, uint16_t length ) {
+	obs_data_type decoded[BACKFILL_MAX_RECORDS];
+	uint32_t first = ( (uint32_t) payload[1] << 24 ) | ( payload[2] << 16 ) | ( payload[3] << 8 ) | payload[4];
+	uint8_t count = payload[5];
+
+	if ( OBS_SUCCESS != OBS_Decode( 0, &(payload[BACKFILL_PAYLOAD_HEADER_LENGTH]),
+		length - BACKFILL_PAYLOAD_HEADER_LENGTH, decoded, count ) ) {
+		fprintf( stderr, "Could not decode the frame starting at record %u\n", first );
+		exit( 1 );
+	}
+	for ( uint8_t i = 0; i < count; i++ ) {
+		if ( ! _Bench_Same( &decoded[i], &bench_obs[first + i] ) ) {
+			fprintf( stderr, "Record %u decoded wrong\n", first + i );
+			exit( 1 );
+		}
+		bench_received[first + i] = 1;
+	}
+
+	uint8_t sequence = payload[0];
+	uint8_t ahead = (uint8_t) ( sequence - bench_gateway_base );
+	if ( ! bench_gateway_started ) {
+		bench_gateway_bitmap = 1;
+		bench_gateway_started = 1;
+	} else if ( ahead < 0x80 ) {
+		bench_gateway_bitmap = ( ahead >= BACKFILL_WINDOW ? 0 : bench_gateway_bitmap << ahead ) | 1;
+	} else {
+		return; // Can't happen - every frame has a new sequence number
+	}
+	bench_gateway_base = sequence;
+}
+
+/**
+ * Drains the whole log, returning the superframes it took
+ */
+static uint32_t _Bench_Drain( const bench_profile_type *profile, double loss, backfill_stats_type *stats ) {
+	static backfill_type backfill;
+	static uint32_t airtime[BENCH_HOUR]; // us per superframe, for the duty cycle
+	uint8_t frame[BENCH_MAX_MESSAGE_LENGTH];
+	uint32_t superframe = 0;
+	uint64_t hour_airtime = 0;
+
+	memset( bench_acked, 0, sizeof( bench_acked ) );
+	bench_acked_count = 0;
+	memset( bench_received, 0, sizeof( bench_received ) );
+	memset( airtime, 0, sizeof( airtime ) );
+	bench_gateway_started = 0;
+	bench_gateway_base = 0;
+	bench_gateway_bitmap = 0;
+	bench_report_waiting = 0;
+	Backfill_Init( &backfill, &bench_store, 0 );
+
+	while ( bench_acked_count < BENCH_RECORDS && superframe < BENCH_MAX_SUPERFRAMES ) {
+		uint32_t now = superframe * BENCH_SUPERFRAME;
+		uint16_t slot = superframe % BENCH_HOUR;
+		hour_airtime -= airtime[slot];
+		airtime[slot] = 0;
+
+		if ( bench_report_waiting ) {
+			Backfill_Handle_Ack( &backfill, bench_gateway_base, bench_gateway_bitmap );
+			bench_report_waiting = 0;
+		}
+		Backfill_Expire( &backfill, now, BENCH_TIMEOUT );
+
+		// The live frame goes first, and backfill frames are sized to fit behind it
+		double left = BENCH_SLOT_BUDGET - _Bench_Frame_Time( profile, BENCH_LIVE_LENGTH );
+		airtime[slot] += (uint32_t) ( _Bench_Airtime( profile, BENCH_LIVE_LENGTH ) * 1000 );
+
+		uint16_t duty_cycle = (uint16_t) ( ( hour_airtime + airtime[slot] ) * 1000 / BENCH_DUTY_CYCLE_BUDGET );
+		for ( int f = 0; f < BENCH_FRAMES_PER_SLOT && duty_cycle < BENCH_MAX_DUTY_CYCLE; f++ ) {
+			uint16_t max_length = _Bench_Max_Frame_Length( profile, left );
+			if ( max_length <= BENCH_HEADER_LENGTH ) {
+				break;
+			}
+
+			uint16_t length = Backfill_Build_Frame( &backfill, 0, BENCH_RECORDS, now,
+				frame, max_length - BENCH_HEADER_LENGTH );
+			if ( 0 == length ) {
+				break;
+			}
+			left -= _Bench_Frame_Time( profile, BENCH_HEADER_LENGTH + length );
+			airtime[slot] += (uint32_t) ( _Bench_Airtime( profile, BENCH_HEADER_LENGTH + length ) * 1000 );
+
+			if ( _Bench_Random() >= loss ) {
+				_Bench_Gateway_Receive( frame, length );
+				if ( _Bench_Random() >= loss ) {
+					bench_report_waiting = 1; // The link report after it
+				}
+			}
+		}
+		hour_airtime += airtime[slot];
+		superframe++;
+	}
+
+	for ( uint32_t i = 0; i < BENCH_RECORDS; i++ ) {
+		if ( bench_acked[i] && ! bench_received[i] ) {
+			fprintf( stderr, "Record %u acknowledged but never received\n", i );
+			exit( 1 );
+		}
+	}
+
+	*stats = backfill.stats;
+	return superframe;
+}
+
+int main() {
+	_Bench_Generate();
+
+	printf( "Draining %d logged observations (%.1f days at %d s), %d backfill frames per slot\n\n",
+		BENCH_RECORDS, BENCH_RECORDS * BENCH_INTERVAL / 86400.0, BENCH_INTERVAL, BENCH_FRAMES_PER_SLOT );
+	printf( "profile  frame  rec/frame  loss  records/s  drain h  resent  nacked  timeouts\n" );
+
+	for ( uint8_t p = 0; p < BENCH_PROFILES; p++ ) {
+		const bench_profile_type *profile = &bench_profiles[p];
+		uint16_t max_length = _Bench_Max_Frame_Length( profile, BENCH_SLOT_BUDGET );
+
+		for ( uint8_t l = 0; l < BENCH_LOSSES; l++ ) {
+			backfill_stats_type stats;
+			srand( 2 );
+			uint32_t superframes = _Bench_Drain( profile, bench_losses[l], &stats );
+			double seconds = (double) superframes * BENCH_SUPERFRAME / 1000;
+
+			if ( superframes >= BENCH_MAX_SUPERFRAMES ) {
+				printf( "%7s  %5u  %9s  %3.0f%%  no room under the duty cycle limit\n",
+					profile->name, max_length, "-", bench_losses[l] * 100 );
+				continue;
+			}
+
+			printf( "%7s  %5u  %9.1f  %3.0f%%  %9.2f  %7.1f  %6u  %6u  %8u\n",
+				profile->name, max_length, stats.frames ? (double) stats.records / stats.frames : 0.0,
+				bench_losses[l] * 100, BENCH_RECORDS / seconds, seconds / 3600,
+				stats.retransmitted, stats.nacked_frames, stats.timeouts );
+		}
+	}
+
+	return 0;
+}
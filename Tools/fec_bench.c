@@ -0,0 +1,120 @@
+/**
+ * fec_bench.c
+ * Allen Snook
+ * October 19, 2026
+ *
+ * Frame success rate against bit error rate, with and without FEC
+ * Random bit errors are injected into each frame at the given rate,
+ * and again as short bursts, then the frame is decoded
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "fec.h"
+
+#define BENCH_PAYLOAD_LENGTH 60 // A typical batched observation frame after the header
+#define BENCH_FRAMES 2000
+#define BENCH_BURST_LENGTH 6 // bits
+#define BENCH_ITERATIONS 20000
+
+static const double bench_bers[] = { 1e-4, 3e-4, 1e-3, 3e-3, 1e-2, 2e-2, 3e-2, 5e-2 };
+
+static uint8_t bench_data[BENCH_PAYLOAD_LENGTH];
+static uint8_t bench_encoded[FEC_MAX_ENCODED_LENGTH];
+static uint8_t bench_decoded[FEC_MAX_ENCODED_LENGTH];
+
+static double _Bench_Random() {
+	return (double) rand() / ( (double) RAND_MAX + 1.0 );
+}
+
+/**
+ * Flips bits at rate ber, either one at a time or as bursts starting at rate ber / burst
+ * Returns the number of bits flipped
+ */
+static uint32_t _Bench_Corrupt( uint8_t *buffer, uint16_t length, double ber, int burst ) {
+	uint32_t flipped = 0;
+	uint32_t bits = length * 8;
+	double rate = burst ? ber / BENCH_BURST_LENGTH : ber;
+
+	for ( uint32_t bit = 0; bit < bits; bit++ ) {
+		if ( _Bench_Random() < rate ) {
+			uint32_t span = burst ? BENCH_BURST_LENGTH : 1;
+			for ( uint32_t i = 0; i < span && bit + i < bits; i++ ) {
+				buffer[( bit + i ) >> 3] ^= 0x80 >> ( ( bit + i ) & 7 );
+				flipped++;
+			}
+			bit += span - 1;
+		}
+	}
+
+	return flipped;
+}
+
+static void _Bench_Sweep( int burst ) {
+	printf( "\n%s errors\n", burst ? "Burst" : "Random" );
+	printf( "    BER   uncoded   with FEC\n" );
+
+	for ( size_t n = 0; n < sizeof( bench_bers ) / sizeof( bench_bers[0] ); n++ ) {
+		uint32_t uncoded_ok = 0;
+		uint32_t coded_ok = 0;
+
+		for ( int frame = 0; frame < BENCH_FRAMES; frame++ ) {
+			for ( int i = 0; i < BENCH_PAYLOAD_LENGTH; i++ ) {
+				bench_data[i] = rand() & 0xFF;
+			}
+
+			// Without FEC the payload and its 2 byte CRC must arrive untouched
+			memcpy( bench_decoded, bench_data, BENCH_PAYLOAD_LENGTH );
+			if ( 0 == _Bench_Corrupt( bench_decoded, BENCH_PAYLOAD_LENGTH + 2, bench_bers[n], burst ) ) {
+				uncoded_ok++;
+			}
+
+			uint16_t encoded_length = 0;
+			FEC_Encode( bench_data, BENCH_PAYLOAD_LENGTH, bench_encoded, sizeof( bench_encoded ), &encoded_length );
+			_Bench_Corrupt( bench_encoded, encoded_length, bench_bers[n], burst );
+
+			uint8_t length = 0;
+			if ( FEC_SUCCESS == FEC_Decode( bench_encoded, encoded_length, bench_decoded, &length ) &&
+				BENCH_PAYLOAD_LENGTH == length && 0 == memcmp( bench_data, bench_decoded, length ) ) {
+				coded_ok++;
+			}
+		}
+
+		printf( "%7.0e  %7.1f%%  %8.1f%%\n", bench_bers[n],
+			100.0 * uncoded_ok / BENCH_FRAMES, 100.0 * coded_ok / BENCH_FRAMES );
+	}
+}
+
+int main() {
+	srand( 1 );
+
+	printf( "%d byte payload, %d bytes encoded, %d frames per point\n",
+		BENCH_PAYLOAD_LENGTH, FEC_ENCODED_LENGTH( BENCH_PAYLOAD_LENGTH ), BENCH_FRAMES );
+
+	_Bench_Sweep( 0 );
+	_Bench_Sweep( 1 );
+
+	// Throughput (on the M4, see the cycle counts in Radio_Get_FEC_Stats)
+	uint16_t encoded_length = 0;
+	clock_t start = clock();
+	for ( int n = 0; n < BENCH_ITERATIONS; n++ ) {
+		bench_data[0] = n;
+		FEC_Encode( bench_data, BENCH_PAYLOAD_LENGTH, bench_encoded, sizeof( bench_encoded ), &encoded_length );
+	}
+	double encode_seconds = (double) ( clock() - start ) / CLOCKS_PER_SEC;
+
+	start = clock();
+	uint8_t length = 0;
+	for ( int n = 0; n < BENCH_ITERATIONS / 10; n++ ) {
+		FEC_Decode( bench_encoded, encoded_length, bench_decoded, &length );
+	}
+	double decode_seconds = (double) ( clock() - start ) / CLOCKS_PER_SEC;
+
+	printf( "\nEncode: %.1f ns per encoded byte\n", 1e9 * encode_seconds / ( (double) BENCH_ITERATIONS * encoded_length ) );
+	printf( "Decode: %.1f ns per encoded byte\n", 1e9 * decode_seconds / ( (double) BENCH_ITERATIONS / 10 * encoded_length ) );
+
+	return 0;
+}
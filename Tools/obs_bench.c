@@ -0,0 +1,140 @@
+/**
+ * obs_bench.c
+ * Allen Snook
+ * October 19, 2026
+ *
+ * Size and throughput benchmark for the compact observation encoding
+ * Encodes a synthetic day of 10 second observations with each batch size,
+ * decodes it again and checks the round trip
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "obs.h"
+
+#define BENCH_OBSERVATIONS 8640 // One day at 10 s
+#define BENCH_INTERVAL 10
+#define BENCH_MAX_BATCH 8
+#define BENCH_RAW_LENGTH 20 // thp_data_type + gps_data_type
+#define BENCH_FRAME_OVERHEAD ( 4 + 2 + OBS_PAYLOAD_HEADER_LENGTH ) // radio header, telemetry, payload header
+#define BENCH_MAX_RECORDS_LENGTH ( 66 - BENCH_FRAME_OVERHEAD )
+#define BENCH_ITERATIONS 50
+
+static obs_data_type bench_obs[BENCH_OBSERVATIONS];
+static obs_data_type bench_decoded[BENCH_OBSERVATIONS];
+
+static void _Bench_Generate() {
+	uint32_t time = OBS_Epoch_From_Date( 26, 7, 4, 0, 0, 0 );
+	int16_t temperature = 215;
+	int32_t pressure = 10132;
+	int32_t humidity = 550;
+
+	srand( 1 );
+	for ( int i = 0; i < BENCH_OBSERVATIONS; i++ ) {
+		// Slow random walks, roughly what the BME280 reports outdoors
+		temperature += ( rand() % 3 ) - 1;
+		pressure += ( rand() % 5 == 0 ) ? ( rand() % 3 ) - 1 : 0;
+		humidity += ( rand() % 4 == 0 ) ? ( rand() % 5 ) - 2 : 0;
+		if ( humidity < 0 ) humidity = 0;
+		if ( humidity > 1000 ) humidity = 1000;
+
+		bench_obs[i].time = time + i * BENCH_INTERVAL;
+		bench_obs[i].temperature = temperature;
+		bench_obs[i].pressure = (uint16_t) pressure;
+		bench_obs[i].humidity = (uint16_t) humidity;
+
+		// The station doesn't move, but the GPS fix wanders by an arc second now and then
+		bench_obs[i].latitude = OBS_Arc_Seconds( 47, 36, 35, 'N' ) + ( ( i % 700 ) == 0 ? 1 : 0 );
+		bench_obs[i].longitude = OBS_Arc_Seconds( 122, 19, 59, 'W' );
+	}
+}
+
+/**
+ * Encodes everything in frames of up to batch observations
+ * acknowledged chooses whether frames are deltas against the previous frame or stand alone
+ * Returns total bytes on the air (excluding preamble, sync and CRC) and the frame count
+ */
+static uint32_t _Bench_Encode_All( uint8_t batch, int acknowledged, uint32_t *frames, int verify ) {
+	uint8_t records[BENCH_MAX_RECORDS_LENGTH];
+	uint32_t bytes = 0;
+	int i = 0;
+
+	*frames = 0;
+	while ( i < BENCH_OBSERVATIONS ) {
+		const obs_data_type *reference = ( acknowledged && i > 0 ) ? &bench_obs[i - 1] : 0;
+		uint8_t count = ( BENCH_OBSERVATIONS - i < batch ) ? BENCH_OBSERVATIONS - i : batch;
+		uint8_t length = 0;
+		uint8_t encoded = OBS_Encode( reference, &bench_obs[i], count, records, sizeof( records ), &length );
+		if ( 0 == encoded ) {
+			fprintf( stderr, "Could not encode observation %d\n", i );
+			exit( 1 );
+		}
+
+		if ( verify ) {
+			const obs_data_type *decode_reference = ( acknowledged && i > 0 ) ? &bench_decoded[i - 1] : 0;
+			if ( OBS_SUCCESS != OBS_Decode( decode_reference, records, length, &bench_decoded[i], encoded ) ) {
+				fprintf( stderr, "Could not decode observation %d\n", i );
+				exit( 1 );
+			}
+		}
+
+		bytes += BENCH_FRAME_OVERHEAD + length;
+		( *frames )++;
+		i += encoded;
+	}
+
+	return bytes;
+}
+
+static void _Bench_Verify() {
+	for ( int i = 0; i < BENCH_OBSERVATIONS; i++ ) {
+		if ( 0 != memcmp( &bench_obs[i], &bench_decoded[i], sizeof( obs_data_type ) ) ) {
+			fprintf( stderr, "Round trip mismatch at observation %d\n", i );
+			exit( 1 );
+		}
+	}
+}
+
+int main() {
+	_Bench_Generate();
+
+	printf( "Raw: %d bytes per observation plus a %d byte frame header\n\n",
+		BENCH_RAW_LENGTH, 4 + 2 );
+	printf( "batch  acked  frames  bytes/obs  vs raw\n" );
+
+	for ( uint8_t batch = 1; batch <= BENCH_MAX_BATCH; batch++ ) {
+		for ( int acknowledged = 0; acknowledged <= 1; acknowledged++ ) {
+			uint32_t frames = 0;
+			memset( bench_decoded, 0, sizeof( bench_decoded ) );
+			uint32_t bytes = _Bench_Encode_All( batch, acknowledged, &frames, 1 );
+			_Bench_Verify();
+
+			double per_obs = (double) bytes / BENCH_OBSERVATIONS;
+			printf( "%5u  %5s  %6u  %9.2f  %5.1f%%\n", batch, acknowledged ? "yes" : "no",
+				frames, per_obs, 100.0 * per_obs / ( BENCH_RAW_LENGTH + 4 + 2 ) );
+		}
+	}
+
+	// Throughput
+	uint32_t frames = 0;
+	clock_t start = clock();
+	for ( int n = 0; n < BENCH_ITERATIONS; n++ ) {
+		_Bench_Encode_All( BENCH_MAX_BATCH, 1, &frames, 0 );
+	}
+	double encode_seconds = (double) ( clock() - start ) / CLOCKS_PER_SEC;
+
+	start = clock();
+	for ( int n = 0; n < BENCH_ITERATIONS; n++ ) {
+		_Bench_Encode_All( BENCH_MAX_BATCH, 1, &frames, 1 );
+	}
+	double both_seconds = (double) ( clock() - start ) / CLOCKS_PER_SEC;
+
+	double total = (double) BENCH_OBSERVATIONS * BENCH_ITERATIONS;
+	printf( "\nEncode: %.0f observations/s\n", total / encode_seconds );
+	printf( "Decode: %.0f observations/s\n", total / ( both_seconds - encode_seconds ) );
+
+	return 0;
+}
@@ -0,0 +1,358 @@
+/**
+ * trace_decode.c
+ * Allen Snook
+ * October 19, 2026
+ *
+ * Turns a dump from the console "trace" command (see trace.h) into a
+ * timeline and latency statistics
+ *
+ *   trace_decode [-s] [dump.txt]
+ *
+ * Reads standard input without a file, and -s leaves out the timeline
+ * Anything in the capture that isn't part of the dump (the prompt, other
+ * commands) is skipped. The cycle counter stops while the board sleeps, so
+ * the time asleep from each sleep record is added back in
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+
+#define DECODE_MAX_NAMES 256
+#define DECODE_MAX_PENDING 64 // Sends not yet received, per queue
+#define DECODE_SLEEP_DEPTHS 2
+
+typedef struct {
+	uint32_t count;
+	double total;	// us
+	double max;
+} decode_timing_type;
+
+typedef struct {
+	double in_at;		// us, when it was last switched in, or < 0 if it isn't running
+	double notified_at;	// ... notified while not running, or < 0
+	uint32_t runs;
+	decode_timing_type run;
+	decode_timing_type wake;	// Notified to switched in
+} decode_task_type;
+
+typedef struct {
+	double entered_at[8];	// A handler can't preempt itself, but the tail of one call may be missing
+	uint8_t depth;
+	decode_timing_type duration;
+} decode_isr_type;
+
+typedef struct {
+	uint32_t sends;
+	uint32_t receives;
+	uint32_t send_failures;
+	uint32_t receive_failures;
+	uint16_t max_depth;
+	double pending[DECODE_MAX_PENDING];	// Send times, oldest first
+	uint8_t pending_count;
+	decode_timing_type latency;			// Sent to received
+} decode_queue_type;
+
+static char *decode_task_names[DECODE_MAX_NAMES];
+static char *decode_isr_names[DECODE_MAX_NAMES];
+static char *decode_queue_names[DECODE_MAX_NAMES];
+
+static decode_task_type decode_tasks[DECODE_MAX_NAMES];
+static decode_isr_type decode_isrs[DECODE_MAX_NAMES];
+static decode_queue_type decode_queues[DECODE_MAX_NAMES];
+static uint32_t decode_sleeps[DECODE_SLEEP_DEPTHS];
+static double decode_asleep[DECODE_SLEEP_DEPTHS]; // us
+static uint32_t decode_boots;
+
+static const char *decode_events[TRACE_EVENTS] = {
+	"boot", "in", "out", "notify", "notify from isr", "send", "send failed", "send from isr",
+	"receive", "receive failed", "receive from isr", "enter", "exit", "sleep", "wake"
+};
+
+static void _Decode_Time( decode_timing_type *timing, double time ) {
+	timing->count++;
+	timing->total += time;
+	if ( time > timing->max ) {
+		timing->max = time;
+	}
+}
+
+static const char *_Decode_Name( char **names, uint8_t id, const char *kind ) {
+	static char unnamed[32];
+	if ( names[id] ) {
+		return names[id];
+	}
+	snprintf( unnamed, sizeof( unnamed ), "%s %u", kind, id );
+	return unnamed;
+}
+
+static void _Decode_Set_Name( char **names, unsigned id, const char *name ) {
+	if ( id >= DECODE_MAX_NAMES ) {
+		return;
+	}
+	free( names[id] );
+	names[id] = strdup( name );
+}
+
+static void _Decode_Reset_State() {
+	for ( int i = 0; i < DECODE_MAX_NAMES; i++ ) {
+		decode_tasks[i].in_at = -1;
+		decode_tasks[i].notified_at = -1;
+		decode_isrs[i].depth = 0;
+		decode_queues[i].pending_count = 0;
+	}
+}
+
+/**
+ * Updates the statistics with one record at time now (us)
+ */
+static void _Decode_Account( const trace_record_type *record, double now ) {
+	decode_task_type *task = &(decode_tasks[record->id]);
+	decode_isr_type *isr = &(decode_isrs[record->id]);
+	decode_queue_type *queue = &(decode_queues[record->id]);
+
+	switch ( record->event ) {
+		case TRACE_BOOT:
+			decode_boots++;
+			_Decode_Reset_State();
+			break;
+		case TRACE_TASK_SWITCHED_IN:
+			task->runs++;
+			task->in_at = now;
+			if ( task->notified_at >= 0 ) {
+				_Decode_Time( &(task->wake), now - task->notified_at );
+				task->notified_at = -1;
+			}
+			break;
+		case TRACE_TASK_SWITCHED_OUT:
+			if ( task->in_at >= 0 ) {
+				_Decode_Time( &(task->run), now - task->in_at );
+			}
+			task->in_at = -1;
+			break;
+		case TRACE_TASK_NOTIFY:
+		case TRACE_TASK_NOTIFY_FROM_ISR:
+			if ( task->in_at < 0 && task->notified_at < 0 ) {
+				task->notified_at = now;
+			}
+			break;
+		case TRACE_QUEUE_SEND:
+		case TRACE_QUEUE_SEND_FROM_ISR:
+			queue->sends++;
+			if ( record->value + 1 > queue->max_depth ) {
+				queue->max_depth = record->value + 1;
+			}
+			if ( queue->pending_count < DECODE_MAX_PENDING ) {
+				queue->pending[queue->pending_count++] = now;
+			}
+			break;
+		case TRACE_QUEUE_RECEIVE:
+		case TRACE_QUEUE_RECEIVE_FROM_ISR:
+			queue->receives++;
+			if ( queue->pending_count > 0 ) {
+				_Decode_Time( &(queue->latency), now - queue->pending[0] );
+				memmove( &(queue->pending[0]), &(queue->pending[1]), --queue->pending_count * sizeof( double ) );
+			}
+			break;
+		case TRACE_QUEUE_SEND_FAILED:
+			queue->send_failures++;
+			break;
+		case TRACE_QUEUE_RECEIVE_FAILED:
+			queue->receive_failures++;
+			break;
+		case TRACE_ISR_ENTER:
+			if ( isr->depth < 8 ) {
+				isr->entered_at[isr->depth++] = now;
+			}
+			break;
+		case TRACE_ISR_EXIT:
+			if ( isr->depth > 0 ) {
+				_Decode_Time( &(isr->duration), now - isr->entered_at[--isr->depth] );
+			}
+			break;
+	}
+}
+
+static void _Decode_Print_Record( const trace_record_type *record, double now, double slept ) {
+	printf( "%14.3f ms  ", now / 1000 );
+
+	switch ( record->event ) {
+		case TRACE_BOOT:
+			printf( "---- reset (cause 0x%02x) ----\n", record->value );
+			return;
+		case TRACE_TASK_SWITCHED_IN:
+		case TRACE_TASK_SWITCHED_OUT:
+		case TRACE_TASK_NOTIFY:
+		case TRACE_TASK_NOTIFY_FROM_ISR:
+			printf( "%-16s", _Decode_Name( decode_task_names, record->id, "task" ) );
+			break;
+		case TRACE_ISR_ENTER:
+		case TRACE_ISR_EXIT:
+			printf( "%-16s", _Decode_Name( decode_isr_names, record->id, "isr" ) );
+			break;
+		case TRACE_SLEEP_ENTER:
+			printf( "%-16s", record->id ? "stop" : "sleep" );
+			break;
+		case TRACE_SLEEP_EXIT:
+			printf( "%-16s%s %.3f ms\n", "", decode_events[record->event], slept / 1000 );
+			return;
+		default:
+			printf( "%-16s", _Decode_Name( decode_queue_names, record->id, "queue" ) );
+			printf( "%s (%u waiting)\n", decode_events[record->event], record->value );
+			return;
+	}
+
+	printf( "%s\n", decode_events[record->event] );
+}
+
+static void _Decode_Print_Timing( const char *label, const decode_timing_type *timing ) {
+	if ( 0 == timing->count ) {
+		printf( "  %-6s -\n", label );
+		return;
+	}
+	printf( "  %-6s %6u  avg %10.1f us  max %10.1f us\n", label, timing->count,
+		timing->total / timing->count, timing->max );
+}
+
+static void _Decode_Print_Stats( uint32_t records, double span ) {
+	printf( "\n%u records over %.3f s, %u reset%s\n", records, span / 1000000, decode_boots,
+		1 == decode_boots ? "" : "s" );
+	if ( records >= TRACE_RECORDS ) {
+		printf( "The buffer had wrapped, so older events are gone\n" );
+	}
+
+	printf( "\nTasks (run is switched in to out, wake is notified to switched in)\n" );
+	for ( int i = 0; i < DECODE_MAX_NAMES; i++ ) {
+		decode_task_type *task = &(decode_tasks[i]);
+		if ( 0 == task->runs ) {
+			continue;
+		}
+		printf( "%s: %u runs, %.1f ms (%.2f%% of the span)\n", _Decode_Name( decode_task_names, i, "task" ),
+			task->runs, task->run.total / 1000, span > 0 ? 100 * task->run.total / span : 0 );
+		_Decode_Print_Timing( "run", &(task->run) );
+		_Decode_Print_Timing( "wake", &(task->wake) );
+	}
+
+	printf( "\nInterrupt handlers\n" );
+	for ( int i = 0; i < DECODE_MAX_NAMES; i++ ) {
+		if ( decode_isrs[i].duration.count ) {
+			printf( "%s\n", _Decode_Name( decode_isr_names, i, "isr" ) );
+			_Decode_Print_Timing( "call", &(decode_isrs[i].duration) );
+		}
+	}
+
+	printf( "\nQueues (latency is sent to received)\n" );
+	for ( int i = 0; i < DECODE_MAX_NAMES; i++ ) {
+		decode_queue_type *queue = &(decode_queues[i]);
+		if ( 0 == queue->sends + queue->receives + queue->send_failures + queue->receive_failures ) {
+			continue;
+		}
+		printf( "%s: %u sent (%u failed), %u received (%u failed), most waiting %u\n",
+			i ? _Decode_Name( decode_queue_names, i, "queue" ) : "unnumbered",
+			queue->sends, queue->send_failures, queue->receives, queue->receive_failures, queue->max_depth );
+		if ( i ) {
+			_Decode_Print_Timing( "wait", &(queue->latency) );
+		}
+	}
+
+	printf( "\nAsleep\n" );
+	printf( "  sleep  %6u  %.1f ms\n", decode_sleeps[0], decode_asleep[0] / 1000 );
+	printf( "  stop   %6u  %.1f ms\n", decode_sleeps[1], decode_asleep[1] / 1000 );
+}
+
+int main( int argc, char **argv ) {
+	int timeline = 1;
+	FILE *input = stdin;
+
+	for ( int i = 1; i < argc; i++ ) {
+		if ( 0 == strcmp( argv[i], "-s" ) ) {
+			timeline = 0;
+		} else if ( ! ( input = fopen( argv[i], "r" ) ) ) {
+			perror( argv[i] );
+			return 1;
+		}
+	}
+
+	_Decode_Reset_State();
+
+	char line[256];
+	char name[128];
+	unsigned id = 0;
+	unsigned expected = 0;
+	unsigned hz = 0;
+	int started = 0;
+
+	uint32_t records = 0;
+	uint32_t last_cycles = 0;
+	uint32_t sleep_cycles = 0;
+	uint8_t sleep_depth = 0;
+	int have_cycles = 0;
+	double now = 0; // us
+
+	while ( fgets( line, sizeof( line ), input ) ) {
+		unsigned cycles, event, record_id, value;
+
+		if ( 2 == sscanf( line, "trace %u %u", &expected, &hz ) ) {
+			started = 1;
+		} else if ( ! started ) {
+			continue;
+		} else if ( 2 == sscanf( line, "task %u %127s", &id, name ) ) {
+			_Decode_Set_Name( decode_task_names, id, name );
+		} else if ( 2 == sscanf( line, "isr %u %127[^\r\n]", &id, name ) ) {
+			_Decode_Set_Name( decode_isr_names, id, name );
+		} else if ( 2 == sscanf( line, "queue %u %127s", &id, name ) ) {
+			_Decode_Set_Name( decode_queue_names, id, name );
+		} else if ( 4 == sscanf( line, "r %x %x %x %x", &cycles, &event, &record_id, &value ) ) {
+			trace_record_type record = { cycles, event, record_id, value };
+			double slept = 0;
+
+			// A boot record's cycle count is from before the counter was restarted
+			if ( TRACE_BOOT == record.event ) {
+				have_cycles = 0;
+			} else {
+				if ( have_cycles ) {
+					now += (double) (uint32_t) ( record.cycles - last_cycles ) * 1000000 / hz;
+				}
+				last_cycles = record.cycles;
+				have_cycles = 1;
+			}
+
+			if ( TRACE_SLEEP_ENTER == record.event ) {
+				sleep_cycles = record.cycles;
+				sleep_depth = record.id < DECODE_SLEEP_DEPTHS ? record.id : 0;
+				decode_sleeps[sleep_depth]++;
+			} else if ( TRACE_SLEEP_EXIT == record.event ) {
+				// Less whatever the counter did count (it keeps going under a debugger)
+				slept = ( (uint32_t) record.id << 16 ) | record.value;
+				double counted = (double) (uint32_t) ( record.cycles - sleep_cycles ) * 1000000 / hz;
+				if ( slept > counted ) {
+					now += slept - counted;
+				}
+				decode_asleep[sleep_depth] += slept;
+			}
+
+			if ( record.event < TRACE_EVENTS ) {
+				_Decode_Account( &record, now );
+				if ( timeline ) {
+					_Decode_Print_Record( &record, now, slept );
+				}
+			}
+			records++;
+		} else if ( 0 == strncmp( line, "end", 3 ) ) {
+			break;
+		}
+	}
+
+	if ( ! started || 0 == hz ) {
+		fprintf( stderr, "No trace dump found\n" );
+		return 1;
+	}
+	if ( records != expected ) {
+		fprintf( stderr, "Expected %u records but read %u - was the capture cut short?\n", expected, records );
+	}
+
+	_Decode_Print_Stats( records, now );
+	return 0;
+}